@@ -0,0 +1,423 @@
+#include <SDL.h>
+#include <engine/ecs.h>
+#include <engine/entity.h>
+#include <engine/jobs.h>
+#include <engine/math/constants.h>
+#include <engine/tilemap.h>
+#include <engine/tileops.h>
+#include <engine/worldgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Headless benchmarks of the engine workloads, nothing is rendered so no window is needed.
+// Runs every workload, or the ones named in the arguments.
+
+#define SIM_MAP_SIZE 2048
+#define SIM_STEPS 60
+#define HEAT_MAP_SIZE 2048
+#define HEAT_STEPS 60
+#define RAY_MAP_SIZE 4096
+#define RAY_COUNT (1 << 20)
+#define RAY_BATCHES 5
+#define ENTITY_COUNT 100000
+#define ENTITY_FRAMES 60
+#define ENTITY_SUBSTEPS 50
+#define TILEOPS_TILES (16 * 1024 * 1024)
+#define TILEOPS_REPEAT 10
+
+typedef void (*BENCH_FN)();
+
+static double now_ms() {
+	return (double)SDL_GetPerformanceCounter() * 1000 / SDL_GetPerformanceFrequency();
+}
+
+// 1, 2, 4... up to the cores, and the cores. Returns how many.
+static int thread_counts(int *counts) {
+	int cores = SDL_GetCPUCount();
+	int n = 0;
+
+	for (int threads = 1; threads < cores && threads < JOBS_MAX_THREADS; threads *= 2)
+		counts[n++] = threads;
+	counts[n++] = SDL_min(cores, JOBS_MAX_THREADS);
+	return n;
+}
+
+// A generated world with sand and water poured over the surface, so most chunks stay awake.
+static Tilemap *create_sim_world(int size) {
+	WorldGenParams params;
+	engine_worldgen_params(&params, 1, size);
+	Tilemap *t = engine_worldgen_create(&params, size, size, 8, TILEMAP_RENDER_MESH);
+
+	for (int x = 0; x < size; x += 64) {
+		engine_tilemap_set_rect(t, (Rect2Di){x, 0, 32, params.surface / 2}, TILE_SAND);
+		engine_tilemap_set_rect(t, (Rect2Di){x + 32, 0, 32, params.surface / 2}, TILE_WATER);
+	}
+
+	return t;
+}
+
+// Cells per second of the falling sand simulation from one thread to all the cores. The tiles
+// must end up the same for every thread count.
+static void bench_sim() {
+	int counts[JOBS_MAX_THREADS];
+	int n = thread_counts(counts);
+	Tile *reference = NULL;
+	double base = 0;
+
+	printf("sim: %dx%d, %d steps\n", SIM_MAP_SIZE, SIM_MAP_SIZE, SIM_STEPS);
+	for (int i = 0; i < n; i++) {
+		engine_jobs_init(counts[i]);
+		Tilemap *t = create_sim_world(SIM_MAP_SIZE);
+
+		unsigned long cells = 0;
+		double start = now_ms();
+		for (int s = 0; s < SIM_STEPS; s++) {
+			engine_tilemap_simulate(t);
+			cells += t->sim_stats.cells_updated;
+		}
+		double ms = now_ms() - start;
+
+		size_t size = sizeof(Tile) * SIM_MAP_SIZE * SIM_MAP_SIZE;
+		if (!reference) {
+			reference = malloc(size);
+			memcpy(reference, t->tiles, size);
+			base = cells / ms;
+		}
+
+		printf("  %2d threads: %8.2f ms/step %8.1f Mcells/s  x%.2f  %s\n", counts[i], ms / SIM_STEPS,
+			   cells / ms / 1000, cells / ms / base, memcmp(reference, t->tiles, size) == 0 ? "same" : "DIFFERENT");
+
+		t->entity.on_free(&t->entity);
+		engine_jobs_quit();
+	}
+
+	free(reference);
+}
+
+// Cells per second of the heat diffusion over a world with lava and water pools, without the
+// simulation so only the temperatures change. They must end up the same for every thread count.
+static void bench_heat() {
+	int counts[JOBS_MAX_THREADS];
+	int n = thread_counts(counts);
+	float *reference = NULL;
+	double base = 0;
+
+	printf("heat: %dx%d, %d steps\n", HEAT_MAP_SIZE, HEAT_MAP_SIZE, HEAT_STEPS);
+	for (int i = 0; i < n; i++) {
+		engine_jobs_init(counts[i]);
+		WorldGenParams params;
+		engine_worldgen_params(&params, 1, HEAT_MAP_SIZE);
+		Tilemap *t = engine_worldgen_create(&params, HEAT_MAP_SIZE, HEAT_MAP_SIZE, 8, TILEMAP_RENDER_MESH);
+
+		for (int y = 0; y < HEAT_MAP_SIZE; y += 128) {
+			for (int x = 0; x < HEAT_MAP_SIZE; x += 128) {
+				TileType type = (x / 128 + y / 128) % 2 ? TILE_LAVA : TILE_WATER;
+				engine_tilemap_set_rect(t, (Rect2Di){x + 48, y + 48, 32, 32}, type);
+			}
+		}
+
+		unsigned long cells = 0;
+		double start = now_ms();
+		for (int s = 0; s < HEAT_STEPS; s++) {
+			engine_tilemap_diffuse_heat(t);
+			cells += t->heat_stats.cells_updated;
+		}
+		double ms = now_ms() - start;
+
+		const float *temperature = engine_tilemap_layer(t, TILE_LAYER_TEMPERATURE);
+		size_t size = sizeof(float) * HEAT_MAP_SIZE * HEAT_MAP_SIZE;
+		if (!reference) {
+			reference = malloc(size);
+			memcpy(reference, temperature, size);
+			base = cells / ms;
+		}
+
+		printf("  %2d threads: %8.2f ms/step %8.1f Mcells/s  x%.2f  %s\n", counts[i], ms / HEAT_STEPS,
+			   cells / ms / 1000, cells / ms / base, memcmp(reference, temperature, size) == 0 ? "same" : "DIFFERENT");
+
+		t->entity.on_free(&t->entity);
+		engine_jobs_quit();
+	}
+
+	free(reference);
+}
+
+// Rays per second of the batched raycasts across a large generated world, from random origins in
+// random directions up to a screen away. The hits must be the same for every thread count.
+static void bench_rays() {
+	int counts[JOBS_MAX_THREADS];
+	int n = thread_counts(counts);
+	TileRay *rays = malloc(sizeof(TileRay) * RAY_COUNT);
+	TileRayHit *hits = malloc(sizeof(TileRayHit) * RAY_COUNT);
+	TileRayHit *reference = NULL;
+	double base = 0;
+
+	srand(1);
+	for (int i = 0; i < RAY_COUNT; i++) {
+		float angle = (float)rand() / RAND_MAX * 2 * (float)M_PI;
+		rays[i] = (TileRay){(float)(rand() % RAY_MAP_SIZE) * 8, (float)(rand() % RAY_MAP_SIZE) * 8, cosf(angle),
+							sinf(angle), 1920};
+	}
+
+	printf("rays: %dx%d, %d rays, %d batches\n", RAY_MAP_SIZE, RAY_MAP_SIZE, RAY_COUNT, RAY_BATCHES);
+	for (int i = 0; i < n; i++) {
+		engine_jobs_init(counts[i]);
+		WorldGenParams params;
+		engine_worldgen_params(&params, 1, RAY_MAP_SIZE);
+		Tilemap *t = engine_worldgen_create(&params, RAY_MAP_SIZE, RAY_MAP_SIZE, 8, TILEMAP_RENDER_MESH);
+
+		// The first batch builds the occupancy bits, not timed.
+		memset(hits, 0, sizeof(TileRayHit) * RAY_COUNT);
+		engine_tilemap_raycast_batch(t, rays, hits, RAY_COUNT, TILE_QUERY_SOLID);
+
+		double best = 0;
+		for (int b = 0; b < RAY_BATCHES; b++) {
+			engine_tilemap_raycast_batch(t, rays, hits, RAY_COUNT, TILE_QUERY_SOLID);
+			best = SDL_max(best, t->ray_stats.rays_per_second);
+		}
+
+		if (!reference) {
+			reference = malloc(sizeof(TileRayHit) * RAY_COUNT);
+			memcpy(reference, hits, sizeof(TileRayHit) * RAY_COUNT);
+			base = best;
+		}
+
+		printf("  %2d threads: %8.2f Mrays/s  x%.2f  %s\n", counts[i], best / 1e6, best / base,
+			   memcmp(reference, hits, sizeof(TileRayHit) * RAY_COUNT) == 0 ? "same" : "DIFFERENT");
+
+		t->entity.on_free(&t->entity);
+		engine_jobs_quit();
+	}
+
+	free(reference);
+	free(hits);
+	free(rays);
+}
+
+typedef struct BenchEntity {
+	Entity entity;
+	float x, y, vx, vy;
+} BenchEntity;
+
+// Only changes the entity itself, so it can run in parallel.
+static void bench_entity_update(Entity *entity, double delta) {
+	BenchEntity *e = (BenchEntity *)entity;
+	float step = (float)delta / 1000 / ENTITY_SUBSTEPS;
+
+	for (int i = 0; i < ENTITY_SUBSTEPS; i++) {
+		e->x += e->vx * step;
+		e->y += e->vy * step;
+		if (e->x < 0 || e->x > 1000)
+			e->vx = -e->vx;
+		if (e->y < 0 || e->y > 1000)
+			e->vy = -e->vy;
+	}
+}
+
+static void bench_entity_free(Entity *entity) {
+	free(entity);
+}
+
+// Adds the moving entities, updates them for ENTITY_FRAMES and removes them. Returns the ms per
+// frame, the positions they ended at go in positions.
+static double run_entities(int parallel, float *positions) {
+	BenchEntity **entities = malloc(sizeof(BenchEntity *) * ENTITY_COUNT);
+
+	srand(1);
+	for (int i = 0; i < ENTITY_COUNT; i++) {
+		BenchEntity *e = malloc(sizeof(BenchEntity));
+		memset(e, 0, sizeof(BenchEntity));
+		e->entity.on_update = bench_entity_update;
+		e->entity.on_free = bench_entity_free;
+		e->entity.parallel_update = parallel;
+		e->x = (float)(rand() % 1000);
+		e->y = (float)(rand() % 1000);
+		e->vx = (float)(rand() % 200 - 100);
+		e->vy = (float)(rand() % 200 - 100);
+		entities[i] = e;
+		engine_entity_add(&e->entity);
+	}
+	engine_entity_flush();
+
+	double start = now_ms();
+	for (int f = 0; f < ENTITY_FRAMES; f++)
+		engine_ecs_run(ECS_PHASE_UPDATE, 16);
+	double ms = now_ms() - start;
+
+	for (int i = 0; i < ENTITY_COUNT; i++) {
+		positions[i * 2] = entities[i]->x;
+		positions[i * 2 + 1] = entities[i]->y;
+		engine_entity_remove(&entities[i]->entity);
+	}
+	engine_entity_flush();
+
+	free(entities);
+	return ms / ENTITY_FRAMES;
+}
+
+// Frame time of updating many moving entities in order, then with parallel_update from one thread
+// up to all the cores. They must end up in the same positions as in order.
+static void bench_entities() {
+	int counts[JOBS_MAX_THREADS];
+	int n = thread_counts(counts);
+	float *reference = malloc(sizeof(float) * 2 * ENTITY_COUNT);
+	float *positions = malloc(sizeof(float) * 2 * ENTITY_COUNT);
+
+	engine_entity_init();
+
+	printf("entities: %d, %d frames\n", ENTITY_COUNT, ENTITY_FRAMES);
+	engine_jobs_init(1);
+	double serial = run_entities(0, reference);
+	engine_jobs_quit();
+	printf("  in order:   %8.2f ms/frame\n", serial);
+
+	for (int i = 0; i < n; i++) {
+		engine_jobs_init(counts[i]);
+		double ms = run_entities(1, positions);
+		engine_jobs_quit();
+
+		printf("  %2d threads: %8.2f ms/frame  x%.2f  %s\n", counts[i], ms, serial / ms,
+			   memcmp(reference, positions, sizeof(float) * 2 * ENTITY_COUNT) == 0 ? "same" : "DIFFERENT");
+	}
+
+	free(positions);
+	free(reference);
+}
+
+// The loops tileops replaces, one tile at a time.
+static void plain_fill(Tile *tiles, size_t n, TileType type) {
+	for (size_t i = 0; i < n; i++)
+		tiles[i].type = type;
+}
+
+static size_t plain_replace(Tile *tiles, size_t n, TileType from, TileType to) {
+	size_t count = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (tiles[i].type == from) {
+			tiles[i].type = to;
+			count++;
+		}
+	}
+	return count;
+}
+
+static size_t plain_count(const Tile *tiles, size_t n, TileType type) {
+	size_t count = 0;
+	for (size_t i = 0; i < n; i++)
+		count += tiles[i].type == type;
+	return count;
+}
+
+static void plain_histogram(const Tile *tiles, size_t n, unsigned long *hist) {
+	for (size_t i = 0; i < n; i++)
+		hist[tiles[i].type]++;
+}
+
+// A tile with its layers next to it, what the layers replaced.
+typedef struct AosTile {
+	uint8_t type;
+	uint8_t lifetime;
+	float temperature;
+} AosTile;
+
+static void random_tiles(Tile *tiles, size_t n) {
+	srand(1);
+	for (size_t i = 0; i < n; i++)
+		tiles[i].type = rand() % NUM_TILE_TYPES;
+}
+
+// Best of TILEOPS_REPEAT, in GB/s over the tiles. The tiles are refilled before each run.
+#define MEASURE(result, tiles, n, call)          \
+	do {                                         \
+		double best = 0;                         \
+		for (int r = 0; r < TILEOPS_REPEAT; r++) { \
+			random_tiles(tiles, n);              \
+			double start = now_ms();             \
+			call;                                \
+			double ms = now_ms() - start;        \
+			if (best == 0 || ms < best)          \
+				best = ms;                       \
+		}                                        \
+		result = (double)(n) / best / 1e6;       \
+	} while (0)
+
+// The tileops kernels against the plain loops, and the type layer against tiles stored with their
+// layers, both in GB/s of tiles. The counts check both give the same result.
+static void bench_tileops() {
+	size_t n = TILEOPS_TILES;
+	Tile *tiles = SDL_SIMDAlloc(sizeof(Tile) * n);
+	unsigned long hist[NUM_TILE_TYPES];
+	size_t a = 0, b = 0;
+	double fast, plain;
+
+	printf("tileops: %d Mtiles, %s kernels, GB/s\n", TILEOPS_TILES >> 20, engine_tileops_kernel());
+
+	MEASURE(fast, tiles, n, engine_tileops_fill(tiles, n, TILE_ROCK));
+	MEASURE(plain, tiles, n, plain_fill(tiles, n, TILE_ROCK));
+	printf("  fill:      %7.2f  plain %7.2f  x%.1f\n", fast, plain, fast / plain);
+
+	MEASURE(fast, tiles, n, a = engine_tileops_replace(tiles, n, TILE_SAND, TILE_WATER));
+	MEASURE(plain, tiles, n, b = plain_replace(tiles, n, TILE_SAND, TILE_WATER));
+	printf("  replace:   %7.2f  plain %7.2f  x%.1f  %s\n", fast, plain, fast / plain, a == b ? "same" : "DIFFERENT");
+
+	MEASURE(fast, tiles, n, a = engine_tileops_count(tiles, n, TILE_LAVA));
+	MEASURE(plain, tiles, n, b = plain_count(tiles, n, TILE_LAVA));
+	printf("  count:     %7.2f  plain %7.2f  x%.1f  %s\n", fast, plain, fast / plain, a == b ? "same" : "DIFFERENT");
+
+	MEASURE(fast, tiles, n, (memset(hist, 0, sizeof(hist)), engine_tileops_histogram(tiles, n, hist)));
+	a = hist[TILE_LAVA];
+	MEASURE(plain, tiles, n, (memset(hist, 0, sizeof(hist)), plain_histogram(tiles, n, hist)));
+	b = hist[TILE_LAVA];
+	printf("  histogram: %7.2f  plain %7.2f  x%.1f  %s\n", fast, plain, fast / plain, a == b ? "same" : "DIFFERENT");
+
+	// Counting the types only reads one byte per tile from the layer, against a whole AosTile.
+	AosTile *aos = malloc(sizeof(AosTile) * n);
+	random_tiles(tiles, n);
+	for (size_t i = 0; i < n; i++)
+		aos[i] = (AosTile){tiles[i].type, 0, TILEMAP_AMBIENT_TEMPERATURE};
+
+	double best_soa = 0, best_aos = 0;
+	for (int r = 0; r < TILEOPS_REPEAT; r++) {
+		double start = now_ms();
+		a = plain_count(tiles, n, TILE_LAVA);
+		double ms = now_ms() - start;
+		best_soa = best_soa == 0 || ms < best_soa ? ms : best_soa;
+
+		start = now_ms();
+		b = 0;
+		for (size_t i = 0; i < n; i++)
+			b += aos[i].type == TILE_LAVA;
+		ms = now_ms() - start;
+		best_aos = best_aos == 0 || ms < best_aos ? ms : best_aos;
+	}
+	printf("  layer:     %7.2f  with layers %7.2f  x%.1f  %s\n", n / best_soa / 1e6, n / best_aos / 1e6,
+		   best_aos / best_soa, a == b ? "same" : "DIFFERENT");
+
+	free(aos);
+	SDL_SIMDFree(tiles);
+}
+
+static const struct {
+	const char *name;
+	BENCH_FN fn;
+} benches[] = {
+	{"entities", bench_entities},
+	{"sim", bench_sim},
+	{"heat", bench_heat},
+	{"rays", bench_rays},
+	{"tileops", bench_tileops},
+};
+
+int main(int argc, char *argv[]) {
+	for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+		int run = argc == 1;
+		for (int a = 1; a < argc; a++)
+			run = run || strcmp(argv[a], benches[i].name) == 0;
+
+		if (run)
+			benches[i].fn();
+	}
+
+	return 0;
+}
@@ -0,0 +1,7 @@
+#version 330 core
+
+in vec4 particleColor;
+
+void main() {
+	gl_FragColor = particleColor;
+}
@@ -0,0 +1,20 @@
+#version 330 core
+
+layout (location = 0) in vec2 corner;
+layout (location = 1) in float x;
+layout (location = 2) in float y;
+layout (location = 3) in float age;
+
+out vec4 particleColor;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform vec4 colorStart;
+uniform vec4 colorEnd;
+uniform vec2 size; // At the start and at the end.
+
+void main() {
+	float s = mix(size.x, size.y, age);
+	gl_Position = projection * view * vec4(vec2(x, y) + corner * s, 0, 1);
+	particleColor = mix(colorStart, colorEnd, age);
+}
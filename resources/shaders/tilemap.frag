@@ -1,7 +1,15 @@
 #version 330 core
 
 in vec4 tileColor;
+in vec2 mapPos;
+
+uniform sampler2D light;
+uniform vec2 mapSize; // In pixels.
+uniform float lightScale;
+uniform float ambient;
 
 void main() {
-	gl_FragColor = (1.f / 255.f) * tileColor;
+	float level = min(1.f, texture(light, mapPos / mapSize).r * lightScale);
+	vec4 color = (1.f / 255.f) * tileColor;
+	gl_FragColor = vec4(color.rgb * (ambient + (1.f - ambient) * level), color.a);
 }
@@ -0,0 +1,16 @@
+#version 330 core
+
+in vec2 tilePos;
+
+uniform usampler2D tiles;
+uniform vec4 palette[16];
+uniform sampler2D light;
+uniform float lightScale;
+uniform float ambient;
+
+void main() {
+	uint id = texelFetch(tiles, ivec2(floor(tilePos)), 0).r;
+	float level = min(1.f, texture(light, tilePos / vec2(textureSize(light, 0))).r * lightScale);
+	vec4 color = palette[id];
+	gl_FragColor = vec4(color.rgb * (ambient + (1.f - ambient) * level), color.a);
+}
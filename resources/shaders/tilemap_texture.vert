@@ -0,0 +1,16 @@
+#version 330 core
+
+layout (location = 0) in vec2 vertex;
+
+out vec2 tilePos;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform vec4 area;
+uniform float tileSize;
+
+void main() {
+	vec2 pos = area.xy + vertex * area.zw;
+	tilePos = pos / tileSize;
+	gl_Position = projection * view * vec4(pos, 0, 1);
+}
@@ -1,14 +1,18 @@
 #include "config.h"
 #include <engine/engine.h>
 #include <engine/logger.h>
+#include <engine/random.h>
 #include <engine/tilemap.h>
 #include <engine/ui/button.h>
 #include <engine/ui/textbox.h>
+#include <engine/worldgen.h>
 
 int main(int argc, const char *argv[]) {
 	engine_init("SimpleGame", argc, argv);
 
-	Tilemap *tilemap = engine_tilemap_create(100, 100, 8, TILE_FIRE);
+	WorldGenParams params;
+	engine_worldgen_params(&params, engine_random_next(engine_random()), 100);
+	Tilemap *tilemap = engine_worldgen_create(&params, 100, 100, 8, TILEMAP_RENDER_MESH);
 	Rect2Di c = (Rect2Di){0, 0, 100, 100};
 	engine_tilemap_set_rect_wall(tilemap, c, TILE_SAND);
 	engine_entity_add((Entity *)tilemap);
@@ -4,6 +4,8 @@
 #include <math.h>
 #include <stdlib.h>
 
+static Camera *active_camera = NULL;
+
 Camera *camera_create() {
 	Camera *c = malloc(sizeof(Camera));
 	glm_vec3_zero(c->pos);
@@ -25,3 +27,22 @@ void camera_update(Camera *c) {
 		engine_shader_update_camera(c);
 	}
 }
+
+void camera_set_active(Camera *c) {
+	active_camera = c;
+}
+
+Camera *camera_get_active() {
+	return active_camera;
+}
+
+void camera_view_rect(Camera *c, Rect2Df *out) {
+	SDL_assert(out);
+	engine_util_screen(out);
+
+	if (c) {
+		// The view translates the world by pos, so the visible area moves the other way.
+		out->x = -c->pos[0];
+		out->y = -c->pos[1];
+	}
+}
@@ -23,4 +23,11 @@ Camera *camera_create();
 void camera_move(Camera *c, float offX, float offY, float speed);
 void camera_update(Camera *c);
 
+// The active camera is used to cull what is not visible, NULL means the screen.
+void camera_set_active(Camera *c);
+Camera *camera_get_active();
+
+// The area of the world seen through the camera, in pixels. NULL means the screen.
+void camera_view_rect(Camera *c, Rect2Df *out);
+
 #endif
@@ -0,0 +1,205 @@
+#include "ecs.h"
+#include <SDL_assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct EcsRecord {
+	uint32_t generation; // Bumped on destroy, so old ids don't match.
+	int table; // -1 if free.
+	int row;
+	uint32_t next_free;
+} EcsRecord;
+
+typedef struct EcsSystem {
+	EcsMask mask;
+	ECS_SYSTEM_FN fn;
+	void *data;
+} EcsSystem;
+
+static size_t component_sizes[ECS_MAX_COMPONENTS];
+static int component_count = 0;
+
+static EcsRecord *records = NULL;
+static uint32_t record_count = 0;
+static uint32_t record_capacity = 0;
+static uint32_t free_record = UINT32_MAX;
+
+static EcsTable *tables = NULL;
+static int table_count = 0;
+static int table_capacity = 0;
+
+static EcsSystem systems[NUM_ECS_PHASES][ECS_MAX_SYSTEMS];
+static int system_count[NUM_ECS_PHASES];
+
+int engine_ecs_component(size_t size) {
+	if (component_count == ECS_MAX_COMPONENTS)
+		return -1;
+
+	component_sizes[component_count] = size;
+	return component_count++;
+}
+
+// Returns the index of the table with exactly these components, creating it if needed.
+static int get_table(EcsMask mask) {
+	for (int i = 0; i < table_count; i++) {
+		if (tables[i].mask == mask)
+			return i;
+	}
+
+	if (table_count == table_capacity) {
+		table_capacity = table_capacity ? table_capacity * 2 : 16;
+		tables = realloc(tables, sizeof(EcsTable) * table_capacity);
+	}
+
+	EcsTable *table = &tables[table_count];
+	memset(table, 0, sizeof(EcsTable));
+	table->mask = mask;
+	return table_count++;
+}
+
+// Returns the new row, zeroed.
+static int push_row(EcsTable *table, EcsId id) {
+	if (table->count == table->capacity) {
+		table->capacity = table->capacity ? table->capacity * 2 : 64;
+		table->ids = realloc(table->ids, sizeof(EcsId) * table->capacity);
+		for (int c = 0; c < component_count; c++) {
+			if (table->mask & ECS_MASK(c))
+				table->columns[c] = realloc(table->columns[c], component_sizes[c] * table->capacity);
+		}
+	}
+
+	int row = table->count++;
+	table->ids[row] = id;
+	for (int c = 0; c < component_count; c++) {
+		if (table->mask & ECS_MASK(c))
+			memset((char *)table->columns[c] + component_sizes[c] * row, 0, component_sizes[c]);
+	}
+
+	return row;
+}
+
+// The last row takes the place of the removed one.
+static void remove_row(EcsTable *table, int row) {
+	int last = --table->count;
+	if (row == last)
+		return;
+
+	table->ids[row] = table->ids[last];
+	records[table->ids[row].index].row = row;
+	for (int c = 0; c < component_count; c++) {
+		if (table->mask & ECS_MASK(c)) {
+			size_t size = component_sizes[c];
+			memcpy((char *)table->columns[c] + size * row, (char *)table->columns[c] + size * last, size);
+		}
+	}
+}
+
+EcsId engine_ecs_create(EcsMask mask) {
+	uint32_t index;
+
+	if (free_record != UINT32_MAX) {
+		index = free_record;
+		free_record = records[index].next_free;
+	} else {
+		if (record_count == record_capacity) {
+			record_capacity = record_capacity ? record_capacity * 2 : 256;
+			records = realloc(records, sizeof(EcsRecord) * record_capacity);
+		}
+		index = record_count++;
+		records[index].generation = 1;
+	}
+
+	EcsId id = {index, records[index].generation};
+	EcsRecord *record = &records[index];
+	record->table = get_table(mask);
+	record->row = push_row(&tables[record->table], id);
+	return id;
+}
+
+int engine_ecs_alive(EcsId id) {
+	return id.index < record_count && records[id.index].generation == id.generation;
+}
+
+void engine_ecs_destroy(EcsId id) {
+	SDL_assert(engine_ecs_alive(id));
+
+	EcsRecord *record = &records[id.index];
+	remove_row(&tables[record->table], record->row);
+	record->table = -1;
+	record->generation++;
+	record->next_free = free_record;
+	free_record = id.index;
+}
+
+void *engine_ecs_get(EcsId id, int component) {
+	if (!engine_ecs_alive(id))
+		return NULL;
+
+	EcsRecord *record = &records[id.index];
+	EcsTable *table = &tables[record->table];
+	if (!(table->mask & ECS_MASK(component)))
+		return NULL;
+
+	return (char *)table->columns[component] + component_sizes[component] * record->row;
+}
+
+static void move_to(EcsId id, EcsMask mask) {
+	SDL_assert(engine_ecs_alive(id));
+
+	EcsRecord *record = &records[id.index];
+	if (tables[record->table].mask == mask)
+		return;
+
+	// get_table may move the tables, so they are looked up by index.
+	int to = get_table(mask);
+	int from = record->table;
+	int from_row = record->row;
+	int row = push_row(&tables[to], id);
+
+	EcsMask shared = tables[from].mask & mask;
+	for (int c = 0; c < component_count; c++) {
+		if (shared & ECS_MASK(c)) {
+			size_t size = component_sizes[c];
+			memcpy((char *)tables[to].columns[c] + size * row, (char *)tables[from].columns[c] + size * from_row, size);
+		}
+	}
+
+	remove_row(&tables[from], from_row);
+	record->table = to;
+	record->row = row;
+}
+
+void engine_ecs_add(EcsId id, int component) {
+	SDL_assert(engine_ecs_alive(id));
+	move_to(id, tables[records[id.index].table].mask | ECS_MASK(component));
+}
+
+void engine_ecs_remove(EcsId id, int component) {
+	SDL_assert(engine_ecs_alive(id));
+	move_to(id, tables[records[id.index].table].mask & ~ECS_MASK(component));
+}
+
+int engine_ecs_system(EcsPhase phase, EcsMask mask, ECS_SYSTEM_FN fn, void *data) {
+	if (system_count[phase] == ECS_MAX_SYSTEMS)
+		return 0;
+
+	systems[phase][system_count[phase]++] = (EcsSystem){mask, fn, data};
+	return 1;
+}
+
+void engine_ecs_run(EcsPhase phase, double delta) {
+	for (int s = 0; s < system_count[phase]; s++) {
+		EcsSystem *system = &systems[phase][s];
+
+		if (!system->mask) {
+			system->fn(NULL, delta, system->data);
+			continue;
+		}
+
+		for (int t = 0; t < table_count; t++) {
+			EcsTable *table = &tables[t];
+			if (table->count > 0 && (table->mask & system->mask) == system->mask)
+				system->fn(table, delta, system->data);
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef ENGINE_ECS_H
+#define ENGINE_ECS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Opt-in storage for many simple objects, next to the entities. An object is an id with a set of
+// components, plain structs registered with engine_ecs_component. The objects with the same set
+// share a table holding an array per component, and systems run over the arrays of every table
+// having their components. The entity callbacks run as systems too, so both live in the same frame.
+//
+// Creating, destroying or changing the components of objects moves rows of the tables. Don't do it
+// from a system over the same tables, keep the ids and do it after engine_ecs_run.
+
+#define ECS_MAX_COMPONENTS 64
+#define ECS_MAX_SYSTEMS 64
+#define ECS_MASK(component) ((EcsMask)1 << (component))
+
+// Array of a component in a table, type has to be the registered one.
+#define ECS_COLUMN(table, type, component) ((type *)(table)->columns[component])
+
+// Bit per component.
+typedef uint64_t EcsMask;
+
+// Stale once the object is destroyed, the zero id is never valid.
+typedef struct EcsId {
+	uint32_t index;
+	uint32_t generation;
+} EcsId;
+
+typedef enum EcsPhase {
+	ECS_PHASE_UPDATE,
+	ECS_PHASE_RENDER,
+	NUM_ECS_PHASES
+} EcsPhase;
+
+// The objects with the same components, row by row.
+typedef struct EcsTable {
+	EcsMask mask;
+	EcsId *ids;
+	void *columns[ECS_MAX_COMPONENTS]; // NULL for the components not in the mask.
+	int count;
+	int capacity;
+} EcsTable;
+
+// Called for every table with the components of the system. Systems without components are called
+// once per run with a NULL table.
+typedef void (*ECS_SYSTEM_FN)(EcsTable *table, double delta, void *data);
+
+// Returns the id of the component, -1 if there are already ECS_MAX_COMPONENTS.
+int engine_ecs_component(size_t size);
+
+// The components start zeroed.
+EcsId engine_ecs_create(EcsMask mask);
+void engine_ecs_destroy(EcsId id);
+int engine_ecs_alive(EcsId id);
+
+// Returns the component of the object, NULL if it doesn't have it. Valid until the object moves.
+void *engine_ecs_get(EcsId id, int component);
+
+// Both move the object to the table of its new components.
+void engine_ecs_add(EcsId id, int component);
+void engine_ecs_remove(EcsId id, int component);
+
+// Systems run in the order they were added. Returns 0 if there are already ECS_MAX_SYSTEMS.
+int engine_ecs_system(EcsPhase phase, EcsMask mask, ECS_SYSTEM_FN fn, void *data);
+
+// Runs the systems of the phase, called from the engine loop.
+void engine_ecs_run(EcsPhase phase, double delta);
+
+#endif
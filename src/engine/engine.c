@@ -1,17 +1,25 @@
 #include "engine.h"
+#include <engine/ecs.h>
 #include <engine/entity.h>
 #include <engine/graphics/renderer.h>
 #include <engine/input.h>
 #include <engine/io.h>
+#include <engine/jobs.h>
 #include <engine/logger.h>
 #include <engine/math/vector.h>
+#include <engine/memory.h>
+#include <engine/random.h>
+#include <engine/replay.h>
 #include <engine/settings.h>
+#include <string.h>
 
 // TODO: Render circle
 // TODO: Render texture
 // TODO: Resource manager
 
 static int running = 0;
+static int log_stats = 0;
+static Tick next_stats_tick = 0;
 
 void engine_init(const char *pName, int argc, const char *argv[]) {
 
@@ -29,12 +37,19 @@ void engine_init(const char *pName, int argc, const char *argv[]) {
 	engine_settings_add_int("msaa_enable", 1, 0, 1);
 	engine_settings_add_int("msaa_value", 2, 0, 4);
 	engine_settings_add_int("vsync", 1, 0, 1);
+	engine_settings_add_int("tilemap_upload_budget", 1 << 20, 1 << 12, 1 << 28);
+	// Threads of the job system, 0 means one per core. Named from when only the simulation had threads.
+	engine_settings_add_int("sim_threads", 0, 0, 64);
+	// Logs the render and memory counters of a frame every second.
+	engine_settings_add_int("log_stats", 0, 0, 1);
 
 	if (!engine_io_file_exists("settings.ini")) {
 		engine_log_info("Settings doesn't exist, creating it.\n");
 		engine_settings_save("settings.ini");
 	}
 	engine_settings_load("settings.ini");
+	log_stats = engine_settings_get_int("log_stats");
+	engine_jobs_init(engine_settings_get_int("sim_threads"));
 
 	if (!engine_render_init(pName)) {
 		engine_log_write(LOG_ERROR, "Error creating renderer: %s", SDL_GetError());
@@ -44,24 +59,52 @@ void engine_init(const char *pName, int argc, const char *argv[]) {
 	engine_input_init();
 	engine_entity_init();
 	engine_render_clear_color(COLOR_WHITE);
+	engine_random_seed(engine_random(), ENGINE_RANDOM_SEED);
+
+	for (int i = 1; i < argc - 1; i++) {
+		if (strcmp(argv[i], "--record") == 0)
+			engine_replay_record(argv[++i]);
+		else if (strcmp(argv[i], "--replay") == 0)
+			engine_replay_play(argv[++i]);
+	}
 
 	// TODO: Add entity manager and initialize it here.
-	// TODO: Add function to set a active camera, create one by default?
+	// TODO: Create a camera by default?
 };
 
 void engine_on_tick() {
 	SDL_Event event;
 
-	while (SDL_PollEvent(&event)) {
+	while (engine_replay_poll_event(&event)) {
 		if (event.type == SDL_QUIT) {
 			running = 0;
 		}
 		engine_entity_onevent(&event);
 	}
+	engine_entity_flush();
 
 	engine_input_update();
 	engine_util_update();
-	engine_entity_onupdate();
+	engine_ecs_run(ECS_PHASE_UPDATE, engine_util_delta_time());
+
+	// So the entities added by the update are rendered this frame.
+	engine_entity_flush();
+}
+
+// Called after the frame, the render stats are reset by the next clear.
+static void print_stats() {
+	if (!engine_util_tick_passed(next_stats_tick))
+		return;
+	next_stats_tick = engine_util_tick() + 1000;
+
+	const RenderStats *r = engine_render_stats();
+	const MemoryStats *m = engine_memory_stats();
+	engine_log_info("Frame: %u draw calls, %u/%u chunks visible, %u uploads of %lu bytes, %u particles", r->draw_calls,
+					r->tilemap_chunks_visible, r->tilemap_chunks_total, r->tilemap_uploads, r->tilemap_upload_bytes,
+					r->particles);
+	engine_log_info("Memory: %u heap allocs, %u pool allocs, %u pool frees, %lu of %lu frame arena bytes",
+					m->heap_allocs, m->pool_allocs, m->pool_frees, (unsigned long)m->frame_bytes,
+					(unsigned long)m->frame_capacity);
 }
 
 int engine_run() {
@@ -71,12 +114,17 @@ int engine_run() {
 
 		engine_render_clear();
 
-		engine_entity_onrender();
+		engine_ecs_run(ECS_PHASE_RENDER, engine_util_delta_time());
 
 		engine_render_present();
+		engine_memory_frame_reset();
+		if (log_stats)
+			print_stats();
 		// SDL_Delay(1);
 	}
 
+	engine_replay_stop();
+	engine_jobs_quit();
 	engine_settings_save("settings.ini");
 	engine_render_quit();
 	engine_settings_quit();
@@ -1,11 +1,101 @@
 #include "entity.h"
 #include <SDL_assert.h>
 #include <SDL_events.h>
-#include <engine/list.h>
+#include <SDL_mouse.h>
+#include <SDL_version.h>
+#include <engine/ecs.h>
+#include <engine/jobs.h>
 #include <engine/logger.h>
-#include <engine/util.h>
+#include <engine/spatial.h>
+#include <stdlib.h>
+#include <string.h>
 
-static List *entity_list;
+typedef struct EntitySlot {
+	Entity *entity; // NULL if free.
+	uint32_t generation; // Bumped on removal, so old handles don't match.
+	uint32_t next_free;
+	int position; // In the stored entities, -1 until the add is applied.
+} EntitySlot;
+
+// Sort key of an entity to render, or in an event list.
+typedef struct RenderKey {
+	unsigned int priority;
+	Entity *entity;
+} RenderKey;
+
+// Handles index the slots, which point to the entities.
+static EntitySlot *slots = NULL;
+static uint32_t slot_count = 0;
+static uint32_t slot_capacity = 0;
+static uint32_t free_slot = UINT32_MAX; // Head of the free slots.
+
+// In the order they were added, NULL where removed, compacted before the next update.
+static Entity **stored = NULL;
+static int stored_count = 0;
+static int stored_capacity = 0;
+static int stored_holes = 0;
+static int entity_count = 0;
+
+// The entities to render or with events, sorted again every frame by their current priority.
+static RenderKey *render_keys = NULL;
+static RenderKey *render_keys_sorted = NULL;
+static int render_key_capacity = 0;
+
+// The entities being subscribed, apart from the render ones as engine_entity_moved may be called
+// while rendering.
+static RenderKey *subscribe_keys = NULL;
+static RenderKey *subscribe_keys_sorted = NULL;
+static int subscribe_key_capacity = 0;
+
+// Events with a list of the entities having a callback for them.
+typedef enum EntityEvent {
+	EVENT_MOUSE_BUTTON, // Only the entities without bounds, the others are found in the grid.
+	EVENT_MOUSE_WHEEL, // Same.
+	EVENT_MOUSE_MOTION,
+	EVENT_KEYUP,
+	EVENT_KEYDOWN,
+	EVENT_TEXTINPUT,
+	EVENT_TEXTEDITING,
+	EVENT_RESIZE,
+	NUM_ENTITY_EVENTS
+} EntityEvent;
+
+// In the render order, by the priorities of the last sort. Entities added since are merged in with
+// their current one.
+typedef struct EntityList {
+	RenderKey *keys;
+	int count;
+	int capacity;
+} EntityList;
+
+static SpatialGrid *grid; // Entities with bounds.
+static EntityList subscribers[NUM_ENTITY_EVENTS];
+static unsigned int next_order = 0;
+
+// Entities with bounds under the mouse, for a mouse event.
+static Entity **candidates = NULL;
+static int candidate_count = 0;
+static int candidate_capacity = 0;
+
+// Entities an event goes to, in order. Handles, so the callbacks can remove entities.
+static EntityHandle *targets = NULL;
+static int target_count = 0;
+static int target_capacity = 0;
+static int event_stopped = 0;
+
+// Queued by engine_entity_add and engine_entity_remove, applied by engine_entity_flush.
+static Entity **added = NULL;
+static int added_count = 0;
+static int added_capacity = 0;
+static Entity **removed = NULL;
+static int removed_count = 0;
+static int removed_capacity = 0;
+
+// Entities with parallel_update, in no order. Split in chunks of PARALLEL_CHUNK across the jobs.
+#define PARALLEL_CHUNK 256
+static Entity **parallel = NULL;
+static int parallel_count = 0;
+static int parallel_capacity = 0;
 
 static void entity_free(void *data) {
 	if (!data)
@@ -21,94 +111,593 @@ static void entity_free(void *data) {
 	entity->on_free(entity);
 }
 
-static Entity *entity_to_check = NULL;
-static int entity_equals(void *data) {
-	return (Entity *)data == entity_to_check;
-}
+static void update_entities(EcsTable *table, double delta, void *data);
+static void render_entities(EcsTable *table, double delta, void *data);
 
 void engine_entity_init() {
-	entity_list = engine_list_create_fn(entity_free);
+	grid = engine_spatial_create();
+
+	// The entity callbacks run before the systems added later.
+	engine_ecs_system(ECS_PHASE_UPDATE, 0, update_entities, NULL);
+	engine_ecs_system(ECS_PHASE_RENDER, 0, render_entities, NULL);
+}
+
+static void push_entity(Entity ***array, int *count, int *capacity, Entity *entity) {
+	if (*count == *capacity) {
+		*capacity = *capacity ? *capacity * 2 : 16;
+		*array = realloc(*array, sizeof(Entity *) * *capacity);
+	}
+	(*array)[(*count)++] = entity;
+}
+
+// The render order, by the current priority then by when they were added.
+static int compare_entities(const Entity *a, const Entity *b) {
+	if (a->render_priority != b->render_priority)
+		return a->render_priority < b->render_priority ? -1 : 1;
+	return a->order < b->order ? -1 : a->order > b->order;
 }
 
-void engine_entity_add(Entity *entity) {
-	SDL_assert(entity_list);
+static int compare_keys(const RenderKey *a, const RenderKey *b) {
+	if (a->priority != b->priority)
+		return a->priority < b->priority ? -1 : 1;
+	return a->entity->order < b->entity->order ? -1 : a->entity->order > b->entity->order;
+}
+
+static int subscribes(const Entity *entity, EntityEvent event) {
+	switch (event) {
+	case EVENT_MOUSE_BUTTON:
+		return !entity->indexed && (entity->on_mouse_button_up || entity->on_mouse_button_down);
+	case EVENT_MOUSE_WHEEL:
+		return !entity->indexed && entity->on_mouse_wheel;
+	case EVENT_MOUSE_MOTION:
+		return entity->on_mouse_motion != NULL;
+	case EVENT_KEYUP:
+		return entity->on_keyup != NULL;
+	case EVENT_KEYDOWN:
+		return entity->on_keydown != NULL;
+	case EVENT_TEXTINPUT:
+		return entity->on_textinput != NULL;
+	case EVENT_TEXTEDITING:
+		return entity->on_textediting != NULL;
+	default:
+		return entity->on_resize != NULL;
+	}
+}
+
+static void reserve_keys(RenderKey **keys, RenderKey **sorted, int *capacity, int count) {
+	if (count > *capacity) {
+		*capacity = SDL_max(count, *capacity * 2);
+		*keys = realloc(*keys, sizeof(RenderKey) * *capacity);
+		*sorted = realloc(*sorted, sizeof(RenderKey) * *capacity);
+	}
+}
 
-	// Add sorted
+// Stable radix sort of the keys by priority, a byte per pass. Returns the sorted ones, which can be
+// either array. Passes where every key has the same byte are skipped, so with few small priorities
+// it takes one or two.
+static RenderKey *sort_render_keys(RenderKey *keys, RenderKey *tmp, int count) {
+	int histogram[4][256];
+	memset(histogram, 0, sizeof(histogram));
+	for (int i = 0; i < count; i++) {
+		for (int pass = 0; pass < 4; pass++)
+			histogram[pass][(keys[i].priority >> (pass * 8)) & 0xff]++;
+	}
 
-	unsigned int i = 0;
-	Node *node = entity_list->head;
+	for (int pass = 0; pass < 4; pass++) {
+		int *counts = histogram[pass];
+		if (counts[(keys[0].priority >> (pass * 8)) & 0xff] == count)
+			continue;
+
+		int offset = 0;
+		for (int i = 0; i < 256; i++) {
+			int n = counts[i];
+			counts[i] = offset;
+			offset += n;
+		}
 
-	if (engine_list_empty(entity_list)) {
-		engine_list_push_front(entity_list, entity, sizeof(Entity));
+		for (int i = 0; i < count; i++)
+			tmp[counts[(keys[i].priority >> (pass * 8)) & 0xff]++] = keys[i];
+
+		RenderKey *swap = keys;
+		keys = tmp;
+		tmp = swap;
+	}
+
+	return keys;
+}
+
+// Merges the entities, in the order they were added, into the lists of their events. They are
+// sorted by their priority first, then each list is walked once from the back.
+static void subscribe(Entity **entities, int count) {
+	reserve_keys(&subscribe_keys, &subscribe_keys_sorted, &subscribe_key_capacity, count);
+	int key_count = 0;
+	for (int i = 0; i < count; i++) {
+		Entity *entity = entities[i];
+		entity->events = 0;
+		for (int e = 0; e < NUM_ENTITY_EVENTS; e++)
+			entity->events |= subscribes(entity, e) << e;
+		if (entity->events)
+			subscribe_keys[key_count++] = (RenderKey){entity->render_priority, entity};
+	}
+	if (key_count == 0)
 		return;
+
+	RenderKey *keys = sort_render_keys(subscribe_keys, subscribe_keys_sorted, key_count);
+	for (int e = 0; e < NUM_ENTITY_EVENTS; e++) {
+		EntityList *list = &subscribers[e];
+		int new_count = list->count;
+		for (int i = 0; i < key_count; i++)
+			new_count += (keys[i].entity->events >> e) & 1;
+		if (new_count == list->count)
+			continue;
+
+		if (new_count > list->capacity) {
+			list->capacity = SDL_max(new_count, list->capacity ? list->capacity * 2 : 16);
+			list->keys = realloc(list->keys, sizeof(RenderKey) * list->capacity);
+		}
+
+		int to = new_count - 1;
+		int from = list->count - 1;
+		for (int i = key_count - 1; i >= 0;) {
+			if (!((keys[i].entity->events >> e) & 1))
+				i--;
+			else if (from >= 0 && compare_keys(&list->keys[from], &keys[i]) > 0)
+				list->keys[to--] = list->keys[from--];
+			else
+				list->keys[to--] = keys[i--];
+		}
+		list->count = new_count;
 	}
+}
 
-	engine_list_for(entity_list, node) {
-		Entity *current_entity = (Entity *)node->value;
+// The priority may have changed since the lists were sorted, so it is searched for.
+static void unsubscribe(Entity *entity) {
+	for (int e = 0; e < NUM_ENTITY_EVENTS; e++) {
+		if (!((entity->events >> e) & 1))
+			continue;
 
-		if (current_entity->render_priority > entity->render_priority) {
-			engine_list_insert(entity_list, entity, sizeof(Entity), i);
-			return;
+		EntityList *list = &subscribers[e];
+		int i = 0;
+		while (i < list->count && list->keys[i].entity != entity)
+			i++;
+		if (i == list->count)
+			continue;
+
+		list->count--;
+		memmove(list->keys + i, list->keys + i + 1, sizeof(RenderKey) * (list->count - i));
+	}
+	entity->events = 0;
+}
+
+// Drops the removed entities from the lists, in one pass over each.
+static void unsubscribe_removed() {
+	for (int e = 0; e < NUM_ENTITY_EVENTS; e++) {
+		EntityList *list = &subscribers[e];
+		int n = 0;
+		for (int i = 0; i < list->count; i++) {
+			Entity *entity = list->keys[i].entity;
+			if (slots[entity->handle.index].entity == entity)
+				list->keys[n++] = list->keys[i];
+		}
+		list->count = n;
+	}
+}
+
+static void unindex_entity(Entity *entity) {
+	if (entity->indexed) {
+		engine_spatial_remove(grid, entity, entity->indexed_bounds);
+		entity->indexed = 0;
+	}
+}
+
+static void index_entity(Entity *entity) {
+	if (entity->bounds) {
+		entity->indexed_bounds = *entity->bounds;
+		entity->indexed = 1;
+		engine_spatial_insert(grid, entity, entity->indexed_bounds);
+	}
+}
+
+void engine_entity_moved(Entity *entity) {
+	// Removed entities are not indexed anymore, queued adds are indexed when applied.
+	if (engine_entity_get(entity->handle) != entity || slots[entity->handle.index].position < 0)
+		return;
+
+	unsubscribe(entity);
+	unindex_entity(entity);
+	index_entity(entity);
+	subscribe(&entity, 1);
+}
+
+// Puts the entities whose bounds changed since they were indexed back in the grid. Setting or
+// clearing the bounds also changes the event lists, as for engine_entity_moved.
+static void reindex_moved() {
+	for (int i = 0; i < stored_count; i++) {
+		Entity *entity = stored[i];
+		if (!entity || (!entity->bounds && !entity->indexed))
+			continue;
+
+		if (!entity->bounds || !entity->indexed) {
+			engine_entity_moved(entity);
+			continue;
+		}
+
+		Rect2Df *r = entity->bounds;
+		Rect2Df *indexed = &entity->indexed_bounds;
+		if (r->x != indexed->x || r->y != indexed->y || r->w != indexed->w || r->h != indexed->h) {
+			unindex_entity(entity);
+			index_entity(entity);
+		}
+	}
+}
+
+typedef struct EntityQuery {
+	ENTITY_QUERY_FN fn;
+	void *data;
+} EntityQuery;
+
+static void query_entity(void *item, void *data) {
+	EntityQuery *query = data;
+	Entity *entity = item;
+
+	// Removed ones stay in the grid until the remove is applied.
+	if (engine_entity_get(entity->handle) == entity)
+		query->fn(entity, query->data);
+}
+
+int engine_entity_query_point(float x, float y, ENTITY_QUERY_FN fn, void *data) {
+	EntityQuery query = {fn, data};
+	return engine_spatial_query_point(grid, x, y, query_entity, &query);
+}
+
+int engine_entity_query_rect(Rect2Df rect, ENTITY_QUERY_FN fn, void *data) {
+	EntityQuery query = {fn, data};
+	return engine_spatial_query_rect(grid, rect, query_entity, &query);
+}
+
+// Drops the removed entities once they are many.
+static void compact_stored() {
+	if (stored_holes == 0 || stored_holes * 2 < stored_count)
+		return;
+
+	int n = 0;
+	for (int i = 0; i < stored_count; i++) {
+		Entity *entity = stored[i];
+		if (!entity)
+			continue;
+		slots[entity->handle.index].position = n;
+		stored[n++] = entity;
+	}
+	stored_count = n;
+	stored_holes = 0;
+}
+
+static EntityHandle alloc_slot(Entity *entity) {
+	uint32_t index;
+
+	if (free_slot != UINT32_MAX) {
+		index = free_slot;
+		free_slot = slots[index].next_free;
+	} else {
+		if (slot_count == slot_capacity) {
+			slot_capacity = slot_capacity ? slot_capacity * 2 : 64;
+			slots = realloc(slots, sizeof(EntitySlot) * slot_capacity);
 		}
-		i++;
+		index = slot_count++;
+		slots[index].generation = 1;
 	}
 
-	engine_list_push_back(entity_list, entity, sizeof(Entity));
+	slots[index].entity = entity;
+	slots[index].position = -1;
+	return (EntityHandle){index, slots[index].generation};
+}
+
+EntityHandle engine_entity_add(Entity *entity) {
+	SDL_assert(grid);
+
+	entity->order = next_order++;
+	entity->handle = alloc_slot(entity);
+	entity->parallel_index = -1;
+	entity->events = 0;
+	push_entity(&added, &added_count, &added_capacity, entity);
+	entity_count++;
+
+	return entity->handle;
 }
 
 void engine_entity_remove(Entity *entity) {
 	SDL_assert(entity);
-	entity_to_check = entity;
-	engine_list_remove_if(entity_list, entity_equals);
-	entity_to_check = NULL;
+	SDL_assert(engine_entity_get(entity->handle) == entity);
+
+	// The hole is skipped by the loops over the entities, the rest waits for engine_entity_flush.
+	EntitySlot *slot = &slots[entity->handle.index];
+	if (slot->position >= 0) {
+		stored[slot->position] = NULL;
+		stored_holes++;
+	}
+	entity_count--;
+
+	slot->entity = NULL;
+	slot->generation++;
+	slot->next_free = free_slot;
+	free_slot = entity->handle.index;
+
+	push_entity(&removed, &removed_count, &removed_capacity, entity);
+}
+
+// The queued entities are in the order they were added, so they are appended as they are.
+static void apply_adds() {
+	int count = 0;
+	for (int i = 0; i < added_count; i++) {
+		Entity *entity = added[i];
+		// Removed before being applied.
+		if (engine_entity_get(entity->handle) == entity)
+			added[count++] = entity;
+	}
+	added_count = 0;
+
+	if (stored_count + count > stored_capacity) {
+		stored_capacity = SDL_max(stored_count + count, stored_capacity ? stored_capacity * 2 : 16);
+		stored = realloc(stored, sizeof(Entity *) * stored_capacity);
+	}
+
+	for (int i = 0; i < count; i++) {
+		Entity *entity = added[i];
+		index_entity(entity);
+		slots[entity->handle.index].position = stored_count;
+		stored[stored_count++] = entity;
+
+		if (entity->parallel_update && entity->on_update) {
+			entity->parallel_index = parallel_count;
+			push_entity(&parallel, &parallel_count, &parallel_capacity, entity);
+		}
+	}
+
+	subscribe(added, count);
 }
 
-void engine_entity_onupdate() {
-	double delta = engine_util_delta_time();
+void engine_entity_flush() {
+	reindex_moved();
+
+	// The free functions may queue more.
+	while (added_count || removed_count) {
+		apply_adds();
+
+		int events = 0;
+		for (int i = 0; i < removed_count; i++)
+			events |= removed[i]->events;
+		if (events)
+			unsubscribe_removed();
+
+		for (int i = 0; i < removed_count; i++) {
+			Entity *entity = removed[i];
+			unindex_entity(entity);
+
+			if (entity->parallel_index >= 0) {
+				Entity *last = parallel[--parallel_count];
+				parallel[entity->parallel_index] = last;
+				last->parallel_index = entity->parallel_index;
+			}
+			entity_free(entity);
+		}
+		removed_count = 0;
+	}
+}
+
+Entity *engine_entity_get(EntityHandle handle) {
+	if (handle.index >= slot_count || slots[handle.index].generation != handle.generation)
+		return NULL;
+	return slots[handle.index].entity;
+}
+
+int engine_entity_count() {
+	return entity_count;
+}
+
+static void update_parallel(void *data, int index) {
+	double delta = *(double *)data;
+	int end = SDL_min((index + 1) * PARALLEL_CHUNK, parallel_count);
+
+	for (int i = index * PARALLEL_CHUNK; i < end; i++)
+		parallel[i]->on_update(parallel[i], delta);
+}
 
-	engine_list_for(entity_list, node) {
-		Entity *entity = (Entity *)node->value;
-		if (entity->on_update)
+static void update_entities(EcsTable *table, double delta, void *data) {
+	compact_stored();
+
+	// Returns once every chunk is done, before the others run.
+	engine_jobs_for((parallel_count + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK, update_parallel, &delta);
+
+	for (int i = 0; i < stored_count; i++) {
+		Entity *entity = stored[i];
+		if (entity && entity->on_update && entity->parallel_index < 0)
 			entity->on_update(entity, delta);
 	}
 }
 
-void engine_entity_onrender() {
-	double delta = engine_util_delta_time();
+// The event lists are rebuilt from the same sort, so the events of the frame follow the priorities
+// it was rendered with.
+static void render_entities(EcsTable *table, double delta, void *data) {
+	reserve_keys(&render_keys, &render_keys_sorted, &render_key_capacity, stored_count);
+
+	// Taken in the order they were added, so the sort keeps it for the same priority.
+	int count = 0;
+	for (int i = 0; i < stored_count; i++) {
+		Entity *entity = stored[i];
+		if (entity && (entity->on_render || entity->events))
+			render_keys[count++] = (RenderKey){entity->render_priority, entity};
+	}
+	if (count == 0)
+		return;
+
+	RenderKey *keys = sort_render_keys(render_keys, render_keys_sorted, count);
 
-	engine_list_for(entity_list, node) {
-		Entity *entity = (Entity *)node->value;
-		if (entity->on_render)
+	// Before the callbacks, the ones they remove are dropped at the next engine_entity_flush.
+	for (int e = 0; e < NUM_ENTITY_EVENTS; e++)
+		subscribers[e].count = 0;
+	for (int i = 0; i < count; i++) {
+		unsigned int events = keys[i].entity->events;
+		for (int e = 0; events && e < NUM_ENTITY_EVENTS; e++) {
+			if ((events >> e) & 1)
+				subscribers[e].keys[subscribers[e].count++] = keys[i];
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		Entity *entity = keys[i].entity;
+		// Removed by an earlier render callback.
+		if (entity->on_render && slots[entity->handle.index].entity == entity)
 			entity->on_render(entity, delta);
 	}
 }
 
-void engine_entity_onevent(union SDL_Event *event) {
-	engine_list_for(entity_list, node) {
-		Entity *entity = (Entity *)node->value;
-
-		if (event->type == SDL_KEYUP) {
-			if (entity->on_keyup)
-				entity->on_keyup(entity, event->key.keysym.scancode,
-								 event->key.keysym.mod);
-		} else if (event->type == SDL_KEYDOWN) {
-			if (entity->on_keydown)
-				entity->on_keydown(entity, event->key.keysym.scancode,
-								   event->key.keysym.mod);
-		} else if (event->type == SDL_MOUSEBUTTONUP) {
-			if (entity->on_mouse_button_up)
-				entity->on_mouse_button_up(entity, event->button.button,
-										   event->button.x, event->button.y);
-		} else if (event->type == SDL_MOUSEBUTTONDOWN) {
-			if (entity->on_mouse_button_down)
-				entity->on_mouse_button_down(entity, event->button.button,
-											 event->button.x, event->button.y);
-		} else if (event->type == SDL_TEXTINPUT) {
-			if (entity->on_textinput)
-				entity->on_textinput(entity, event->text.text);
-		} else if (event->type == SDL_TEXTEDITING) {
-			if (entity->on_textediting)
-				entity->on_textediting(entity, event->edit.text, event->edit.start, event->edit.length);
+static void push_target(Entity *entity) {
+	if (target_count == target_capacity) {
+		target_capacity = target_capacity ? target_capacity * 2 : 16;
+		targets = realloc(targets, sizeof(EntityHandle) * target_capacity);
+	}
+	targets[target_count++] = entity->handle;
+}
+
+static void add_candidate(void *item, void *data) {
+	push_entity(&candidates, &candidate_count, &candidate_capacity, item);
+}
+
+static int compare_candidates(const void *a, const void *b) {
+	return compare_entities(*(Entity *const *)a, *(Entity *const *)b);
+}
+
+// The subscribers of the event, from the top.
+static void target_subscribers(EntityEvent event) {
+	EntityList *list = &subscribers[event];
+	target_count = 0;
+	for (int i = list->count - 1; i >= 0; i--)
+		push_target(list->keys[i].entity);
+}
+
+// The subscribers without bounds and the entities under the mouse, from the top. Only the few under
+// the mouse are sorted, then merged into the sorted list.
+static void target_point(EntityEvent event, int x, int y) {
+	candidate_count = 0;
+	engine_spatial_query_point(grid, x, y, add_candidate, NULL);
+	qsort(candidates, candidate_count, sizeof(Entity *), compare_candidates);
+
+	EntityList *list = &subscribers[event];
+	int i = list->count - 1;
+	int c = candidate_count - 1;
+	target_count = 0;
+	while (i >= 0 || c >= 0) {
+		RenderKey candidate = {0, NULL};
+		if (c >= 0)
+			candidate = (RenderKey){candidates[c]->render_priority, candidates[c]};
+
+		if (c < 0 || (i >= 0 && compare_keys(&list->keys[i], &candidate) > 0))
+			push_target(list->keys[i--].entity);
+		else
+			push_target(candidates[c--]);
+	}
+}
+
+// Where the mouse is for a wheel event. The input state is only read once per frame, so it is taken
+// from the event, or from SDL when the event does not have it.
+static void wheel_position(union SDL_Event *event, int *x, int *y) {
+#if SDL_VERSION_ATLEAST(2, 26, 0)
+	*x = event->wheel.mouseX;
+	*y = event->wheel.mouseY;
+#else
+	SDL_GetMouseState(x, y);
+#endif
+}
+
+static void call_handler(Entity *entity, union SDL_Event *event) {
+	switch (event->type) {
+	case SDL_MOUSEBUTTONUP:
+		if (entity->on_mouse_button_up)
+			entity->on_mouse_button_up(entity, event->button.button, event->button.x, event->button.y);
+		break;
+	case SDL_MOUSEBUTTONDOWN:
+		if (entity->on_mouse_button_down)
+			entity->on_mouse_button_down(entity, event->button.button, event->button.x, event->button.y);
+		break;
+	case SDL_MOUSEWHEEL:
+		if (entity->on_mouse_wheel) {
+			int x, y;
+			wheel_position(event, &x, &y);
+			entity->on_mouse_wheel(entity, event->wheel.x, event->wheel.y, x, y);
 		}
+		break;
+	case SDL_MOUSEMOTION:
+		if (entity->on_mouse_motion)
+			entity->on_mouse_motion(entity, event->motion.x, event->motion.y, event->motion.xrel, event->motion.yrel);
+		break;
+	case SDL_KEYUP:
+		if (entity->on_keyup)
+			entity->on_keyup(entity, event->key.keysym.scancode, event->key.keysym.mod);
+		break;
+	case SDL_KEYDOWN:
+		if (entity->on_keydown)
+			entity->on_keydown(entity, event->key.keysym.scancode, event->key.keysym.mod);
+		break;
+	case SDL_TEXTINPUT:
+		if (entity->on_textinput)
+			entity->on_textinput(entity, event->text.text);
+		break;
+	case SDL_TEXTEDITING:
+		if (entity->on_textediting)
+			entity->on_textediting(entity, event->edit.text, event->edit.start, event->edit.length);
+		break;
+	case SDL_WINDOWEVENT:
+		if (entity->on_resize)
+			entity->on_resize(entity, event->window.data1, event->window.data2);
+		break;
+	}
+}
+
+void engine_entity_stop_event() {
+	event_stopped = 1;
+}
+
+void engine_entity_onevent(union SDL_Event *event) {
+	switch (event->type) {
+	case SDL_MOUSEBUTTONUP:
+	case SDL_MOUSEBUTTONDOWN:
+		target_point(EVENT_MOUSE_BUTTON, event->button.x, event->button.y);
+		break;
+	case SDL_MOUSEWHEEL: {
+		int x, y;
+		wheel_position(event, &x, &y);
+		target_point(EVENT_MOUSE_WHEEL, x, y);
+		break;
+	}
+	case SDL_MOUSEMOTION:
+		target_subscribers(EVENT_MOUSE_MOTION);
+		break;
+	case SDL_KEYUP:
+		target_subscribers(EVENT_KEYUP);
+		break;
+	case SDL_KEYDOWN:
+		target_subscribers(EVENT_KEYDOWN);
+		break;
+	case SDL_TEXTINPUT:
+		target_subscribers(EVENT_TEXTINPUT);
+		break;
+	case SDL_TEXTEDITING:
+		target_subscribers(EVENT_TEXTEDITING);
+		break;
+	case SDL_WINDOWEVENT:
+		if (event->window.event != SDL_WINDOWEVENT_SIZE_CHANGED)
+			return;
+		target_subscribers(EVENT_RESIZE);
+		break;
+	default:
+		return;
+	}
+
+	// A callback may remove entities, or add ones which wait for the next event.
+	event_stopped = 0;
+	for (int i = 0; i < target_count && !event_stopped; i++) {
+		Entity *entity = engine_entity_get(targets[i]);
+		if (entity)
+			call_handler(entity, event);
 	}
 }
@@ -1,6 +1,9 @@
 #ifndef ENGINE_ENTITY_H
 #define ENGINE_ENTITY_H
 
+#include <engine/math/rect.h>
+#include <stdint.h>
+
 struct Entity;
 
 typedef void (*ENTITY_RENDER_FN)(struct Entity *entity, double delta);
@@ -10,12 +13,22 @@ typedef void (*ENTITY_EVENT_MOUSE_BUTTON_FN)(struct Entity *entity, unsigned cha
 typedef void (*ENTITY_EVENT_KEY_FN)(struct Entity *entity, int keycode, unsigned short mod);
 typedef void (*ENTITY_EVENT_TEXTINPUT_FN)(struct Entity *entity, const char *text);
 typedef void (*ENTITY_EVENT_TEXTEDITING_FN)(struct Entity *entity, const char *text, int start, int length);
+typedef void (*ENTITY_EVENT_MOUSE_MOTION_FN)(struct Entity *entity, int x, int y, int dx, int dy);
+// dx and dy are the scrolled amount, x and y where the mouse is.
+typedef void (*ENTITY_EVENT_MOUSE_WHEEL_FN)(struct Entity *entity, int dx, int dy, int x, int y);
+typedef void (*ENTITY_EVENT_RESIZE_FN)(struct Entity *entity, int w, int h);
 typedef void (*ENTITY_FREE_FN)(struct Entity *entity);
+typedef void (*ENTITY_QUERY_FN)(struct Entity *entity, void *data);
 
-// TODO: Add more events
+// Refers to an added entity without owning it. Once the entity is removed the handle is stale and
+// engine_entity_get returns NULL for it, even if the slot is reused. The zero handle is never valid.
+typedef struct EntityHandle {
+	uint32_t index;
+	uint32_t generation;
+} EntityHandle;
 
 typedef struct Entity {
-	unsigned int render_priority; // less means later, which means will be on top.
+	unsigned int render_priority; // more means later, which means will be on top. Can change any time.
 	ENTITY_UPDATE_FN on_update;
 	ENTITY_RENDER_FN on_render;
 	ENTITY_EVENT_MOUSE_BUTTON_FN on_mouse_button_up;
@@ -24,27 +37,69 @@ typedef struct Entity {
 	ENTITY_EVENT_KEY_FN on_keydown;
 	ENTITY_EVENT_TEXTEDITING_FN on_textediting;
 	ENTITY_EVENT_TEXTINPUT_FN on_textinput;
+	ENTITY_EVENT_MOUSE_MOTION_FN on_mouse_motion; // Gets all the motion, inside of the bounds or not.
+	ENTITY_EVENT_MOUSE_WHEEL_FN on_mouse_wheel;
+	ENTITY_EVENT_RESIZE_FN on_resize; // The window was resized.
 	ENTITY_FREE_FN on_free;
+	// Set before adding if on_update only changes the entity itself, without GL, other entities or
+	// globals. Those entities are updated first, in chunks across worker threads, then the others in
+	// order.
+	int parallel_update;
+	// Optional, usually the rect of the entity. Entities with bounds are kept in a grid and only get
+	// the mouse button and wheel events inside of them, the others get all. Changes are picked up by
+	// the next engine_entity_flush, once per frame after the update.
+	Rect2Df *bounds;
+	Rect2Df indexed_bounds; // Used internally, bounds when last put in the grid.
+	int indexed; // Used internally
+	unsigned int order; // Used internally, keeps the order of the entities with the same priority.
+	unsigned int events; // Used internally, bits of the event lists it is in.
+	EntityHandle handle; // Used internally
+	int parallel_index; // Used internally, -1 if updated in order.
 } Entity;
 
 // Initializes the entity engine.
 void engine_entity_init();
 
-// Note: Once added, changing the render priority in the entity has no effect.
-void engine_entity_add(Entity *entity);
+// Entities are kept in the order they were added, and updated in it. Removing one leaves a hole,
+// dropped before the next update. Every frame they are sorted by their current render priority to
+// render them, and the events until the next frame follow that order, so the priority can change
+// without removing the entity. Each event goes only to the entities with a callback for it, looked
+// up when added.
+// Adding and removing are safe from any entity callback, both are queued and applied together at
+// the next engine_entity_flush. Until then an added entity is not updated, rendered or found by the
+// queries, but engine_entity_get returns it.
+EntityHandle engine_entity_add(Entity *entity);
 
-// Removes and FREES the entity.
+// Removes and FREES the entity, the free is delayed until the next engine_entity_flush but the
+// entity gets no more callbacks and engine_entity_get returns NULL for it.
 void engine_entity_remove(Entity *entity);
 
-// Used internally
-void engine_entity_onupdate();
+// Returns the entity, NULL if it was removed.
+Entity *engine_entity_get(EntityHandle handle);
 
-// Used internally
-void engine_entity_onrender();
+int engine_entity_count();
+
+// Updates the grid after the bounds changed or were set or cleared, and the event lists after the
+// event callbacks changed. Bounds are also checked by engine_entity_flush, this is only needed for the
+// queries and events before it, or for the callbacks. Does nothing for removed entities.
+void engine_entity_moved(Entity *entity);
+
+// Called from an event callback, the entities after it don't get the event. Events go first to the
+// entities on top, the ones rendered last.
+void engine_entity_stop_event();
+
+// Call fn for each entity whose bounds have the point or overlap the rect, entities without bounds
+// are not included. Return the count of entities found.
+int engine_entity_query_point(float x, float y, ENTITY_QUERY_FN fn, void *data);
+int engine_entity_query_rect(Rect2Df rect, ENTITY_QUERY_FN fn, void *data);
 
 union SDL_Event;
 
 // Used internally
 void engine_entity_onevent(union SDL_Event *event);
 
+// Used internally, puts the moved entities back in the grid and applies the queued adds and
+// removes. Called from the engine loop, outside of the entity callbacks.
+void engine_entity_flush();
+
 #endif
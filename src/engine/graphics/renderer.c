@@ -9,6 +9,7 @@
 #include <engine/io.h>
 #include <engine/list.h>
 #include <engine/logger.h>
+#include <engine/memory.h>
 #include <engine/settings.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -26,6 +27,7 @@ static GLuint quadVAO;
 static GLuint lineVAO;
 static GLuint textVAO;
 static GLuint textVBO;
+static RenderStats stats;
 
 typedef struct Glyph {
 	FT_ULong code;
@@ -35,6 +37,8 @@ typedef struct Glyph {
 	GLuint tx, ty;
 } Glyph;
 
+static MemoryPool glyph_pool = MEMORY_POOL(Glyph, 256);
+
 typedef struct CachedFont {
 	unsigned int pt;
 	int style;
@@ -56,6 +60,10 @@ void GLAPIENTRY opengl_message_callback(GLenum source, GLenum type, GLuint id, G
 	engine_log_write(type == GL_DEBUG_TYPE_ERROR ? LOG_ERROR : LOG_DEBUG, "OpenGL message type=%d, severity=%d, message: %s", type, severity, message);
 }
 
+static void free_glyph(void *p) {
+	engine_memory_pool_free(&glyph_pool, p);
+}
+
 static void free_font(void *p) {
 	CachedFont *c = p;
 	glDeleteTextures(1, &c->tex);
@@ -127,7 +135,7 @@ static CachedFont *search_font(unsigned int pt, int style) {
 		CachedFont *cfont = malloc(sizeof(CachedFont));
 		cfont->pt = pt;
 		cfont->style = style;
-		cfont->pCharList = engine_list_create();
+		cfont->pCharList = engine_list_create_fn(free_glyph);
 		FT_Error fterr = FT_New_Face(ft, font_path(style), 0, &cfont->ft);
 
 		if (fterr) {
@@ -191,7 +199,7 @@ static CachedFont *search_font(unsigned int pt, int style) {
 
 			glTexSubImage2D(GL_TEXTURE_2D, 0, (int)x, (int)y, (int)g->bitmap.width, (int)g->bitmap.rows, GL_RED, GL_UNSIGNED_BYTE, g->bitmap.buffer);
 
-			Glyph *glyph = malloc(sizeof(Glyph));
+			Glyph *glyph = MEMORY_POOL_NEW(&glyph_pool, Glyph);
 			glyph->advance = g->advance.x >> 6L;
 			glyph->bl = g->bitmap_left;
 			glyph->bt = g->bitmap_top;
@@ -388,7 +396,10 @@ void engine_render_quit() {
 	SDL_Quit();
 }
 
-void engine_render_clear() { glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); }
+void engine_render_clear() {
+	memset(&stats, 0, sizeof(RenderStats));
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
 
 void engine_render_present() { SDL_GL_SwapWindow(pWindow); }
 
@@ -427,6 +438,7 @@ void engine_render_rect(float x, float y, float width, float height, int filled)
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 	else
 		glDrawElements(GL_LINE_STRIP, 6, GL_UNSIGNED_INT, 0);
+	stats.draw_calls++;
 	glBindVertexArray(0);
 }
 
@@ -459,6 +471,7 @@ void engine_render_texture2D(float x, float y, float width, float height, unsign
 	glBindTexture(GL_TEXTURE_2D, tex);
 
 	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	stats.draw_calls++;
 	glBindVertexArray(0);
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
@@ -486,6 +499,7 @@ void engine_render_line(float x1, float y1, float x2, float y2) {
 	glBindVertexArray(lineVAO);
 
 	glDrawArrays(GL_LINES, 0, 2);
+	stats.draw_calls++;
 	glBindVertexArray(0);
 }
 
@@ -522,7 +536,8 @@ void engine_render_text(unsigned int pt, int style, const char *text, float x, f
 		GLfloat y;
 		GLfloat tx;
 		GLfloat ty;
-	} coords[6 * strlen(text)];
+	};
+	struct point *coords = engine_memory_frame_alloc(sizeof(struct point) * 6 * strlen(text));
 
 	float startx = x;
 
@@ -571,8 +586,9 @@ void engine_render_text(unsigned int pt, int style, const char *text, float x, f
 			current = current->next;
 		}
 	}
-	glBufferData(GL_ARRAY_BUFFER, sizeof(coords), coords, GL_DYNAMIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(struct point) * n, coords, GL_DYNAMIC_DRAW);
 	glDrawArrays(GL_TRIANGLES, 0, n);
+	stats.draw_calls++;
 	glBindVertexArray(0);
 	glBindTexture(GL_TEXTURE_2D, 0);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
@@ -620,10 +636,10 @@ void engine_render_text_size(const char *text, unsigned int pt, int style, float
 }
 
 void engine_render_text_size_len(const char *text, unsigned int pt, int style, Vector2Df *point, size_t len) {
-	char *buf = malloc(len);
+	char *buf = engine_memory_frame_alloc(len + 1);
 	strncpy(buf, text, len);
+	buf[len] = '\0';
 	engine_render_text_size_s(buf, pt, style, point);
-	free(buf);
 }
 
 void engine_render_text_size_s(const char *text, unsigned int pt, int style, Vector2Df *point) {
@@ -638,3 +654,7 @@ void engine_render_use_camera(int enable) {
 void engine_render_clear_color(Color c) {
 	glClearColor(c.r / 255.f, c.g / 255.f, c.b / 255.f, c.a / 255.f);
 }
+
+RenderStats *engine_render_stats() {
+	return &stats;
+}
@@ -19,6 +19,17 @@ enum {
 	STYLE_SEMIBOLD_ITALIC
 };
 
+typedef struct RenderStats {
+	unsigned int draw_calls;
+	unsigned int tilemap_chunks_visible;
+	unsigned int tilemap_chunks_total;
+	unsigned int tilemap_uploads;
+	unsigned long tilemap_upload_bytes;
+	unsigned int particles; // Alive.
+	unsigned int particle_capacity;
+	double particle_update_ms; // Last update of the particle systems drawn.
+} RenderStats;
+
 int engine_render_init(const char *title);
 void engine_render_quit();
 
@@ -42,4 +53,7 @@ void engine_render_use_camera(int enable);
 void engine_render_clear_color(Color c);
 void engine_render_projection(mat4 proj);
 
+// Counters of the current frame, they are reset by engine_render_clear.
+RenderStats *engine_render_stats();
+
 #endif
@@ -136,6 +136,11 @@ void engine_shader_set_float(Shader shader, const char *name, float x) {
 	glUniform1f(glGetUniformLocation(shader, name), x);
 }
 
+void engine_shader_set_vec2(Shader shader, const char *name, float x, float y) {
+	engine_shader_use(shader);
+	glUniform2f(glGetUniformLocation(shader, name), x, y);
+}
+
 void engine_shader_set_vec3(Shader shader, const char *name, float x, float y,
 							float z) {
 	engine_shader_use(shader);
@@ -17,6 +17,7 @@ void engine_shader_update_camera(Camera *c);
 
 void engine_shader_set_int(Shader shader, const char *name, int x);
 void engine_shader_set_float(Shader shader, const char *name, float x);
+void engine_shader_set_vec2(Shader shader, const char *name, float x, float y);
 void engine_shader_set_vec3(Shader shader, const char *name, float x, float y, float z);
 void engine_shader_set_vec4(Shader shader, const char *name, float x, float y, float z, float w);
 void engine_shader_set_mat4(Shader shader, const char *name, mat4 mat);
@@ -1,17 +1,21 @@
 #include "input.h"
 #include <SDL.h>
+#include <engine/replay.h>
 
 static Uint32 prev_mouse_state;
 static Uint32 mouse_state;
 static Uint8 *prev_keyboard_status = NULL;
-static const Uint8 *keyboard_status = NULL;
+// A copy of the SDL state, so replays can replace it.
+static Uint8 *keyboard_status = NULL;
 static int keyboard_status_length = 0;
 static int oldMX = 0, oldMY = 0;
 static int currentMX = 0, currentMY = 0;
 
 void engine_input_init() {
-	keyboard_status = SDL_GetKeyboardState(&keyboard_status_length);
+	SDL_GetKeyboardState(&keyboard_status_length);
+	keyboard_status = malloc(keyboard_status_length);
 	prev_keyboard_status = malloc(keyboard_status_length);
+	memset(keyboard_status, 0, keyboard_status_length);
 	engine_input_update();
 }
 
@@ -23,6 +27,8 @@ void engine_input_update() {
 
 	if (keyboard_status) {
 		memcpy(prev_keyboard_status, keyboard_status, keyboard_status_length);
+		memcpy(keyboard_status, SDL_GetKeyboardState(NULL), keyboard_status_length);
+		engine_replay_input(&mouse_state, &currentMX, &currentMY, keyboard_status, keyboard_status_length);
 	}
 }
 
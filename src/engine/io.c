@@ -46,11 +46,15 @@ char *engine_io_load(const char *path) {
 	return source;
 }
 
-char *engine_io_load_app(const char *path) {
+char *engine_io_app_path(const char *path) {
 	if (!app_path)
 		app_path = SDL_GetPrefPath("Ryozuki", "SimpleGame");
 
-	char *combined_path = combine_path(app_path, path);
+	return combine_path(app_path, path);
+}
+
+char *engine_io_load_app(const char *path) {
+	char *combined_path = engine_io_app_path(path);
 	char *value = engine_io_load(combined_path);
 
 	free(combined_path);
@@ -58,10 +62,7 @@ char *engine_io_load_app(const char *path) {
 }
 
 void engine_io_save(const char *path, char *value) {
-	if (!app_path)
-		app_path = SDL_GetPrefPath("Ryozuki", "SimpleGame");
-
-	char *combined_path = combine_path(app_path, path);
+	char *combined_path = engine_io_app_path(path);
 
 	SDL_RWops *file = SDL_RWFromFile(combined_path, "w");
 
@@ -82,10 +83,7 @@ void engine_io_save(const char *path, char *value) {
 }
 
 int engine_io_file_exists(const char *path) {
-	if (!app_path)
-		app_path = SDL_GetPrefPath("Ryozuki", "SimpleGame");
-
-	char *combined_path = combine_path(app_path, path);
+	char *combined_path = engine_io_app_path(path);
 
 	SDL_RWops *file = SDL_RWFromFile(combined_path, "r+");
 
@@ -6,6 +6,9 @@
 // Loads a file, remember to free the pointer.
 char *engine_io_load(const char *path);
 
+// Returns the path inside the app directory, remember to free the pointer.
+char *engine_io_app_path(const char *path);
+
 char *engine_io_load_app(const char *path);
 void engine_io_save(const char *path, char *value);
 
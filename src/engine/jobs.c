@@ -0,0 +1,397 @@
+#include "jobs.h"
+#include <SDL.h>
+#include <engine/logger.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JOB_MASK (JOBS_PER_THREAD - 1) // JOBS_PER_THREAD is a power of two.
+#define JOBS_PER_FOR_THREAD 4 // Jobs per thread a parallel for is split in.
+#define IDLE_SPINS 64 // Times a worker looks for jobs before sleeping.
+#define WAIT_SPINS 64 // Times a wait looks for jobs before sleeping until a counter finishes.
+
+typedef struct Job {
+	JOB_FN fn;
+	JOB_FOR_FN for_fn; // Instead of fn, called for [begin, end).
+	void *data;
+	int begin, end;
+	JobCounter *counter;
+	struct Job *next; // In the waiting list of a counter.
+	SDL_atomic_t busy; // Until finished, so its place in the ring is not reused.
+	int allocated; // Not from a ring, freed once finished.
+} Job;
+
+// Chase-Lev deque of fixed size. The owner pushes and pops at the bottom, the thieves take from
+// the top, and only the last job needs both to agree. Indices only grow and wrap around.
+typedef struct JobDeque {
+	SDL_atomic_t top;
+	char top_pad[60]; // Thieves and owner write different cache lines.
+	SDL_atomic_t bottom;
+	char bottom_pad[60];
+	Job *jobs[JOBS_PER_THREAD];
+} JobDeque;
+
+typedef struct Worker {
+	JobDeque deque;
+	Job jobs[JOBS_PER_THREAD]; // Ring the jobs started by the worker come from.
+	unsigned int next_job;
+	unsigned int random; // Picks the first worker to steal from.
+	JobStats stats;
+	SDL_Thread *thread; // NULL for the main thread.
+} Worker;
+
+static Worker *workers = NULL;
+static int worker_count = 0;
+static SDL_TLSID worker_tls; // SDL can't free it, created once and kept across engine_jobs_init.
+static SDL_sem *wake; // Posted when jobs are pushed and some worker sleeps.
+static SDL_atomic_t sleeping;
+static SDL_atomic_t quit;
+static SDL_mutex *waiting_mutex; // Guards the waiting lists of the counters.
+static SDL_cond *waiter_wake; // Broadcast under waiting_mutex when a counter reaches 0 or jobs are pushed.
+static SDL_atomic_t waiters; // Sleeping in engine_jobs_wait.
+
+static double elapsed_ms(Uint64 start) {
+	return (double)(SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency();
+}
+
+// The indices are unsigned, so they wrap around without overflowing.
+static unsigned int get_index(SDL_atomic_t *index) {
+	return (unsigned int)SDL_AtomicGet(index);
+}
+
+// Returns 0 if the deque is full.
+static int push(JobDeque *d, Job *job) {
+	unsigned int b = get_index(&d->bottom);
+	unsigned int t = get_index(&d->top);
+	if (b - t >= JOBS_PER_THREAD)
+		return 0;
+
+	SDL_AtomicSetPtr((void **)&d->jobs[b & JOB_MASK], job);
+	SDL_AtomicSet(&d->bottom, (int)(b + 1));
+	return 1;
+}
+
+static Job *pop(JobDeque *d) {
+	// Taken before looking at the top, so a thief sees it.
+	unsigned int b = (unsigned int)SDL_AtomicAdd(&d->bottom, -1) - 1;
+	unsigned int t = get_index(&d->top);
+
+	if ((int)(b - t) < 0) {
+		SDL_AtomicSet(&d->bottom, (int)(b + 1));
+		return NULL;
+	}
+
+	Job *job = SDL_AtomicGetPtr((void **)&d->jobs[b & JOB_MASK]);
+	if (b != t)
+		return job;
+
+	// The last one, a thief may be taking it too.
+	if (!SDL_AtomicCAS(&d->top, (int)t, (int)(t + 1)))
+		job = NULL;
+	SDL_AtomicSet(&d->bottom, (int)(t + 1));
+	return job;
+}
+
+static Job *steal(JobDeque *d) {
+	unsigned int t = get_index(&d->top);
+	unsigned int b = get_index(&d->bottom);
+	if ((int)(b - t) <= 0)
+		return NULL;
+
+	Job *job = SDL_AtomicGetPtr((void **)&d->jobs[t & JOB_MASK]);
+	if (!SDL_AtomicCAS(&d->top, (int)t, (int)(t + 1)))
+		return NULL;
+	return job;
+}
+
+static Worker *current_worker() {
+	// Only the main thread and the workers have one.
+	Worker *w = SDL_TLSGet(worker_tls);
+	SDL_assert(w);
+	return w;
+}
+
+static Job *find_job(Worker *w) {
+	Job *job = pop(&w->deque);
+	if (job)
+		return job;
+
+	w->random ^= w->random << 13;
+	w->random ^= w->random >> 17;
+	w->random ^= w->random << 5;
+
+	int self = (int)(w - workers);
+	int first = w->random % worker_count;
+	for (int i = 0; i < worker_count; i++) {
+		int victim = (first + i) % worker_count;
+		if (victim == self)
+			continue;
+
+		job = steal(&workers[victim].deque);
+		if (job) {
+			w->stats.steals++;
+			return job;
+		}
+	}
+
+	return NULL;
+}
+
+static void submit(Worker *w, Job *job);
+
+// The last job of the counter hands its waiting list over. pending only reaches 0 under the lock
+// and with nothing after, as the counter can be gone once a wait sees it.
+static void finish(JobCounter *counter) {
+	int n = SDL_AtomicGet(&counter->pending);
+	while (n > 1) {
+		if (SDL_AtomicCAS(&counter->pending, n, n - 1))
+			return;
+		n = SDL_AtomicGet(&counter->pending);
+	}
+
+	SDL_LockMutex(waiting_mutex);
+	Job *waiting = counter->waiting;
+	counter->waiting = NULL;
+	if (SDL_AtomicAdd(&counter->pending, -1) != 1) {
+		// More jobs were started meanwhile.
+		counter->waiting = waiting;
+		waiting = NULL;
+	} else {
+		SDL_CondBroadcast(waiter_wake);
+	}
+	SDL_UnlockMutex(waiting_mutex);
+
+	Worker *w = current_worker();
+	while (waiting) {
+		Job *next = waiting->next;
+		submit(w, waiting);
+		waiting = next;
+	}
+}
+
+static void run_job(Worker *w, Job *job) {
+	Uint64 start = SDL_GetPerformanceCounter();
+
+	if (job->for_fn) {
+		for (int i = job->begin; i < job->end; i++)
+			job->for_fn(job->data, i);
+	} else {
+		job->fn(job->data);
+	}
+
+	w->stats.jobs++;
+	w->stats.busy_ms += elapsed_ms(start);
+
+	JobCounter *counter = job->counter;
+	if (job->allocated)
+		free(job);
+	else
+		SDL_AtomicSet(&job->busy, 0);
+	if (counter)
+		finish(counter);
+}
+
+static void submit(Worker *w, Job *job) {
+	// Without other workers nobody would run it until a wait.
+	if (worker_count == 1 || !push(&w->deque, job)) {
+		run_job(w, job);
+		return;
+	}
+
+	if (SDL_AtomicGet(&sleeping) > 0)
+		SDL_SemPost(wake);
+	if (SDL_AtomicGet(&waiters) > 0) {
+		SDL_LockMutex(waiting_mutex);
+		SDL_CondBroadcast(waiter_wake);
+		SDL_UnlockMutex(waiting_mutex);
+	}
+}
+
+static Job *alloc_job(Worker *w, JobCounter *counter) {
+	Job *job = &w->jobs[w->next_job++ & JOB_MASK];
+
+	// Started a whole ring ago and not finished yet. It can be waiting for this very job, so no
+	// waiting for it.
+	if (SDL_AtomicGet(&job->busy)) {
+		job = malloc(sizeof(Job));
+		memset(job, 0, sizeof(Job));
+		job->allocated = 1;
+	} else {
+		memset(job, 0, sizeof(Job));
+		SDL_AtomicSet(&job->busy, 1);
+	}
+
+	job->counter = counter;
+	if (counter)
+		SDL_AtomicAdd(&counter->pending, 1);
+	return job;
+}
+
+static int worker_main(void *data) {
+	Worker *w = data;
+	SDL_TLSSet(worker_tls, w, NULL);
+
+	while (!SDL_AtomicGet(&quit)) {
+		Job *job = NULL;
+		for (int i = 0; i < IDLE_SPINS && !job; i++)
+			job = find_job(w);
+
+		if (!job) {
+			// Looks again after saying it sleeps, a push in between posts the semaphore.
+			SDL_AtomicAdd(&sleeping, 1);
+			job = find_job(w);
+			if (!job && !SDL_AtomicGet(&quit)) {
+				Uint64 start = SDL_GetPerformanceCounter();
+				SDL_SemWait(wake);
+				w->stats.idle_ms += elapsed_ms(start);
+			}
+			SDL_AtomicAdd(&sleeping, -1);
+		}
+
+		if (job)
+			run_job(w, job);
+	}
+
+	return 0;
+}
+
+void engine_jobs_init(int threads) {
+	if (threads <= 0)
+		threads = SDL_GetCPUCount();
+	worker_count = SDL_max(1, SDL_min(threads, JOBS_MAX_THREADS));
+
+	workers = malloc(sizeof(Worker) * worker_count);
+	memset(workers, 0, sizeof(Worker) * worker_count);
+	for (int i = 0; i < worker_count; i++)
+		workers[i].random = 2654435761u * (i + 1);
+
+	SDL_AtomicSet(&sleeping, 0);
+	SDL_AtomicSet(&waiters, 0);
+	SDL_AtomicSet(&quit, 0);
+	wake = SDL_CreateSemaphore(0);
+	waiting_mutex = SDL_CreateMutex();
+	waiter_wake = SDL_CreateCond();
+	if (!worker_tls)
+		worker_tls = SDL_TLSCreate();
+	SDL_TLSSet(worker_tls, &workers[0], NULL);
+
+	for (int i = 1; i < worker_count; i++) {
+		workers[i].thread = SDL_CreateThread(worker_main, "engine_jobs", &workers[i]);
+		if (!workers[i].thread)
+			engine_log_error("Error creating job thread: %s", SDL_GetError());
+	}
+
+	engine_log_info("Job system started with %d threads.", worker_count);
+}
+
+void engine_jobs_quit() {
+	SDL_AtomicSet(&quit, 1);
+	for (int i = 1; i < worker_count; i++)
+		SDL_SemPost(wake);
+
+	for (int i = 1; i < worker_count; i++) {
+		if (workers[i].thread)
+			SDL_WaitThread(workers[i].thread, NULL);
+	}
+
+	SDL_DestroySemaphore(wake);
+	SDL_DestroyCond(waiter_wake);
+	SDL_DestroyMutex(waiting_mutex);
+	SDL_TLSSet(worker_tls, NULL, NULL);
+	free(workers);
+	workers = NULL;
+	worker_count = 0;
+}
+
+int engine_jobs_thread_count() {
+	return worker_count;
+}
+
+void engine_jobs_run(JOB_FN fn, void *data, JobCounter *counter) {
+	Worker *w = current_worker();
+	Job *job = alloc_job(w, counter);
+	job->fn = fn;
+	job->data = data;
+	submit(w, job);
+}
+
+void engine_jobs_run_after(JobCounter *after, JOB_FN fn, void *data, JobCounter *counter) {
+	Worker *w = current_worker();
+	Job *job = alloc_job(w, counter);
+	job->fn = fn;
+	job->data = data;
+
+	SDL_LockMutex(waiting_mutex);
+	int held = SDL_AtomicGet(&after->pending) > 0;
+	if (held) {
+		job->next = after->waiting;
+		after->waiting = job;
+	}
+	SDL_UnlockMutex(waiting_mutex);
+
+	if (!held)
+		submit(w, job);
+}
+
+void engine_jobs_wait(JobCounter *counter) {
+	Worker *w = current_worker();
+	int spins = 0;
+
+	while (SDL_AtomicGet(&counter->pending) > 0) {
+		Job *job = find_job(w);
+		if (job) {
+			run_job(w, job);
+			spins = 0;
+			continue;
+		}
+
+		if (++spins < WAIT_SPINS)
+			continue;
+
+		// Sleeps until a counter finishes or jobs are pushed. Looks again under the lock after
+		// saying it waits, pending only reaches 0 and pushes only wake it under the lock too.
+		Uint64 start = SDL_GetPerformanceCounter();
+		SDL_AtomicAdd(&waiters, 1);
+		SDL_LockMutex(waiting_mutex);
+		job = find_job(w);
+		if (!job && SDL_AtomicGet(&counter->pending) > 0)
+			SDL_CondWait(waiter_wake, waiting_mutex);
+		SDL_UnlockMutex(waiting_mutex);
+		SDL_AtomicAdd(&waiters, -1);
+		w->stats.idle_ms += elapsed_ms(start);
+
+		if (job)
+			run_job(w, job);
+		spins = 0;
+	}
+}
+
+void engine_jobs_for(int count, JOB_FOR_FN fn, void *data) {
+	if (count <= 0)
+		return;
+
+	if (worker_count == 1 || count == 1) {
+		for (int i = 0; i < count; i++)
+			fn(data, i);
+		return;
+	}
+
+	Worker *w = current_worker();
+	JobCounter counter;
+	memset(&counter, 0, sizeof(JobCounter));
+
+	int jobs = SDL_min(count, worker_count * JOBS_PER_FOR_THREAD);
+	for (int j = 0; j < jobs; j++) {
+		Job *job = alloc_job(w, &counter);
+		job->for_fn = fn;
+		job->data = data;
+		job->begin = (int)((long long)count * j / jobs);
+		job->end = (int)((long long)count * (j + 1) / jobs);
+		submit(w, job);
+	}
+
+	engine_jobs_wait(&counter);
+}
+
+const JobStats *engine_jobs_stats(int worker) {
+	return &workers[worker].stats;
+}
@@ -0,0 +1,56 @@
+#ifndef ENGINE_JOBS_H
+#define ENGINE_JOBS_H
+
+#include <SDL_atomic.h>
+
+// Workers shared by the whole engine, started by engine_init. Every worker, the main thread being
+// the first, has a deque of jobs: it takes the last job it pushed, and when empty steals the oldest
+// job of another worker. Jobs are only started from the main thread or from other jobs.
+//
+// A counter tracks a group of jobs. Waiting on it runs other jobs meanwhile, so jobs can wait on
+// the jobs they start, and a job can be held until the jobs of another counter are done.
+
+#define JOBS_MAX_THREADS 64
+#define JOBS_PER_THREAD 4096 // Unfinished jobs a thread holds without allocating.
+
+typedef void (*JOB_FN)(void *data);
+typedef void (*JOB_FOR_FN)(void *data, int index);
+
+struct Job;
+
+// Zero it before the first use, it can be reused once waited.
+typedef struct JobCounter {
+	SDL_atomic_t pending; // Jobs not finished.
+	struct Job *waiting; // Used internally, jobs held until pending is 0.
+} JobCounter;
+
+typedef struct JobStats {
+	unsigned long jobs; // Run by the worker.
+	unsigned long steals; // Jobs taken from other workers.
+	double busy_ms; // Running jobs.
+	double idle_ms; // Sleeping without jobs, for the main thread only in engine_jobs_wait.
+} JobStats;
+
+// threads is the total including the main thread, 0 means one per core.
+void engine_jobs_init(int threads);
+void engine_jobs_quit();
+
+int engine_jobs_thread_count();
+
+// Runs fn(data) on some worker. counter can be NULL.
+void engine_jobs_run(JOB_FN fn, void *data, JobCounter *counter);
+
+// Same, but the job only starts after the jobs of after are done.
+void engine_jobs_run_after(JobCounter *after, JOB_FN fn, void *data, JobCounter *counter);
+
+// Runs jobs until the ones of the counter are done, sleeps when there are none to run.
+void engine_jobs_wait(JobCounter *counter);
+
+// Runs fn for every index in [0, count) split across the workers, and waits for all of them.
+void engine_jobs_for(int count, JOB_FOR_FN fn, void *data);
+
+// Stats since engine_jobs_init, worker 0 is the main thread. Updated by the worker, so they can
+// be a job late.
+const JobStats *engine_jobs_stats(int worker);
+
+#endif
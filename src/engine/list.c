@@ -1,11 +1,15 @@
 #include "list.h"
+#include <engine/memory.h>
 #include <stdlib.h>
 #include <string.h>
 
+static MemoryPool list_pool = MEMORY_POOL(List, 32);
+static MemoryPool node_pool = MEMORY_POOL(Node, 256);
+
 static void engine_list_free_node(List *list, Node *elem) {
 	if (elem != NULL) {
 		list->freeFunc(elem->value);
-		free(elem);
+		engine_memory_pool_free(&node_pool, elem);
 	}
 }
 
@@ -31,7 +35,7 @@ static Node *list_get_node(List *list, unsigned int index) {
 }
 
 List *engine_list_create_fn(LIST_FREE_FN f) {
-	List *list = (List *)malloc(sizeof(List));
+	List *list = MEMORY_POOL_NEW(&list_pool, List);
 	list->head = list->tail = NULL;
 	list->freeFunc = f;
 	return list;
@@ -43,7 +47,7 @@ void engine_list_push_front(List *list, void *value, size_t size) {
 
 	Node *oldFirst = list->head;
 
-	list->head = (Node *)malloc(sizeof(Node));
+	list->head = MEMORY_POOL_NEW(&node_pool, Node);
 
 	if (oldFirst)
 		oldFirst->prev = list->head;
@@ -58,7 +62,7 @@ void engine_list_push_front(List *list, void *value, size_t size) {
 }
 
 void engine_list_push_back(List *list, void *value, size_t size) {
-	Node *newVal = (Node *)malloc(sizeof(Node));
+	Node *newVal = MEMORY_POOL_NEW(&node_pool, Node);
 
 	newVal->next = NULL;
 	newVal->prev = list->tail;
@@ -139,7 +143,7 @@ int engine_list_insert(List *list, void *value, size_t size, unsigned int index)
 
 	// Already checked if it was on the head or tail.
 	if (i == index && current) {
-		Node *newVal = (Node *)malloc(sizeof(Node));
+		Node *newVal = MEMORY_POOL_NEW(&node_pool, Node);
 
 		newVal->prev = current;
 		newVal->next = current->next;
@@ -258,7 +262,7 @@ void engine_list_clear(List *list) {
 
 void engine_list_free(List *list) {
 	engine_list_clear(list);
-	free(list);
+	engine_memory_pool_free(&list_pool, list);
 }
 
 void engine_list_swap_index(List *list, unsigned index1, unsigned index2) {
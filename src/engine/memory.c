@@ -0,0 +1,125 @@
+#include "memory.h"
+#include <SDL_assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALIGN(size) (((size) + 15) & ~(size_t)15)
+#define FRAME_ARENA_SIZE (64 * 1024) // First block of the frame arena.
+
+// Each block of the arena starts with this, padded to the alignment.
+typedef struct FrameBlock {
+	struct FrameBlock *next; // Older, still used this frame.
+	size_t capacity;
+	size_t used;
+} FrameBlock;
+
+static FrameBlock *frame_block = NULL; // The newest.
+static MemoryStats stats;
+static MemoryStats last_stats;
+
+// Objects are at least a pointer, the free ones hold the next free one.
+static size_t object_size(MemoryPool *pool) {
+	return ALIGN(pool->size > sizeof(void *) ? pool->size : sizeof(void *));
+}
+
+void *engine_memory_pool_alloc(MemoryPool *pool) {
+	SDL_assert(pool->size > 0 && pool->per_chunk > 0);
+
+	if (!pool->free_objects) {
+		// The chunks are linked by their first pointer, the objects follow.
+		size_t size = object_size(pool);
+		char *chunk = malloc(ALIGN(sizeof(void *)) + size * pool->per_chunk);
+		*(void **)chunk = pool->chunks;
+		pool->chunks = chunk;
+		stats.heap_allocs++;
+
+		char *objects = chunk + ALIGN(sizeof(void *));
+		for (int i = pool->per_chunk - 1; i >= 0; i--) {
+			void *object = objects + size * i;
+			*(void **)object = pool->free_objects;
+			pool->free_objects = object;
+		}
+	}
+
+	void *object = pool->free_objects;
+	pool->free_objects = *(void **)object;
+	pool->used++;
+	stats.pool_allocs++;
+	return object;
+}
+
+void engine_memory_pool_free(MemoryPool *pool, void *object) {
+	if (!object)
+		return;
+
+	// Freed twice or from another pool.
+	SDL_assert(pool->used > 0);
+
+	*(void **)object = pool->free_objects;
+	pool->free_objects = object;
+	pool->used--;
+	stats.pool_frees++;
+}
+
+void engine_memory_pool_destroy(MemoryPool *pool) {
+	SDL_assert(pool->used == 0);
+
+	void *chunk = pool->chunks;
+	while (chunk) {
+		void *next = *(void **)chunk;
+		free(chunk);
+		chunk = next;
+	}
+
+	pool->chunks = NULL;
+	pool->free_objects = NULL;
+}
+
+static void push_block(size_t capacity) {
+	FrameBlock *block = malloc(ALIGN(sizeof(FrameBlock)) + capacity);
+	block->next = frame_block;
+	block->capacity = capacity;
+	block->used = 0;
+	frame_block = block;
+	stats.heap_allocs++;
+}
+
+void *engine_memory_frame_alloc(size_t size) {
+	size = ALIGN(size);
+
+	if (!frame_block || frame_block->used + size > frame_block->capacity) {
+		size_t capacity = frame_block ? frame_block->capacity * 2 : FRAME_ARENA_SIZE;
+		push_block(capacity > size ? capacity : size);
+	}
+
+	void *buffer = (char *)frame_block + ALIGN(sizeof(FrameBlock)) + frame_block->used;
+	frame_block->used += size;
+	stats.frame_bytes += size;
+	return buffer;
+}
+
+void engine_memory_frame_reset() {
+	// The blocks of a frame which didn't fit in one become a single one, big enough for all.
+	if (frame_block && frame_block->next) {
+		size_t capacity = 0;
+		while (frame_block) {
+			FrameBlock *next = frame_block->next;
+			capacity += frame_block->capacity;
+			free(frame_block);
+			frame_block = next;
+		}
+		push_block(capacity);
+	}
+
+	if (frame_block) {
+		frame_block->used = 0;
+		stats.frame_capacity = frame_block->capacity;
+	}
+
+	last_stats = stats;
+	memset(&stats, 0, sizeof(MemoryStats));
+}
+
+const MemoryStats *engine_memory_stats() {
+	return &last_stats;
+}
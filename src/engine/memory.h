@@ -0,0 +1,48 @@
+#ifndef ENGINE_MEMORY_H
+#define ENGINE_MEMORY_H
+
+#include <stddef.h>
+
+// Allocators for the main thread, so the engine allocates nothing in a steady frame.
+//
+// A pool hands out objects of one size, taken from chunks allocated as needed and reused once
+// freed. The frame arena hands out buffers which are valid until the end of the frame, all
+// released at once by engine_run.
+
+// A pool for objects of the type, usable without init.
+#define MEMORY_POOL(type, per_chunk) {sizeof(type), (per_chunk), NULL, NULL, 0}
+#define MEMORY_POOL_NEW(pool, type) ((type *)engine_memory_pool_alloc(pool))
+
+typedef struct MemoryPool {
+	size_t size; // Of the objects.
+	int per_chunk; // Objects per allocated chunk.
+	void *free_objects; // Used internally
+	void *chunks; // Used internally
+	unsigned int used; // Objects allocated and not freed.
+} MemoryPool;
+
+typedef struct MemoryStats {
+	unsigned int heap_allocs; // Chunks and arena blocks allocated.
+	unsigned int pool_allocs;
+	unsigned int pool_frees;
+	size_t frame_bytes; // Taken from the frame arena.
+	size_t frame_capacity; // Of the frame arena.
+} MemoryStats;
+
+// The objects are not zeroed.
+void *engine_memory_pool_alloc(MemoryPool *pool);
+void engine_memory_pool_free(MemoryPool *pool, void *object);
+
+// Frees the chunks, all the objects of the pool have to be freed before.
+void engine_memory_pool_destroy(MemoryPool *pool);
+
+// Aligned to 16 bytes, not zeroed. Valid until the end of the frame.
+void *engine_memory_frame_alloc(size_t size);
+
+// Used internally, called by engine_run at the end of each frame.
+void engine_memory_frame_reset();
+
+// Counters of the last frame.
+const MemoryStats *engine_memory_stats();
+
+#endif
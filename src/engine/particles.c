@@ -0,0 +1,253 @@
+#include "particles.h"
+#include <GL/glew.h>
+#include <SDL.h>
+#include <cglm/cglm.h>
+#include <engine/graphics/renderer.h>
+#include <engine/graphics/shader.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static Shader particleShader;
+
+static const ParticleStyle default_styles[NUM_PARTICLE_MATERIALS] = {
+	[PARTICLE_FIRE] = {{255, 200, 60, 255}, {200, 40, 10, 0}, 4, 1, -60, 1},
+	[PARTICLE_SPARK] = {{255, 240, 180, 255}, {255, 120, 0, 0}, 2, 1, 300, 0.5f},
+	[PARTICLE_BUBBLE] = {{255, 90, 30, 255}, {120, 20, 10, 0}, 3, 5, -20, 2},
+};
+
+static void create_pool(ParticlePool *pool, int capacity) {
+	// Padded, so the vectorized update never needs a scalar tail.
+	capacity = (capacity + 3) & ~3;
+	size_t size = sizeof(float) * capacity;
+
+	memset(pool, 0, sizeof(ParticlePool));
+	pool->capacity = capacity;
+	pool->x = SDL_SIMDAlloc(size);
+	pool->y = SDL_SIMDAlloc(size);
+	pool->vx = SDL_SIMDAlloc(size);
+	pool->vy = SDL_SIMDAlloc(size);
+	pool->life = SDL_SIMDAlloc(size);
+	pool->inv_lifetime = SDL_SIMDAlloc(size);
+	pool->age = SDL_SIMDAlloc(size);
+
+	// The padding is updated too, it has to hold numbers.
+	float *arrays[] = {pool->x, pool->y, pool->vx, pool->vy, pool->life, pool->inv_lifetime, pool->age};
+	for (int i = 0; i < (int)SDL_arraysize(arrays); i++)
+		memset(arrays[i], 0, size);
+}
+
+static void free_pool(ParticlePool *pool) {
+	SDL_SIMDFree(pool->x);
+	SDL_SIMDFree(pool->y);
+	SDL_SIMDFree(pool->vx);
+	SDL_SIMDFree(pool->vy);
+	SDL_SIMDFree(pool->life);
+	SDL_SIMDFree(pool->inv_lifetime);
+	SDL_SIMDFree(pool->age);
+}
+
+// Moves the particles [0, count) by dt seconds. damp scales the velocity, already for dt.
+static void integrate(ParticlePool *pool, float dt, float damp, float gravity) {
+	int i = 0;
+
+#if defined(__SSE2__)
+	int n = (pool->count + 3) & ~3;
+	__m128 vdt = _mm_set1_ps(dt);
+	__m128 vdamp = _mm_set1_ps(damp);
+	__m128 vg = _mm_set1_ps(gravity * dt);
+	__m128 one = _mm_set1_ps(1);
+	for (; i < n; i += 4) {
+		__m128 vx = _mm_mul_ps(_mm_load_ps(pool->vx + i), vdamp);
+		__m128 vy = _mm_add_ps(_mm_mul_ps(_mm_load_ps(pool->vy + i), vdamp), vg);
+		__m128 life = _mm_sub_ps(_mm_load_ps(pool->life + i), vdt);
+		_mm_store_ps(pool->vx + i, vx);
+		_mm_store_ps(pool->vy + i, vy);
+		_mm_store_ps(pool->x + i, _mm_add_ps(_mm_load_ps(pool->x + i), _mm_mul_ps(vx, vdt)));
+		_mm_store_ps(pool->y + i, _mm_add_ps(_mm_load_ps(pool->y + i), _mm_mul_ps(vy, vdt)));
+		_mm_store_ps(pool->life + i, life);
+		_mm_store_ps(pool->age + i, _mm_sub_ps(one, _mm_mul_ps(life, _mm_load_ps(pool->inv_lifetime + i))));
+	}
+#endif
+
+	for (; i < pool->count; i++) {
+		pool->vx[i] *= damp;
+		pool->vy[i] = pool->vy[i] * damp + gravity * dt;
+		pool->x[i] += pool->vx[i] * dt;
+		pool->y[i] += pool->vy[i] * dt;
+		pool->life[i] -= dt;
+		pool->age[i] = 1 - pool->life[i] * pool->inv_lifetime[i];
+	}
+}
+
+static void remove_dead(ParticlePool *pool) {
+	int i = 0;
+	while (i < pool->count) {
+		if (pool->life[i] > 0) {
+			i++;
+			continue;
+		}
+
+		int last = --pool->count;
+		pool->x[i] = pool->x[last];
+		pool->y[i] = pool->y[last];
+		pool->vx[i] = pool->vx[last];
+		pool->vy[i] = pool->vy[last];
+		pool->life[i] = pool->life[last];
+		pool->inv_lifetime[i] = pool->inv_lifetime[last];
+		pool->age[i] = pool->age[last];
+	}
+}
+
+static void on_update(Entity *entity, double delta) {
+	ParticleSystem *ps = (ParticleSystem *)entity;
+	Uint64 start = SDL_GetPerformanceCounter();
+	float dt = (float)(delta / 1000);
+	unsigned int alive = 0;
+
+	for (int m = 0; m < NUM_PARTICLE_MATERIALS; m++) {
+		ParticlePool *pool = &ps->pools[m];
+		ParticleStyle *style = &ps->styles[m];
+		if (pool->count == 0)
+			continue;
+
+		integrate(pool, dt, SDL_max(0, 1 - style->drag * dt), style->gravity);
+		remove_dead(pool);
+		alive += pool->count;
+	}
+
+	ps->stats.alive = alive;
+	ps->stats.update_ms = (double)(SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency();
+}
+
+static void on_render(Entity *entity, double delta) {
+	ParticleSystem *ps = (ParticleSystem *)entity;
+	RenderStats *stats = engine_render_stats();
+	stats->particles += ps->stats.alive;
+	stats->particle_capacity += ps->stats.capacity;
+	stats->particle_update_ms += ps->stats.update_ms;
+
+	engine_shader_use(particleShader);
+	glBindVertexArray(ps->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, ps->instance_vbo);
+
+	for (int m = 0; m < NUM_PARTICLE_MATERIALS; m++) {
+		ParticlePool *pool = &ps->pools[m];
+		ParticleStyle *style = &ps->styles[m];
+		if (pool->count == 0)
+			continue;
+
+		// The attributes point at the x, y and age arrays of the buffer, sized for the biggest pool.
+		size_t size = sizeof(float) * pool->count;
+		size_t stride = sizeof(float) * ps->pools[0].capacity;
+		glBufferSubData(GL_ARRAY_BUFFER, 0, size, pool->x);
+		glBufferSubData(GL_ARRAY_BUFFER, stride, size, pool->y);
+		glBufferSubData(GL_ARRAY_BUFFER, stride * 2, size, pool->age);
+
+		engine_shader_set_vec4(particleShader, "colorStart", style->start.r / 255.f, style->start.g / 255.f,
+							   style->start.b / 255.f, style->start.a / 255.f);
+		engine_shader_set_vec4(particleShader, "colorEnd", style->end.r / 255.f, style->end.g / 255.f,
+							   style->end.b / 255.f, style->end.a / 255.f);
+		engine_shader_set_vec2(particleShader, "size", style->size_start, style->size_end);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, pool->count);
+		stats->draw_calls++;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+static void on_free(Entity *entity) {
+	ParticleSystem *ps = (ParticleSystem *)entity;
+	glDeleteVertexArrays(1, &ps->vao);
+	glDeleteBuffers(1, &ps->quad_vbo);
+	glDeleteBuffers(1, &ps->instance_vbo);
+	for (int m = 0; m < NUM_PARTICLE_MATERIALS; m++)
+		free_pool(&ps->pools[m]);
+	free(ps);
+}
+
+static void create_buffers(ParticleSystem *ps) {
+	// Unit quad around the particle position, scaled by the size in the vertex shader.
+	GLfloat vertices[] = {-0.5f, -0.5f, 0.5f, -0.5f, -0.5f, 0.5f, 0.5f, -0.5f, 0.5f, 0.5f, -0.5f, 0.5f};
+	size_t stride = sizeof(float) * ps->pools[0].capacity;
+
+	glGenVertexArrays(1, &ps->vao);
+	glGenBuffers(1, &ps->quad_vbo);
+	glGenBuffers(1, &ps->instance_vbo);
+	glBindVertexArray(ps->vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, ps->quad_vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), 0);
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, ps->instance_vbo);
+	glBufferData(GL_ARRAY_BUFFER, stride * 3, NULL, GL_STREAM_DRAW);
+	for (int i = 0; i < 3; i++) {
+		glVertexAttribPointer(1 + i, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), (void *)(stride * i));
+		glEnableVertexAttribArray(1 + i);
+		glVertexAttribDivisor(1 + i, 1);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	if (!particleShader) {
+		particleShader = engine_shader_load("resources/shaders/particle.vert", "resources/shaders/particle.frag", NULL);
+		engine_shader_use(particleShader);
+		mat4 proj;
+		engine_render_projection(proj);
+		engine_shader_set_mat4(particleShader, "projection", proj);
+		mat4 view;
+		glm_mat4_identity(view);
+		engine_shader_set_mat4(particleShader, "view", view);
+	}
+}
+
+ParticleSystem *engine_particles_create(int capacity) {
+	ParticleSystem *ps = malloc(sizeof(ParticleSystem));
+	memset(ps, 0, sizeof(ParticleSystem));
+
+	ps->entity.on_update = on_update;
+	ps->entity.on_render = on_render;
+	ps->entity.on_free = on_free;
+	engine_random_seed(&ps->random, engine_random_next(engine_random()));
+
+	for (int m = 0; m < NUM_PARTICLE_MATERIALS; m++) {
+		create_pool(&ps->pools[m], capacity);
+		ps->styles[m] = default_styles[m];
+		ps->stats.capacity += ps->pools[m].capacity;
+	}
+
+	create_buffers(ps);
+	return ps;
+}
+
+int engine_particles_emit(ParticleSystem *ps, ParticleMaterial material, float x, float y, float vx, float vy,
+						  float spread, float lifetime, int count) {
+	// The update divides by it. Written so NaN is rejected too.
+	SDL_assert(lifetime > 0);
+	if (!(lifetime > 0))
+		return 0;
+
+	ParticlePool *pool = &ps->pools[material];
+	int emitted = SDL_min(count, pool->capacity - pool->count);
+	ps->stats.dropped += count - emitted;
+
+	for (int i = 0; i < emitted; i++) {
+		int p = pool->count++;
+		float life = lifetime * (0.5f + 0.5f * engine_random_float(&ps->random));
+		pool->x[p] = x;
+		pool->y[p] = y;
+		pool->vx[p] = vx + spread * (engine_random_float(&ps->random) * 2 - 1);
+		pool->vy[p] = vy + spread * (engine_random_float(&ps->random) * 2 - 1);
+		pool->life[p] = life;
+		pool->inv_lifetime[p] = 1 / life;
+		pool->age[p] = 0;
+	}
+
+	return emitted;
+}
@@ -0,0 +1,67 @@
+#ifndef ENGINE_PARTICLES_H
+#define ENGINE_PARTICLES_H
+
+#include <engine/color.h>
+#include <engine/entity.h>
+#include <engine/random.h>
+
+// A particle system is a single entity holding a pool per material, particles are not entities.
+// The pools are structures of arrays with a fixed capacity, updated four particles at a time, and
+// each material is drawn with one instanced call.
+
+typedef enum ParticleMaterial {
+	PARTICLE_FIRE,
+	PARTICLE_SPARK,
+	PARTICLE_BUBBLE, // Lava bubbles.
+	NUM_PARTICLE_MATERIALS
+} ParticleMaterial;
+
+// Look of the particles of a material, color and size go from start to end over the lifetime.
+typedef struct ParticleStyle {
+	Color start;
+	Color end;
+	float size_start, size_end; // In pixels.
+	float gravity; // In pixels per second squared, positive is down.
+	float drag; // Fraction of the velocity lost per second.
+} ParticleStyle;
+
+// The live particles are [0, count), a dead one is replaced by the last. The arrays are padded to a
+// multiple of four.
+typedef struct ParticlePool {
+	float *x, *y; // In pixels.
+	float *vx, *vy; // In pixels per second.
+	float *life; // Seconds left.
+	float *inv_lifetime; // 1 / the lifetime it was emitted with.
+	float *age; // From 0 when emitted to 1 when it dies.
+	int count;
+	int capacity;
+} ParticlePool;
+
+typedef struct ParticleStats {
+	unsigned int alive;
+	unsigned int capacity; // Of all the pools.
+	unsigned int dropped; // Not emitted because their pool was full.
+	double update_ms; // Time spent in the last update.
+} ParticleStats;
+
+typedef struct ParticleSystem {
+	Entity entity;
+	ParticlePool pools[NUM_PARTICLE_MATERIALS];
+	ParticleStyle styles[NUM_PARTICLE_MATERIALS];
+	Random random;
+	unsigned int vao;
+	unsigned int quad_vbo;
+	unsigned int instance_vbo; // Positions and ages of a pool, x, y and age arrays one after the other.
+	ParticleStats stats;
+} ParticleSystem;
+
+// capacity is the maximum of particles alive per material.
+ParticleSystem *engine_particles_create(int capacity);
+
+// Emits count particles at x, y with the velocity plus a random one up to spread on each axis. They
+// live between half and all of the lifetime, in seconds, which has to be more than 0. Returns how
+// many fit in the pool.
+int engine_particles_emit(ParticleSystem *ps, ParticleMaterial material, float x, float y, float vx, float vy,
+						  float spread, float lifetime, int count);
+
+#endif
@@ -0,0 +1,28 @@
+#include "random.h"
+
+static Random engine_generator = {ENGINE_RANDOM_SEED};
+
+void engine_random_seed(Random *r, uint64_t seed) {
+	r->state = seed;
+}
+
+// splitmix64
+uint32_t engine_random_next(Random *r) {
+	uint64_t z = (r->state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+int engine_random_range(Random *r, int min, int max) {
+	// Multiply and shift, cheaper than a modulo.
+	return min + (int)(((uint64_t)engine_random_next(r) * (uint32_t)(max - min)) >> 32);
+}
+
+float engine_random_float(Random *r) {
+	return (engine_random_next(r) >> 8) * (1.0f / 16777216.0f);
+}
+
+Random *engine_random() {
+	return &engine_generator;
+}
@@ -0,0 +1,26 @@
+#ifndef ENGINE_RANDOM_H
+#define ENGINE_RANDOM_H
+
+#include <stdint.h>
+
+// Seed of the engine generator, every session starts with the same numbers.
+#define ENGINE_RANDOM_SEED 2
+
+// Deterministic on every platform, unlike rand().
+typedef struct Random {
+	uint64_t state;
+} Random;
+
+void engine_random_seed(Random *r, uint64_t seed);
+uint32_t engine_random_next(Random *r);
+
+// In [min, max).
+int engine_random_range(Random *r, int min, int max);
+
+// In [0, 1).
+float engine_random_float(Random *r);
+
+// The engine generator, seeded in engine_init and again when a replay starts.
+Random *engine_random();
+
+#endif
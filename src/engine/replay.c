@@ -0,0 +1,323 @@
+#include "replay.h"
+#include <SDL.h>
+#include <engine/engine.h>
+#include <engine/logger.h>
+#include <engine/random.h>
+#include <engine/settings.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The log starts with a header:
+//   u32 magic, u32 version, u64 random seed, u32 window width, u32 window height, u32 keyboard length
+// Followed by one record per tick:
+//   u32 event count, then for each event: u32 type and the event struct
+//   u32 mouse state, i32 mouse x, i32 mouse y
+//   u16 changed key count, then for each key: u16 scancode, u8 state
+// Numbers are little endian. Events are written as they are in memory, so replays are only
+// portable between builds for the same platform.
+
+#define REPLAY_MAGIC 0x50524753 // "SGRP"
+#define REPLAY_VERSION 1
+
+static ReplayMode mode = REPLAY_OFF;
+static SDL_RWops *file = NULL;
+
+// Events of the tick being recorded, written together with the input state.
+static SDL_Event *events = NULL;
+static int event_count = 0;
+static int event_capacity = 0;
+
+// Keyboard state of the last tick, only the keys that changed are in the log.
+static Uint8 *keyboard_state = NULL;
+static int keyboard_length = 0;
+
+// Events of the tick being replayed that were not read yet, -1 until the tick is read.
+static int events_left = -1;
+static unsigned long ticks = 0;
+static Uint64 start_time = 0;
+
+// Bytes of the event in the log, 0 if the event is not recorded.
+static size_t event_size(Uint32 type) {
+	switch (type) {
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+		return sizeof(SDL_KeyboardEvent);
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+		return sizeof(SDL_MouseButtonEvent);
+	case SDL_MOUSEMOTION:
+		return sizeof(SDL_MouseMotionEvent);
+	case SDL_MOUSEWHEEL:
+		return sizeof(SDL_MouseWheelEvent);
+	case SDL_TEXTINPUT:
+		return sizeof(SDL_TextInputEvent);
+	case SDL_TEXTEDITING:
+		return sizeof(SDL_TextEditingEvent);
+	case SDL_WINDOWEVENT:
+		return sizeof(SDL_WindowEvent);
+	default:
+		// Quitting ends the log, others like dropped files hold pointers.
+		return 0;
+	}
+}
+
+static int open_log(const char *path, const char *file_mode) {
+	engine_replay_stop();
+
+	file = SDL_RWFromFile(path, file_mode);
+	if (!file) {
+		engine_log_error("Error opening replay %s: %s", path, SDL_GetError());
+		return 0;
+	}
+
+	SDL_GetKeyboardState(&keyboard_length);
+	ticks = 0;
+	events_left = -1;
+	start_time = SDL_GetPerformanceCounter();
+	return 1;
+}
+
+// The SDL_ReadLE functions can't tell the end of the file from a 0, these return 0 at the end.
+static int read_bytes(Uint8 *bytes, size_t size) {
+	return SDL_RWread(file, bytes, size, 1) == 1;
+}
+
+static int read_u16(Uint16 *value) {
+	Uint8 b[2];
+	if (!read_bytes(b, sizeof(b)))
+		return 0;
+	*value = b[0] | b[1] << 8;
+	return 1;
+}
+
+static int read_u32(Uint32 *value) {
+	Uint8 b[4];
+	if (!read_bytes(b, sizeof(b)))
+		return 0;
+	*value = b[0] | b[1] << 8 | b[2] << 16 | (Uint32)b[3] << 24;
+	return 1;
+}
+
+static int read_u64(Uint64 *value) {
+	Uint32 low, high;
+	if (!read_u32(&low) || !read_u32(&high))
+		return 0;
+	*value = low | (Uint64)high << 32;
+	return 1;
+}
+
+static void alloc_keyboard_state() {
+	keyboard_state = malloc(keyboard_length);
+	memset(keyboard_state, 0, keyboard_length);
+}
+
+int engine_replay_record(const char *path) {
+	if (!open_log(path, "wb"))
+		return 0;
+
+	alloc_keyboard_state();
+
+	// The state the generator is in now, whatever it was seeded with, so the replay gets the same
+	// random numbers.
+	SDL_WriteLE32(file, REPLAY_MAGIC);
+	SDL_WriteLE32(file, REPLAY_VERSION);
+	SDL_WriteLE64(file, engine_random()->state);
+	SDL_WriteLE32(file, engine_settings_get_int("window_width"));
+	SDL_WriteLE32(file, engine_settings_get_int("window_height"));
+	SDL_WriteLE32(file, keyboard_length);
+
+	mode = REPLAY_RECORD;
+	engine_log_info("Recording replay to %s", path);
+	return 1;
+}
+
+int engine_replay_play(const char *path) {
+	if (!open_log(path, "rb"))
+		return 0;
+
+	Uint32 magic, version, w, h, recorded_length;
+	Uint64 seed;
+	if (!read_u32(&magic) || !read_u32(&version) || magic != REPLAY_MAGIC || version != REPLAY_VERSION) {
+		engine_log_error("%s is not a replay or is from another version", path);
+		engine_replay_stop();
+		return 0;
+	}
+
+	if (!read_u64(&seed) || !read_u32(&w) || !read_u32(&h) || !read_u32(&recorded_length)) {
+		engine_log_error("%s is truncated", path);
+		engine_replay_stop();
+		return 0;
+	}
+
+	engine_random_seed(engine_random(), seed);
+
+	if ((int)w != engine_settings_get_int("window_width") || (int)h != engine_settings_get_int("window_height")) {
+		engine_log_warning("Replay recorded with a %dx%d window, the mouse positions may not match", w, h);
+	}
+
+	// Keys the recording platform had, the state of the others stays released.
+	keyboard_length = SDL_max(keyboard_length, (int)recorded_length);
+	alloc_keyboard_state();
+
+	mode = REPLAY_PLAY;
+	engine_log_info("Playing replay %s", path);
+	return 1;
+}
+
+void engine_replay_stop() {
+	if (file)
+		SDL_RWclose(file);
+
+	free(events);
+	free(keyboard_state);
+	file = NULL;
+	events = NULL;
+	keyboard_state = NULL;
+	event_count = 0;
+	event_capacity = 0;
+	mode = REPLAY_OFF;
+}
+
+ReplayMode engine_replay_mode() {
+	return mode;
+}
+
+static void finish_replay() {
+	double ms = (double)(SDL_GetPerformanceCounter() - start_time) * 1000 / SDL_GetPerformanceFrequency();
+	engine_log_info("Replay finished: %lu ticks in %.1f ms, %.3f ms per tick", ticks, ms, ticks ? ms / ticks : 0);
+	engine_replay_stop();
+	engine_quit();
+}
+
+static void record_event(SDL_Event *event) {
+	if (event_count == event_capacity) {
+		event_capacity = event_capacity ? event_capacity * 2 : 16;
+		events = realloc(events, sizeof(SDL_Event) * event_capacity);
+	}
+	events[event_count++] = *event;
+}
+
+// Returns 0 if the log is corrupt.
+static int read_event(SDL_Event *event) {
+	memset(event, 0, sizeof(SDL_Event));
+	Uint32 type = 0;
+	size_t size = read_u32(&type) ? event_size(type) : 0;
+
+	if (size == 0 || !read_bytes((Uint8 *)event, size)) {
+		engine_log_error("Replay is corrupt, stopping it");
+		return 0;
+	}
+
+	return 1;
+}
+
+int engine_replay_poll_event(SDL_Event *event) {
+	if (mode != REPLAY_PLAY) {
+		if (!SDL_PollEvent(event))
+			return 0;
+		if (mode == REPLAY_RECORD && event_size(event->type))
+			record_event(event);
+		return 1;
+	}
+
+	// The window can still be closed, everything else comes from the log.
+	while (SDL_PollEvent(event)) {
+		if (event->type == SDL_QUIT)
+			return 1;
+	}
+
+	if (events_left < 0) {
+		// The end of the file between two ticks is the end of the replay.
+		Uint32 count;
+		if (!read_u32(&count)) {
+			finish_replay();
+			return 0;
+		}
+		events_left = count;
+	}
+
+	if (events_left == 0)
+		return 0;
+
+	events_left--;
+	if (!read_event(event)) {
+		finish_replay();
+		return 0;
+	}
+
+	return 1;
+}
+
+static void write_tick(Uint32 mouse_state, int mouse_x, int mouse_y, Uint8 *keyboard) {
+	SDL_WriteLE32(file, event_count);
+	for (int i = 0; i < event_count; i++) {
+		SDL_WriteLE32(file, events[i].type);
+		SDL_RWwrite(file, &events[i], event_size(events[i].type), 1);
+	}
+	event_count = 0;
+
+	SDL_WriteLE32(file, mouse_state);
+	SDL_WriteLE32(file, (Uint32)mouse_x);
+	SDL_WriteLE32(file, (Uint32)mouse_y);
+
+	int changed = 0;
+	for (int k = 0; k < keyboard_length; k++)
+		changed += keyboard[k] != keyboard_state[k];
+
+	SDL_WriteLE16(file, changed);
+	for (int k = 0; k < keyboard_length; k++) {
+		if (keyboard[k] != keyboard_state[k]) {
+			SDL_WriteLE16(file, k);
+			SDL_WriteU8(file, keyboard[k]);
+		}
+	}
+	memcpy(keyboard_state, keyboard, keyboard_length);
+}
+
+// Returns 0 if the log ends in the middle of the tick, the input is left as it was.
+static int read_tick(Uint32 *mouse_state, int *mouse_x, int *mouse_y, Uint8 *keyboard, int length) {
+	// Events of the tick that were not polled are skipped.
+	SDL_Event event;
+	for (; events_left > 0; events_left--) {
+		if (!read_event(&event))
+			return 0;
+	}
+
+	Uint32 state, x, y;
+	Uint16 changed;
+	if (!read_u32(&state) || !read_u32(&x) || !read_u32(&y) || !read_u16(&changed)) {
+		engine_log_error("Replay is truncated, stopping it");
+		return 0;
+	}
+
+	for (int i = 0; i < changed; i++) {
+		Uint16 k;
+		Uint8 key_state;
+		if (!read_u16(&k) || !read_bytes(&key_state, 1)) {
+			engine_log_error("Replay is truncated, stopping it");
+			return 0;
+		}
+		if (k < keyboard_length)
+			keyboard_state[k] = key_state;
+	}
+
+	*mouse_state = state;
+	*mouse_x = (Sint32)x;
+	*mouse_y = (Sint32)y;
+	memcpy(keyboard, keyboard_state, SDL_min(length, keyboard_length));
+	events_left = -1;
+	return 1;
+}
+
+void engine_replay_input(Uint32 *mouse_state, int *mouse_x, int *mouse_y, Uint8 *keyboard, int length) {
+	if (mode == REPLAY_RECORD) {
+		write_tick(*mouse_state, *mouse_x, *mouse_y, keyboard);
+		ticks++;
+	} else if (mode == REPLAY_PLAY) {
+		if (!read_tick(mouse_state, mouse_x, mouse_y, keyboard, length)) {
+			finish_replay();
+			return;
+		}
+		ticks++;
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef ENGINE_REPLAY_H
+#define ENGINE_REPLAY_H
+
+#include <SDL_stdinc.h>
+
+// Records the events and the input state of every tick to a binary log, and plays it back.
+// Recording and replaying both run at a fixed step, so a replay goes through exactly the same
+// ticks as the recorded session. Started with --record <file> or --replay <file>. The engine quits
+// at the end of a replay and logs the time per tick.
+
+// Delta time of a tick while recording or replaying, in ms.
+#define ENGINE_REPLAY_STEP_MS (1000.0 / 60.0)
+
+typedef enum ReplayMode {
+	REPLAY_OFF,
+	REPLAY_RECORD,
+	REPLAY_PLAY,
+} ReplayMode;
+
+// Both return 0 if the file can't be opened.
+int engine_replay_record(const char *path);
+int engine_replay_play(const char *path);
+
+// Closes the log, also called when a replay reaches the end.
+void engine_replay_stop();
+
+ReplayMode engine_replay_mode();
+
+union SDL_Event;
+
+// Used internally, replaces SDL_PollEvent. Returns the recorded events when replaying.
+int engine_replay_poll_event(union SDL_Event *event);
+
+// Used internally, records the input state of the tick or replaces it with the recorded one.
+void engine_replay_input(Uint32 *mouse_state, int *mouse_x, int *mouse_y, Uint8 *keyboard, int length);
+
+#endif
@@ -0,0 +1,303 @@
+#include "sparse_tilemap.h"
+#include <SDL.h>
+#include <engine/tileops.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHUNK_TILES (TILEMAP_CHUNK_SIZE * TILEMAP_CHUNK_SIZE)
+#define INITIAL_CAPACITY 64
+
+// Rounds towards negative infinity, so tile -1 is in chunk -1.
+static int chunk_coord(int v) {
+	return v >= 0 ? v / TILEMAP_CHUNK_SIZE : (v + 1) / TILEMAP_CHUNK_SIZE - 1;
+}
+
+static uint32_t hash_coords(int32_t cx, int32_t cy) {
+	uint32_t h = (uint32_t)cx * 0x9e3779b1u ^ (uint32_t)cy * 0x85ebca77u;
+	h ^= h >> 15;
+	h *= 0x2c1b3c6du;
+	h ^= h >> 13;
+	return h;
+}
+
+// Returns the slot of the chunk, or the empty slot where it would go.
+static int find_slot(SparseTilemap *t, int32_t cx, int32_t cy) {
+	int mask = t->capacity - 1;
+	int i = hash_coords(cx, cy) & mask;
+
+	while (t->slots[i].used && (t->slots[i].cx != cx || t->slots[i].cy != cy))
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+static void alloc_slots(SparseTilemap *t, int capacity) {
+	t->capacity = capacity;
+	t->slots = malloc(sizeof(SparseChunk) * capacity);
+	memset(t->slots, 0, sizeof(SparseChunk) * capacity);
+}
+
+static void grow(SparseTilemap *t) {
+	SparseChunk *old = t->slots;
+	int old_capacity = t->capacity;
+
+	alloc_slots(t, old_capacity * 2);
+	for (int i = 0; i < old_capacity; i++) {
+		if (old[i].used)
+			t->slots[find_slot(t, old[i].cx, old[i].cy)] = old[i];
+	}
+
+	free(old);
+}
+
+// Returns the chunk, adding it uniformly of the fill type if it is not in the map.
+static SparseChunk *get_or_add(SparseTilemap *t, int32_t cx, int32_t cy) {
+	int i = find_slot(t, cx, cy);
+	if (t->slots[i].used)
+		return &t->slots[i];
+
+	// Below 70% full, the probe sequences stay short.
+	if ((t->count + 1) * 10 > t->capacity * 7) {
+		grow(t);
+		i = find_slot(t, cx, cy);
+	}
+
+	SparseChunk *chunk = &t->slots[i];
+	chunk->cx = cx;
+	chunk->cy = cy;
+	chunk->used = 1;
+	chunk->type = t->fill;
+	chunk->data = NULL;
+	t->count++;
+	return chunk;
+}
+
+static void free_data(SparseTilemap *t, SparseChunk *chunk) {
+	if (chunk->data) {
+		free(chunk->data);
+		chunk->data = NULL;
+		t->dense_count--;
+	}
+}
+
+// Shifts the chunks after it back, so no probe sequence has a hole.
+static void remove_chunk(SparseTilemap *t, SparseChunk *chunk) {
+	int mask = t->capacity - 1;
+	int hole = chunk - t->slots;
+
+	free_data(t, chunk);
+	t->count--;
+
+	for (int i = (hole + 1) & mask; t->slots[i].used; i = (i + 1) & mask) {
+		int home = hash_coords(t->slots[i].cx, t->slots[i].cy) & mask;
+		// Moved only if its home is not between the hole and it.
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			t->slots[hole] = t->slots[i];
+			hole = i;
+		}
+	}
+
+	t->slots[hole].used = 0;
+	t->slots[hole].data = NULL;
+}
+
+static void set_uniform(SparseTilemap *t, SparseChunk *chunk, TileType type) {
+	if (type == t->fill) {
+		remove_chunk(t, chunk);
+	} else {
+		free_data(t, chunk);
+		chunk->type = type;
+	}
+}
+
+static void make_dense(SparseTilemap *t, SparseChunk *chunk) {
+	if (chunk->data)
+		return;
+
+	chunk->data = malloc(sizeof(SparseChunkTiles));
+	memset(chunk->data->counts, 0, sizeof(chunk->data->counts));
+	engine_tileops_fill(chunk->data->tiles, CHUNK_TILES, chunk->type);
+	chunk->data->counts[chunk->type] = CHUNK_TILES;
+	t->dense_count++;
+}
+
+// Collapses the chunk once all its tiles are of the type last written.
+static void check_uniform(SparseTilemap *t, SparseChunk *chunk, TileType type) {
+	if (chunk->data->counts[type] == CHUNK_TILES)
+		set_uniform(t, chunk, type);
+}
+
+SparseTilemap *engine_sparse_tilemap_create(TileType fill) {
+	SparseTilemap *t = malloc(sizeof(SparseTilemap));
+	memset(t, 0, sizeof(SparseTilemap));
+	t->fill = fill;
+	alloc_slots(t, INITIAL_CAPACITY);
+	return t;
+}
+
+SparseChunk *engine_sparse_tilemap_chunk(SparseTilemap *t, int cx, int cy) {
+	SparseChunk *chunk = &t->slots[find_slot(t, cx, cy)];
+	return chunk->used ? chunk : NULL;
+}
+
+void engine_sparse_tilemap_set(SparseTilemap *t, int x, int y, TileType type) {
+	int cx = chunk_coord(x);
+	int cy = chunk_coord(y);
+	SparseChunk *chunk = engine_sparse_tilemap_chunk(t, cx, cy);
+
+	if (!chunk) {
+		if (type == t->fill)
+			return;
+		chunk = get_or_add(t, cx, cy);
+	}
+
+	if (!chunk->data && chunk->type == type)
+		return;
+
+	make_dense(t, chunk);
+
+	Tile *tile = &chunk->data->tiles[(y - cy * TILEMAP_CHUNK_SIZE) * TILEMAP_CHUNK_SIZE + x - cx * TILEMAP_CHUNK_SIZE];
+	if (tile->type == type)
+		return;
+
+	chunk->data->counts[tile->type]--;
+	chunk->data->counts[type]++;
+	tile->type = type;
+	check_uniform(t, chunk, type);
+}
+
+TileType engine_sparse_tilemap_get(SparseTilemap *t, int x, int y) {
+	int cx = chunk_coord(x);
+	int cy = chunk_coord(y);
+	SparseChunk *chunk = engine_sparse_tilemap_chunk(t, cx, cy);
+
+	if (!chunk)
+		return t->fill;
+	if (!chunk->data)
+		return chunk->type;
+
+	return chunk->data->tiles[(y - cy * TILEMAP_CHUNK_SIZE) * TILEMAP_CHUNK_SIZE + x - cx * TILEMAP_CHUNK_SIZE].type;
+}
+
+// Part of r inside the chunk, relative to the chunk.
+static Rect2Di chunk_part(Rect2Di r, int cx, int cy) {
+	int x0 = SDL_max(r.x - cx * TILEMAP_CHUNK_SIZE, 0);
+	int y0 = SDL_max(r.y - cy * TILEMAP_CHUNK_SIZE, 0);
+	int x1 = SDL_min(r.x + r.w - cx * TILEMAP_CHUNK_SIZE, TILEMAP_CHUNK_SIZE);
+	int y1 = SDL_min(r.y + r.h - cy * TILEMAP_CHUNK_SIZE, TILEMAP_CHUNK_SIZE);
+	return (Rect2Di){x0, y0, x1 - x0, y1 - y0};
+}
+
+static void set_part(SparseTilemap *t, int cx, int cy, Rect2Di part, TileType type) {
+	SparseChunk *chunk = engine_sparse_tilemap_chunk(t, cx, cy);
+
+	if (part.w == TILEMAP_CHUNK_SIZE && part.h == TILEMAP_CHUNK_SIZE) {
+		if (chunk)
+			set_uniform(t, chunk, type);
+		else if (type != t->fill)
+			get_or_add(t, cx, cy)->type = type;
+		return;
+	}
+
+	if (!chunk) {
+		if (type == t->fill)
+			return;
+		chunk = get_or_add(t, cx, cy);
+	}
+
+	if (!chunk->data && chunk->type == type)
+		return;
+
+	make_dense(t, chunk);
+
+	SparseChunkTiles *data = chunk->data;
+	for (int y = part.y; y < part.y + part.h; y++) {
+		Tile *row = data->tiles + y * TILEMAP_CHUNK_SIZE + part.x;
+		unsigned long hist[NUM_TILE_TYPES] = {0};
+		engine_tileops_histogram(row, part.w, hist);
+		for (int i = 0; i < NUM_TILE_TYPES; i++)
+			data->counts[i] -= hist[i];
+
+		engine_tileops_fill(row, part.w, type);
+		data->counts[type] += part.w;
+	}
+
+	check_uniform(t, chunk, type);
+}
+
+void engine_sparse_tilemap_set_rect(SparseTilemap *t, Rect2Di r, TileType type) {
+	if (r.w <= 0 || r.h <= 0)
+		return;
+
+	int cx1 = chunk_coord(r.x + r.w - 1);
+	int cy1 = chunk_coord(r.y + r.h - 1);
+
+	for (int cy = chunk_coord(r.y); cy <= cy1; cy++) {
+		for (int cx = chunk_coord(r.x); cx <= cx1; cx++)
+			set_part(t, cx, cy, chunk_part(r, cx, cy), type);
+	}
+}
+
+void engine_sparse_tilemap_read_rect(SparseTilemap *t, Rect2Di r, Tile *out) {
+	if (r.w <= 0 || r.h <= 0)
+		return;
+
+	int cx1 = chunk_coord(r.x + r.w - 1);
+	int cy1 = chunk_coord(r.y + r.h - 1);
+
+	for (int cy = chunk_coord(r.y); cy <= cy1; cy++) {
+		for (int cx = chunk_coord(r.x); cx <= cx1; cx++) {
+			SparseChunk *chunk = engine_sparse_tilemap_chunk(t, cx, cy);
+			Rect2Di part = chunk_part(r, cx, cy);
+			// Position of the part in out.
+			int ox = cx * TILEMAP_CHUNK_SIZE + part.x - r.x;
+			int oy = cy * TILEMAP_CHUNK_SIZE + part.y - r.y;
+
+			for (int y = 0; y < part.h; y++) {
+				Tile *dst = out + (size_t)(oy + y) * r.w + ox;
+				if (chunk && chunk->data)
+					memcpy(dst, chunk->data->tiles + (part.y + y) * TILEMAP_CHUNK_SIZE + part.x, sizeof(Tile) * part.w);
+				else
+					engine_tileops_fill(dst, part.w, chunk ? chunk->type : t->fill);
+			}
+		}
+	}
+}
+
+Tilemap *engine_sparse_tilemap_extract(SparseTilemap *t, Rect2Di r, int tile_size, TilemapRenderMode mode) {
+	Tile *tiles = SDL_SIMDAlloc(sizeof(Tile) * (size_t)r.w * r.h);
+	engine_sparse_tilemap_read_rect(t, r, tiles);
+	return engine_tilemap_create_tiles(r.w, r.h, tile_size, mode, tiles);
+}
+
+int engine_sparse_tilemap_bounds(SparseTilemap *t, Rect2Di *out) {
+	if (t->count == 0)
+		return 0;
+
+	int x0 = INT32_MAX, y0 = INT32_MAX, x1 = INT32_MIN, y1 = INT32_MIN;
+	for (int i = 0; i < t->capacity; i++) {
+		SparseChunk *chunk = &t->slots[i];
+		if (chunk->used) {
+			x0 = SDL_min(x0, chunk->cx);
+			y0 = SDL_min(y0, chunk->cy);
+			x1 = SDL_max(x1, chunk->cx);
+			y1 = SDL_max(y1, chunk->cy);
+		}
+	}
+
+	*out = (Rect2Di){x0 * TILEMAP_CHUNK_SIZE, y0 * TILEMAP_CHUNK_SIZE, (x1 - x0 + 1) * TILEMAP_CHUNK_SIZE,
+					 (y1 - y0 + 1) * TILEMAP_CHUNK_SIZE};
+	return 1;
+}
+
+size_t engine_sparse_tilemap_memory(SparseTilemap *t) {
+	return sizeof(SparseTilemap) + sizeof(SparseChunk) * t->capacity + sizeof(SparseChunkTiles) * t->dense_count;
+}
+
+void engine_sparse_tilemap_free(SparseTilemap *t) {
+	for (int i = 0; i < t->capacity; i++)
+		free(t->slots[i].data);
+
+	free(t->slots);
+	free(t);
+}
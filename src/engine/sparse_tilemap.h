@@ -0,0 +1,60 @@
+#ifndef ENGINE_SPARSE_TILEMAP_H
+#define ENGINE_SPARSE_TILEMAP_H
+
+#include <engine/tilemap.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A tilemap without bounds, stored as a hash map of TILEMAP_CHUNK_SIZE chunks keyed by their
+// chunk coordinates. Coordinates can be negative. Chunks are only allocated when written, and a
+// chunk where every tile has the same type is kept as that single type, so the memory used depends
+// on the content and not on the area. Chunks that end up all of the fill type are removed.
+// It has no rendering or simulation, copy a rect into a Tilemap with engine_sparse_tilemap_extract.
+
+// Tiles of a chunk that is not uniform.
+typedef struct SparseChunkTiles {
+	Tile tiles[TILEMAP_CHUNK_SIZE * TILEMAP_CHUNK_SIZE]; // Row by row.
+	uint16_t counts[NUM_TILE_TYPES]; // Tiles of each type, the chunk is uniform when one has all.
+} SparseChunkTiles;
+
+typedef struct SparseChunk {
+	int32_t cx, cy; // In chunks, the first tile is at cx * TILEMAP_CHUNK_SIZE.
+	int used; // The slot holds a chunk.
+	TileType type; // Type of every tile if data is NULL.
+	SparseChunkTiles *data;
+} SparseChunk;
+
+typedef struct SparseTilemap {
+	TileType fill; // Type of the tiles outside of the chunks.
+	SparseChunk *slots; // Open addressing, the capacity is a power of two.
+	int capacity;
+	int count; // Chunks in the map.
+	int dense_count; // Chunks with their own tiles.
+} SparseTilemap;
+
+SparseTilemap *engine_sparse_tilemap_create(TileType fill);
+
+void engine_sparse_tilemap_set(SparseTilemap *t, int x, int y, TileType type);
+TileType engine_sparse_tilemap_get(SparseTilemap *t, int x, int y);
+
+// Chunks fully inside the rect become uniform without allocating their tiles.
+void engine_sparse_tilemap_set_rect(SparseTilemap *t, Rect2Di r, TileType type);
+
+// Copies the rect row by row into out, which has r.w * r.h tiles.
+void engine_sparse_tilemap_read_rect(SparseTilemap *t, Rect2Di r, Tile *out);
+
+// Creates a tilemap with a copy of the rect, tile (0, 0) of it is r.x, r.y.
+Tilemap *engine_sparse_tilemap_extract(SparseTilemap *t, Rect2Di r, int tile_size, TilemapRenderMode mode);
+
+// Returns the chunk, NULL if it was never written or is all of the fill type.
+SparseChunk *engine_sparse_tilemap_chunk(SparseTilemap *t, int cx, int cy);
+
+// Area covered by the chunks, in tiles. Returns 0 if there are none.
+int engine_sparse_tilemap_bounds(SparseTilemap *t, Rect2Di *out);
+
+// Bytes used by the map and its chunks.
+size_t engine_sparse_tilemap_memory(SparseTilemap *t);
+
+void engine_sparse_tilemap_free(SparseTilemap *t);
+
+#endif
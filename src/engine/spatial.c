@@ -0,0 +1,163 @@
+#include "spatial.h"
+#include <SDL.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int cell_coord(float v) {
+	return (int)floorf(v / SPATIAL_CELL_SIZE);
+}
+
+// Cells overlapped by the rect, inclusive.
+static void cell_range(Rect2Df r, int *cx0, int *cy0, int *cx1, int *cy1) {
+	*cx0 = cell_coord(r.x);
+	*cy0 = cell_coord(r.y);
+	// The right and bottom edges are outside the rect.
+	*cx1 = SDL_max(*cx0, (int)ceilf((r.x + r.w) / SPATIAL_CELL_SIZE) - 1);
+	*cy1 = SDL_max(*cy0, (int)ceilf((r.y + r.h) / SPATIAL_CELL_SIZE) - 1);
+}
+
+static SpatialBucket *bucket_of(SpatialGrid *grid, int cx, int cy) {
+	uint32_t h = (uint32_t)cx * 0x9e3779b1u ^ (uint32_t)cy * 0x85ebca77u;
+	h ^= h >> 16;
+	return &grid->buckets[h & (grid->bucket_count - 1)];
+}
+
+static void add_entry(SpatialBucket *bucket, SpatialEntry entry) {
+	if (bucket->count == bucket->capacity) {
+		bucket->capacity = bucket->capacity ? bucket->capacity * 2 : 8;
+		bucket->entries = realloc(bucket->entries, sizeof(SpatialEntry) * bucket->capacity);
+	}
+	bucket->entries[bucket->count++] = entry;
+}
+
+// Doubles the buckets and moves the entries to their new bucket.
+static void grow(SpatialGrid *grid) {
+	SpatialBucket *old = grid->buckets;
+	int old_count = grid->bucket_count;
+
+	grid->bucket_count *= 2;
+	grid->buckets = malloc(sizeof(SpatialBucket) * grid->bucket_count);
+	memset(grid->buckets, 0, sizeof(SpatialBucket) * grid->bucket_count);
+
+	for (int b = 0; b < old_count; b++) {
+		for (int i = 0; i < old[b].count; i++)
+			add_entry(bucket_of(grid, old[b].entries[i].cx, old[b].entries[i].cy), old[b].entries[i]);
+		free(old[b].entries);
+	}
+	free(old);
+}
+
+static int has_point(Rect2Df *r, float x, float y) {
+	return x >= r->x && x < r->x + r->w && y >= r->y && y < r->y + r->h;
+}
+
+static int overlaps(Rect2Df *a, Rect2Df *b) {
+	return a->x < b->x + b->w && b->x < a->x + a->w && a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+SpatialGrid *engine_spatial_create() {
+	SpatialGrid *grid = malloc(sizeof(SpatialGrid));
+	memset(grid, 0, sizeof(SpatialGrid));
+
+	grid->bucket_count = SPATIAL_MIN_BUCKETS;
+	grid->buckets = malloc(sizeof(SpatialBucket) * grid->bucket_count);
+	memset(grid->buckets, 0, sizeof(SpatialBucket) * grid->bucket_count);
+	return grid;
+}
+
+void engine_spatial_insert(SpatialGrid *grid, void *item, Rect2Df rect) {
+	int cx0, cy0, cx1, cy1;
+	cell_range(rect, &cx0, &cy0, &cx1, &cy1);
+
+	int cells = (cx1 - cx0 + 1) * (cy1 - cy0 + 1);
+	while (grid->entries + cells > grid->bucket_count * SPATIAL_BUCKET_LOAD)
+		grow(grid);
+
+	for (int cy = cy0; cy <= cy1; cy++) {
+		for (int cx = cx0; cx <= cx1; cx++)
+			add_entry(bucket_of(grid, cx, cy), (SpatialEntry){item, rect, cx, cy});
+	}
+
+	grid->entries += cells;
+	grid->count++;
+}
+
+void engine_spatial_remove(SpatialGrid *grid, void *item, Rect2Df rect) {
+	int cx0, cy0, cx1, cy1;
+	cell_range(rect, &cx0, &cy0, &cx1, &cy1);
+	int removed = 0;
+
+	for (int cy = cy0; cy <= cy1; cy++) {
+		for (int cx = cx0; cx <= cx1; cx++) {
+			SpatialBucket *bucket = bucket_of(grid, cx, cy);
+			for (int i = 0; i < bucket->count; i++) {
+				SpatialEntry *entry = &bucket->entries[i];
+				if (entry->item == item && entry->cx == cx && entry->cy == cy) {
+					*entry = bucket->entries[--bucket->count];
+					removed++;
+					break;
+				}
+			}
+		}
+	}
+
+	// Not in the grid, or inserted with another rect.
+	SDL_assert(removed > 0);
+	if (removed) {
+		grid->entries -= removed;
+		grid->count--;
+	}
+}
+
+int engine_spatial_query_point(SpatialGrid *grid, float x, float y, SPATIAL_QUERY_FN fn, void *data) {
+	int cx = cell_coord(x);
+	int cy = cell_coord(y);
+	SpatialBucket *bucket = bucket_of(grid, cx, cy);
+	int found = 0;
+
+	for (int i = 0; i < bucket->count; i++) {
+		SpatialEntry *entry = &bucket->entries[i];
+		if (entry->cx == cx && entry->cy == cy && has_point(&entry->rect, x, y)) {
+			fn(entry->item, data);
+			found++;
+		}
+	}
+
+	return found;
+}
+
+int engine_spatial_query_rect(SpatialGrid *grid, Rect2Df rect, SPATIAL_QUERY_FN fn, void *data) {
+	int cx0, cy0, cx1, cy1;
+	cell_range(rect, &cx0, &cy0, &cx1, &cy1);
+	int found = 0;
+
+	for (int cy = cy0; cy <= cy1; cy++) {
+		for (int cx = cx0; cx <= cx1; cx++) {
+			SpatialBucket *bucket = bucket_of(grid, cx, cy);
+			for (int i = 0; i < bucket->count; i++) {
+				SpatialEntry *entry = &bucket->entries[i];
+				if (entry->cx != cx || entry->cy != cy || !overlaps(&entry->rect, &rect))
+					continue;
+
+				// An item in several of the cells is only reported from the first cell both rects share.
+				if (cx != SDL_max(cx0, cell_coord(entry->rect.x)) || cy != SDL_max(cy0, cell_coord(entry->rect.y)))
+					continue;
+
+				fn(entry->item, data);
+				found++;
+			}
+		}
+	}
+
+	return found;
+}
+
+void engine_spatial_free(SpatialGrid *grid) {
+	for (int i = 0; i < grid->bucket_count; i++)
+		free(grid->buckets[i].entries);
+
+	free(grid->buckets);
+	free(grid);
+}
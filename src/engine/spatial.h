@@ -0,0 +1,52 @@
+#ifndef ENGINE_SPATIAL_H
+#define ENGINE_SPATIAL_H
+
+#include <engine/math/rect.h>
+
+// Uniform grid of rects. Every item is stored in the cells its rect overlaps, and the cells are
+// kept in a hash table, so the grid has no bounds. Queries only look at the items in the cells they
+// touch. Rects are half open, a point on the right or bottom edge is outside.
+
+// Size of a cell, in the units of the rects.
+#define SPATIAL_CELL_SIZE 64
+
+// The table starts with this many buckets and doubles when the entries average more than
+// SPATIAL_BUCKET_LOAD per bucket. It does not shrink.
+#define SPATIAL_MIN_BUCKETS 256
+#define SPATIAL_BUCKET_LOAD 4
+
+typedef void (*SPATIAL_QUERY_FN)(void *item, void *data);
+
+typedef struct SpatialEntry {
+	void *item;
+	Rect2Df rect;
+	int cx, cy; // Cell of the entry.
+} SpatialEntry;
+
+typedef struct SpatialBucket {
+	SpatialEntry *entries;
+	int count;
+	int capacity;
+} SpatialBucket;
+
+typedef struct SpatialGrid {
+	SpatialBucket *buckets;
+	int bucket_count; // Power of two.
+	int entries; // Entries in the buckets, an item has one per cell it overlaps.
+	int count; // Items in the grid.
+} SpatialGrid;
+
+SpatialGrid *engine_spatial_create();
+
+void engine_spatial_insert(SpatialGrid *grid, void *item, Rect2Df rect);
+
+// rect has to be the one the item was inserted with, and the item has to be in the grid.
+void engine_spatial_remove(SpatialGrid *grid, void *item, Rect2Df rect);
+
+// Both call fn once per item and return the count of items found.
+int engine_spatial_query_point(SpatialGrid *grid, float x, float y, SPATIAL_QUERY_FN fn, void *data);
+int engine_spatial_query_rect(SpatialGrid *grid, Rect2Df rect, SPATIAL_QUERY_FN fn, void *data);
+
+void engine_spatial_free(SpatialGrid *grid);
+
+#endif
@@ -2,12 +2,20 @@
 #include <GL/glew.h>
 #include <GL/glu.h>
 #include <cglm/cglm.h>
+#include <engine/camera.h>
 #include <engine/graphics/renderer.h>
 #include <engine/graphics/shader.h>
 #include <engine/logger.h>
+#include <engine/settings.h>
+#include <engine/tileops.h>
+#include <engine/world.h>
 #include <stdlib.h>
 
-static Shader shader;
+// Uploads closer than this in the VBO are merged into one, rewriting the clean tiles in between.
+#define UPLOAD_MERGE_GAP 16384
+
+static Shader meshShader;
+static Shader textureShader;
 
 static Color tileColors[] = {
 	{0, 0, 0, 255},
@@ -27,28 +35,42 @@ typedef struct Vertex {
 
 void on_free(Entity *entity) {
 	Tilemap *t = (Tilemap *)entity;
-	glDeleteVertexArrays(1, &t->vao);
-	glDeleteBuffers(1, &t->vbo);
-	for (int y = 0; y < t->h; y++) {
-		free(t->tiles[y]);
+	if (t->paths)
+		engine_tilemap_free_paths(t);
+	// Never rendered if it has no vao.
+	if (t->vao) {
+		glDeleteVertexArrays(1, &t->vao);
+		glDeleteBuffers(1, &t->vbo);
+		glDeleteTextures(1, &t->light_tex);
+	}
+	if (t->tex)
+		glDeleteTextures(1, &t->tex);
+	SDL_SIMDFree(t->tiles);
+	for (int i = 0; i < NUM_TILE_LAYERS; i++) {
+		SDL_SIMDFree(t->layers[i]);
 	}
-	free(t->tiles);
+	free(t->chunks);
+	free(t->draw_first);
+	free(t->draw_count);
+	free(t->dirty_chunks);
+	free(t->upload_buffer);
+	free(t->sim_chunks);
+	free(t->light);
+	free(t->light_chunks);
+	free(t->light_uploads);
+	SDL_SIMDFree(t->heat_next);
+	SDL_SIMDFree(t->heat_k);
+	if (t->source)
+		engine_world_source_free(t->source);
 	free(t);
 }
 
-void engine_tilemap_set(Tilemap *t, int x, int y, TileType type) {
-	if (x >= t->w || x < 0 || y >= t->h || y < 0)
-		return;
-
-	t->tiles[y][x].type = type;
-
-	Vertex vertices[6];
-
+static void tile_vertices(Tilemap *t, int x, int y, Vertex *vertices) {
 	int ox = x * t->tileSize;
 	int oy = y * t->tileSize;
 	int s = t->tileSize;
 
-	Color c = tileColors[type];
+	Color c = tileColors[t->tiles[y * t->w + x].type];
 
 	vertices[0] = (Vertex){ox, oy, c.r, c.g, c.b, c.a};
 	vertices[1] = (Vertex){ox + s, oy, c.r, c.g, c.b, c.a};
@@ -57,87 +79,530 @@ void engine_tilemap_set(Tilemap *t, int x, int y, TileType type) {
 	vertices[3] = (Vertex){ox + s, oy, c.r, c.g, c.b, c.a};
 	vertices[4] = (Vertex){ox + s, oy + s, c.r, c.g, c.b, c.a};
 	vertices[5] = (Vertex){ox, oy + s, c.r, c.g, c.b, c.a};
+}
 
-	glBindVertexArray(t->vao);
-	glBindBuffer(GL_ARRAY_BUFFER, t->vbo);
-	glBufferSubData(GL_ARRAY_BUFFER, (unsigned long)(t->w * y + x) * 6 * (2 * sizeof(GLfloat) + 4 * sizeof(GLfloat)), sizeof(vertices), vertices);
+TileChunk *engine_tilemap_get_chunk(Tilemap *t, int x, int y) {
+	if (x >= t->w || x < 0 || y >= t->h || y < 0)
+		return NULL;
+	return &t->chunks[(y / TILEMAP_CHUNK_SIZE) * t->chunks_w + x / TILEMAP_CHUNK_SIZE];
+}
+
+// Grows r to contain [x0, x1) x [y0, y1), an empty r (w is 0) becomes that area.
+static void rect_union(Rect2Di *r, int x0, int y0, int x1, int y1) {
+	if (r->w != 0) {
+		x0 = SDL_min(x0, r->x);
+		y0 = SDL_min(y0, r->y);
+		x1 = SDL_max(x1, r->x + r->w);
+		y1 = SDL_max(y1, r->y + r->h);
+	}
+	*r = (Rect2Di){x0, y0, x1 - x0, y1 - y0};
+}
+
+void engine_tilemap_wake(Tilemap *t, Rect2Di r) {
+	int x0 = SDL_max(0, r.x);
+	int y0 = SDL_max(0, r.y);
+	int x1 = SDL_min(t->w, r.x + r.w);
+	int y1 = SDL_min(t->h, r.y + r.h);
+
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	for (int cy = y0 / TILEMAP_CHUNK_SIZE; cy <= (y1 - 1) / TILEMAP_CHUNK_SIZE; cy++) {
+		for (int cx = x0 / TILEMAP_CHUNK_SIZE; cx <= (x1 - 1) / TILEMAP_CHUNK_SIZE; cx++) {
+			TileChunk *chunk = &t->chunks[cy * t->chunks_w + cx];
+			SDL_AtomicLock(&chunk->lock);
+			rect_union(&chunk->sim_next, SDL_max(x0, chunk->x), SDL_max(y0, chunk->y),
+					   SDL_min(x1, chunk->x + chunk->w), SDL_min(y1, chunk->y + chunk->h));
+			chunk->heat_awake = 1;
+			SDL_AtomicUnlock(&chunk->lock);
+		}
+	}
+}
+
+void engine_tilemap_mark_upload(Tilemap *t, Rect2Di r) {
+	int x0 = SDL_max(0, r.x);
+	int y0 = SDL_max(0, r.y);
+	int x1 = SDL_min(t->w, r.x + r.w);
+	int y1 = SDL_min(t->h, r.y + r.h);
+
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	for (int cy = y0 / TILEMAP_CHUNK_SIZE; cy <= (y1 - 1) / TILEMAP_CHUNK_SIZE; cy++) {
+		for (int cx = x0 / TILEMAP_CHUNK_SIZE; cx <= (x1 - 1) / TILEMAP_CHUNK_SIZE; cx++) {
+			int index = cy * t->chunks_w + cx;
+			TileChunk *chunk = &t->chunks[index];
+			SDL_AtomicLock(&chunk->lock);
+
+			if (chunk->dirty.w == 0) {
+				SDL_AtomicLock(&t->dirty_lock);
+				t->dirty_chunks[t->dirty_count++] = index;
+				SDL_AtomicUnlock(&t->dirty_lock);
+			}
+
+			rect_union(&chunk->dirty, SDL_max(x0, chunk->x), SDL_max(y0, chunk->y),
+					   SDL_min(x1, chunk->x + chunk->w), SDL_min(y1, chunk->y + chunk->h));
+			chunk->occupancy_dirty = 1;
+
+			if (t->light && chunk->light_dirty.w == 0) {
+				SDL_AtomicLock(&t->dirty_lock);
+				t->light_chunks[t->light_chunk_count++] = index;
+				SDL_AtomicUnlock(&t->dirty_lock);
+			}
+			if (t->light) {
+				rect_union(&chunk->light_dirty, SDL_max(x0, chunk->x), SDL_max(y0, chunk->y),
+						   SDL_min(x1, chunk->x + chunk->w), SDL_min(y1, chunk->y + chunk->h));
+			}
+
+			if (t->paths && !chunk->path_dirty) {
+				chunk->path_dirty = 1;
+				SDL_AtomicLock(&t->dirty_lock);
+				t->path_chunks[t->path_chunk_count++] = index;
+				SDL_AtomicUnlock(&t->dirty_lock);
+			}
+			SDL_AtomicUnlock(&chunk->lock);
+		}
+	}
+}
+
+void engine_tilemap_mark_dirty(Tilemap *t, Rect2Di r) {
+	engine_tilemap_mark_upload(t, r);
+
+	// The changed tiles and their neighbours have to be simulated again.
+	engine_tilemap_wake(t, (Rect2Di){r.x - 1, r.y - 1, r.w + 2, r.h + 2});
+}
+
+void engine_tilemap_load_rect(Tilemap *t, Rect2Di r) {
+	if (!t->source)
+		return;
+
+	int x0 = SDL_max(0, r.x);
+	int y0 = SDL_max(0, r.y);
+	int x1 = SDL_min(t->w, r.x + r.w);
+	int y1 = SDL_min(t->h, r.y + r.h);
+
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	for (int cy = y0 / TILEMAP_CHUNK_SIZE; cy <= (y1 - 1) / TILEMAP_CHUNK_SIZE; cy++) {
+		for (int cx = x0 / TILEMAP_CHUNK_SIZE; cx <= (x1 - 1) / TILEMAP_CHUNK_SIZE; cx++) {
+			TileChunk *chunk = &t->chunks[cy * t->chunks_w + cx];
+			// The last chunk frees the source.
+			if (chunk->pending && t->source)
+				engine_world_load_chunk(t, chunk);
+		}
+	}
+}
+
+void engine_tilemap_load_awake(Tilemap *t) {
+	int chunk_count = t->chunks_w * t->chunks_h;
+	int loaded = 1;
+
+	// Loaded chunks may be awake too, repeat until nothing else is loaded.
+	while (t->source && loaded) {
+		int pending = t->source->pending;
+
+		for (int i = 0; i < chunk_count; i++) {
+			TileChunk *chunk = &t->chunks[i];
+			if (chunk->sim_next.w != 0 || chunk->heat_awake)
+				engine_tilemap_load_rect(t, (Rect2Di){chunk->x - 1, chunk->y - 1, chunk->w + 2, chunk->h + 2});
+		}
+
+		loaded = t->source && t->source->pending != pending;
+	}
+}
+
+void engine_tilemap_set(Tilemap *t, int x, int y, TileType type) {
+	if (x >= t->w || x < 0 || y >= t->h || y < 0)
+		return;
+
+	engine_tilemap_load_rect(t, (Rect2Di){x, y, 1, 1});
+	t->tiles[y * t->w + x].type = type;
+	if (t->layers[TILE_LAYER_LIFETIME])
+		((uint8_t *)t->layers[TILE_LAYER_LIFETIME])[y * t->w + x] = 0;
+	engine_tilemap_mark_dirty(t, (Rect2Di){x, y, 1, 1});
 }
 
 void engine_tilemap_set_rect(Tilemap *t, Rect2Di r, TileType type) {
 	if (r.x + r.w <= t->w && r.y + r.h <= t->h && r.x >= 0 && r.y >= 0) {
+		// Chunks only partly covered keep the rest of their tiles.
+		engine_tilemap_load_rect(t, r);
 		for (int y = (int)r.y; y < r.y + r.h; y++) {
-			for (int x = (int)r.x; x < r.x + r.w; x++) {
-				engine_tilemap_set(t, x, y, type);
-			}
+			engine_tileops_fill(&t->tiles[y * t->w + r.x], r.w, type);
+			if (t->layers[TILE_LAYER_LIFETIME])
+				memset((uint8_t *)t->layers[TILE_LAYER_LIFETIME] + y * t->w + r.x, 0, r.w);
 		}
+		engine_tilemap_mark_dirty(t, r);
 	}
 }
 
 void engine_tilemap_set_rect_wall(Tilemap *t, Rect2Di r, TileType type) {
 	if (r.x + r.w <= t->w && r.y + r.h <= t->h && r.x >= 0 && r.y >= 0) {
-		for (int y = (int)r.y; y < r.y + r.h; y++) {
-			for (int x = (int)r.x; x < r.x + r.w; x++) {
-				if (x == r.x || x == r.x + r.w - 1 || y == r.y || y == r.y + r.h - 1)
-					engine_tilemap_set(t, x, y, type);
+		engine_tilemap_load_rect(t, r);
+		engine_tileops_fill(&t->tiles[r.y * t->w + r.x], r.w, type);
+		engine_tileops_fill(&t->tiles[(r.y + r.h - 1) * t->w + r.x], r.w, type);
+		for (int y = (int)r.y + 1; y < r.y + r.h - 1; y++) {
+			t->tiles[y * t->w + r.x].type = type;
+			t->tiles[y * t->w + r.x + r.w - 1].type = type;
+		}
+
+		uint8_t *lifetime = t->layers[TILE_LAYER_LIFETIME];
+		if (lifetime) {
+			memset(lifetime + r.y * t->w + r.x, 0, r.w);
+			memset(lifetime + (r.y + r.h - 1) * t->w + r.x, 0, r.w);
+			for (int y = (int)r.y + 1; y < r.y + r.h - 1; y++) {
+				lifetime[y * t->w + r.x] = 0;
+				lifetime[y * t->w + r.x + r.w - 1] = 0;
 			}
 		}
+
+		// Each side separately, so the inside is not uploaded.
+		engine_tilemap_mark_dirty(t, (Rect2Di){r.x, r.y, r.w, 1});
+		engine_tilemap_mark_dirty(t, (Rect2Di){r.x, r.y + r.h - 1, r.w, 1});
+		engine_tilemap_mark_dirty(t, (Rect2Di){r.x, r.y, 1, r.h});
+		engine_tilemap_mark_dirty(t, (Rect2Di){r.x + r.w - 1, r.y, 1, r.h});
+	}
+}
+
+static void *upload_buffer(Tilemap *t, size_t size) {
+	if (size > t->upload_buffer_size) {
+		t->upload_buffer = realloc(t->upload_buffer, size);
+		t->upload_buffer_size = size;
+	}
+	return t->upload_buffer;
+}
+
+// Range of local tile indices covering the dirty rect of a chunk, tiles are stored row by row.
+static void chunk_dirty_range(TileChunk *chunk, int *start, int *end) {
+	Rect2Di *d = &chunk->dirty;
+	*start = (d->y - chunk->y) * chunk->w + (d->x - chunk->x);
+	*end = (d->y + d->h - 1 - chunk->y) * chunk->w + (d->x + d->w - chunk->x);
+}
+
+// Uploads the dirty chunks [from, to] of the queue, they are consecutive in the VBO.
+static size_t flush_mesh(Tilemap *t, int from, int to) {
+	TileChunk *first = &t->chunks[t->dirty_chunks[from]];
+	TileChunk *last = &t->chunks[t->dirty_chunks[to]];
+	int start, end, unused;
+	chunk_dirty_range(first, &start, &unused);
+	chunk_dirty_range(last, &unused, &end);
+
+	int vertex_start = first->first + start * 6;
+	int vertex_end = last->first + end * 6;
+	size_t size = sizeof(Vertex) * (vertex_end - vertex_start);
+	Vertex *vertices = upload_buffer(t, size);
+
+	int n = 0;
+	for (int i = from; i <= to; i++) {
+		TileChunk *chunk = &t->chunks[t->dirty_chunks[i]];
+		int local_start = i == from ? start : 0;
+		int local_end = i == to ? end : chunk->w * chunk->h;
+
+		for (int l = local_start; l < local_end; l++) {
+			tile_vertices(t, chunk->x + l % chunk->w, chunk->y + l / chunk->w, &vertices[n]);
+			n += 6;
+		}
+	}
+
+	glBufferSubData(GL_ARRAY_BUFFER, (unsigned long)vertex_start * sizeof(Vertex), size, vertices);
+	return size;
+}
+
+// Uploads the bounding rect of the dirty chunks [from, to] of the queue.
+static size_t flush_texture(Tilemap *t, int from, int to) {
+	Rect2Di r = t->chunks[t->dirty_chunks[from]].dirty;
+	for (int i = from + 1; i <= to; i++) {
+		Rect2Di *d = &t->chunks[t->dirty_chunks[i]].dirty;
+		int x1 = SDL_max(r.x + r.w, d->x + d->w);
+		int y1 = SDL_max(r.y + r.h, d->y + d->h);
+		r.x = SDL_min(r.x, d->x);
+		r.y = SDL_min(r.y, d->y);
+		r.w = x1 - r.x;
+		r.h = y1 - r.y;
 	}
+
+	// The type layer is uploaded straight from the tiles, a row of the map is a row of the texture.
+	glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.w, r.h, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &t->tiles[r.y * t->w + r.x]);
+	return (size_t)r.w * r.h;
+}
+
+// Bytes needed to upload the chunk.
+static size_t chunk_upload_size(Tilemap *t, TileChunk *chunk) {
+	if (t->mode == TILEMAP_RENDER_TEXTURE)
+		return (size_t)chunk->dirty.w * chunk->dirty.h;
+
+	int start, end;
+	chunk_dirty_range(chunk, &start, &end);
+	return sizeof(Vertex) * 6 * (end - start);
+}
+
+// Whether the next chunk in the queue can be uploaded together with the previous one.
+static int can_merge(Tilemap *t, int prev_index, int index) {
+	if (index != prev_index + 1)
+		return 0;
+
+	TileChunk *prev = &t->chunks[prev_index];
+	TileChunk *chunk = &t->chunks[index];
+
+	if (t->mode == TILEMAP_RENDER_TEXTURE) {
+		// Same row of chunks and touching, otherwise the bounding rect grows too much.
+		return prev->y == chunk->y && prev->dirty.x + prev->dirty.w == chunk->x &&
+			   chunk->dirty.x == chunk->x && prev->dirty.y == chunk->dirty.y &&
+			   prev->dirty.h == chunk->dirty.h;
+	}
+
+	int prev_start, prev_end, start, end;
+	chunk_dirty_range(prev, &prev_start, &prev_end);
+	chunk_dirty_range(chunk, &start, &end);
+	int gap = (prev->w * prev->h - prev_end) + start;
+	return sizeof(Vertex) * 6 * gap <= UPLOAD_MERGE_GAP;
+}
+
+static int compare_index(const void *a, const void *b) {
+	return *(const int *)a - *(const int *)b;
+}
+
+static void create_mesh(Tilemap *t);
+static void create_texture(Tilemap *t);
+
+void engine_tilemap_flush(Tilemap *t) {
+	if (!t->vao) {
+		if (t->mode == TILEMAP_RENDER_TEXTURE)
+			create_texture(t);
+		else
+			create_mesh(t);
+		engine_tilemap_create_light_texture(t);
+	}
+
+	if (t->dirty_count == 0) {
+		engine_tilemap_flush_light(t);
+		return;
+	}
+
+	RenderStats *stats = engine_render_stats();
+	size_t budget = engine_settings_get_int("tilemap_upload_budget");
+	size_t uploaded = 0;
+
+	// In chunk order, chunks next to each other are next to each other in the VBO.
+	qsort(t->dirty_chunks, t->dirty_count, sizeof(int), compare_index);
+
+	if (t->mode == TILEMAP_RENDER_TEXTURE) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, t->w);
+		glBindTexture(GL_TEXTURE_2D, t->tex);
+	} else {
+		glBindVertexArray(t->vao);
+		glBindBuffer(GL_ARRAY_BUFFER, t->vbo);
+	}
+
+	int i = 0;
+	int kept = 0;
+	while (i < t->dirty_count) {
+		// Kept for the next frame if it would go over the budget. Always upload something, so edits
+		// bigger than the budget still make progress.
+		size_t size = chunk_upload_size(t, &t->chunks[t->dirty_chunks[i]]);
+		if (uploaded > 0 && uploaded + size > budget && t->chunks[t->dirty_chunks[i]].uploaded) {
+			t->dirty_chunks[kept++] = t->dirty_chunks[i++];
+			continue;
+		}
+
+		int last = i;
+
+		while (last + 1 < t->dirty_count && can_merge(t, t->dirty_chunks[last], t->dirty_chunks[last + 1])) {
+			size_t next = chunk_upload_size(t, &t->chunks[t->dirty_chunks[last + 1]]);
+			if (uploaded + size + next > budget)
+				break;
+			size += next;
+			last++;
+		}
+
+		if (t->mode == TILEMAP_RENDER_TEXTURE)
+			uploaded += flush_texture(t, i, last);
+		else
+			uploaded += flush_mesh(t, i, last);
+
+		for (int j = i; j <= last; j++) {
+			TileChunk *chunk = &t->chunks[t->dirty_chunks[j]];
+			chunk->dirty.w = 0;
+
+			// The light texture is empty until then.
+			if (!chunk->uploaded && !chunk->light_upload) {
+				chunk->light_upload = 1;
+				t->light_uploads[t->light_upload_count++] = t->dirty_chunks[j];
+			}
+			chunk->uploaded = 1;
+		}
+
+		stats->tilemap_uploads++;
+		i = last + 1;
+	}
+
+	if (t->mode == TILEMAP_RENDER_TEXTURE) {
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	} else {
+		glBindVertexArray(0);
+	}
+
+	// Keep what did not fit for the next frame.
+	t->dirty_count = kept;
+	stats->tilemap_upload_bytes += uploaded;
+
+	engine_tilemap_flush_light(t);
 }
 
 Tile *engine_tilemap_get(Tilemap *t, int x, int y) {
 	if (x >= t->w || x < 0 || y >= t->h || y < 0)
 		return NULL;
-	return &t->tiles[y][x];
+	engine_tilemap_load_rect(t, (Rect2Di){x, y, 1, 1});
+	return &t->tiles[y * t->w + x];
 }
 
-static void on_render(Entity *entity, double delta) {
-	Tilemap *t = (Tilemap *)entity;
-	engine_shader_use(shader);
-	glBindVertexArray(t->vao);
-	glDrawArrays(GL_TRIANGLES, 0, t->w * t->h * 6);
-	glBindVertexArray(0);
+static size_t layer_element_size(TileLayer layer) {
+	switch (layer) {
+	case TILE_LAYER_FLAGS:
+	case TILE_LAYER_LIFETIME:
+		return sizeof(uint8_t);
+	case TILE_LAYER_TEMPERATURE:
+		return sizeof(float);
+	default:
+		break;
+	}
+	return 0;
 }
 
-void engine_tilemap_get_tile_rect(Tilemap *t, int x, int y, Rect2Di *out) {
-	SDL_assert(out);
-	*out = (Rect2Di){x * t->tileSize, y * t->tileSize, t->tileSize, t->tileSize};
+void *engine_tilemap_layer(Tilemap *t, TileLayer layer) {
+	SDL_assert(layer < NUM_TILE_LAYERS);
+
+	if (!t->layers[layer]) {
+		size_t size = layer_element_size(layer) * t->w * t->h;
+		t->layers[layer] = SDL_SIMDAlloc(size);
+
+		if (layer == TILE_LAYER_TEMPERATURE) {
+			float *temperature = t->layers[layer];
+			for (int i = 0; i < t->w * t->h; i++)
+				temperature[i] = TILEMAP_AMBIENT_TEMPERATURE;
+		} else {
+			memset(t->layers[layer], 0, size);
+		}
+	}
+
+	return t->layers[layer];
 }
 
-Tilemap *engine_tilemap_create(int w, int h, int tile_size, TileType fill) {
-	Tilemap *t = malloc(sizeof(Tilemap));
-	memset(t, 0, sizeof(Tilemap));
+static void on_update(Entity *entity, double delta) {
+	Tilemap *t = (Tilemap *)entity;
 
-	t->w = w;
-	t->h = h;
-	t->tiles = malloc(sizeof(Tile *) * (unsigned long)h);
-	t->tileSize = tile_size;
-	t->entity.on_render = on_render;
-	t->entity.on_free = on_free;
+	// Fixed step, so the simulation speed does not depend on the frame rate.
+	t->sim_time += delta;
+	int steps = 0;
+	while (t->sim_time >= TILEMAP_SIM_STEP_MS && steps < TILEMAP_SIM_MAX_STEPS) {
+		engine_tilemap_simulate(t);
+		engine_tilemap_diffuse_heat(t);
+		t->sim_time -= TILEMAP_SIM_STEP_MS;
+		steps++;
+	}
 
-	Vertex *vertices = malloc(sizeof(Vertex) * w * h * 6);
+	if (steps == TILEMAP_SIM_MAX_STEPS)
+		t->sim_time = 0;
 
-	srand(2);
+	if (t->paths)
+		engine_tilemap_update_paths(t);
+}
 
-	int s = tile_size;
+static void render_mesh(Tilemap *t, int cx0, int cy0, int cx1, int cy1) {
 	int n = 0;
-	for (int y = 0; y < h; y++) {
-		t->tiles[y] = malloc(sizeof(Tile) * (unsigned long)w);
-		for (int x = 0; x < w; x++) {
-			int type = rand() % NUM_TILE_TYPES;
-			Color c = tileColors[type];
-			t->tiles[y][x].type = type; //fill;
-			int ox = x * s;
-			int oy = y * s;
-			vertices[n++] = (Vertex){ox, oy, c.r, c.g, c.b, c.a};
-			vertices[n++] = (Vertex){ox + s, oy, c.r, c.g, c.b, c.a};
-			vertices[n++] = (Vertex){ox, oy + s, c.r, c.g, c.b, c.a};
-
-			vertices[n++] = (Vertex){ox + s, oy, c.r, c.g, c.b, c.a};
-			vertices[n++] = (Vertex){ox + s, oy + s, c.r, c.g, c.b, c.a};
-			vertices[n++] = (Vertex){ox, oy + s, c.r, c.g, c.b, c.a};
+	for (int cy = cy0; cy <= cy1; cy++) {
+		for (int cx = cx0; cx <= cx1; cx++) {
+			TileChunk *chunk = &t->chunks[cy * t->chunks_w + cx];
+			t->draw_first[n] = chunk->first;
+			t->draw_count[n] = chunk->count;
+			n++;
 		}
 	}
 
+	engine_shader_use(meshShader);
+	engine_shader_set_vec2(meshShader, "mapSize", t->w * t->tileSize, t->h * t->tileSize);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, t->light_tex);
+	glBindVertexArray(t->vao);
+	glMultiDrawArrays(GL_TRIANGLES, t->draw_first, t->draw_count, n);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+static void render_texture(Tilemap *t, Rect2Df *view) {
+	// Draw one quad over the visible part of the map, the shader looks up each tile.
+	float x0 = SDL_max(0, view->x);
+	float y0 = SDL_max(0, view->y);
+	float x1 = SDL_min(t->w * t->tileSize, view->x + view->w);
+	float y1 = SDL_min(t->h * t->tileSize, view->y + view->h);
+
+	engine_shader_use(textureShader);
+	engine_shader_set_vec4(textureShader, "area", x0, y0, x1 - x0, y1 - y0);
+	engine_shader_set_float(textureShader, "tileSize", t->tileSize);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, t->light_tex);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, t->tex);
+	glBindVertexArray(t->vao);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+static void on_render(Entity *entity, double delta) {
+	Tilemap *t = (Tilemap *)entity;
+	RenderStats *stats = engine_render_stats();
+
+	// Only draw the chunks intersecting the view.
+	Rect2Df view;
+	camera_view_rect(camera_get_active(), &view);
+
+	float chunk_px = (float)TILEMAP_CHUNK_SIZE * t->tileSize;
+	int cx0 = SDL_max(0, (int)floorf(view.x / chunk_px));
+	int cy0 = SDL_max(0, (int)floorf(view.y / chunk_px));
+	int cx1 = SDL_min(t->chunks_w - 1, (int)floorf((view.x + view.w) / chunk_px));
+	int cy1 = SDL_min(t->chunks_h - 1, (int)floorf((view.y + view.h) / chunk_px));
+
+	// Visible chunks of a lazily loaded world are decompressed before uploading.
+	if (cx0 <= cx1 && cy0 <= cy1) {
+		engine_tilemap_load_rect(t, (Rect2Di){cx0 * TILEMAP_CHUNK_SIZE, cy0 * TILEMAP_CHUNK_SIZE,
+											  (cx1 - cx0 + 1) * TILEMAP_CHUNK_SIZE, (cy1 - cy0 + 1) * TILEMAP_CHUNK_SIZE});
+	}
+
+	engine_tilemap_update_light(t);
+	engine_tilemap_flush(t);
+
+	stats->tilemap_chunks_total += t->chunks_w * t->chunks_h;
+
+	if (cx0 > cx1 || cy0 > cy1)
+		return;
+
+	stats->tilemap_chunks_visible += (cx1 - cx0 + 1) * (cy1 - cy0 + 1);
+
+	if (t->mode == TILEMAP_RENDER_TEXTURE)
+		render_texture(t, &view);
+	else
+		render_mesh(t, cx0, cy0, cx1, cy1);
+
+	stats->draw_calls++;
+}
+
+void engine_tilemap_get_tile_rect(Tilemap *t, int x, int y, Rect2Di *out) {
+	SDL_assert(out);
+	*out = (Rect2Di){x * t->tileSize, y * t->tileSize, t->tileSize, t->tileSize};
+}
+
+// The vertices of each chunk are written by its first upload.
+static void create_mesh(Tilemap *t) {
 	glGenVertexArrays(1, &t->vao);
 	glGenBuffers(1, &t->vbo);
 
@@ -145,8 +610,7 @@ Tilemap *engine_tilemap_create(int w, int h, int tile_size, TileType fill) {
 
 	glBindBuffer(GL_ARRAY_BUFFER, t->vbo);
 
-	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * w * h * 6, vertices, GL_DYNAMIC_DRAW);
-	free(vertices);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * t->w * t->h * 6, NULL, GL_DYNAMIC_DRAW);
 
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat) + 4 * sizeof(GLfloat), 0);
 	glEnableVertexAttribArray(0);
@@ -155,13 +619,143 @@ Tilemap *engine_tilemap_create(int w, int h, int tile_size, TileType fill) {
 
 	glBindVertexArray(0);
 
-	if (!shader) {
-		shader = engine_shader_load("resources/shaders/tilemap.vert", "resources/shaders/tilemap.frag", NULL);
-		engine_shader_use(shader);
+	if (!meshShader) {
+		meshShader = engine_shader_load("resources/shaders/tilemap.vert", "resources/shaders/tilemap.frag", NULL);
+		engine_shader_use(meshShader);
+		mat4 proj;
+		engine_render_projection(proj);
+		engine_shader_set_mat4(meshShader, "projection", proj);
+		mat4 view;
+		glm_mat4_identity(view);
+		engine_shader_set_mat4(meshShader, "view", view);
+		engine_shader_set_int(meshShader, "light", 1);
+		engine_shader_set_float(meshShader, "lightScale", 255.f / TILEMAP_LIGHT_MAX);
+		engine_shader_set_float(meshShader, "ambient", TILEMAP_LIGHT_AMBIENT);
+	}
+}
+
+// Same, the tiles of each chunk are written by its first upload.
+static void create_texture(Tilemap *t) {
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glGenTextures(1, &t->tex);
+	glBindTexture(GL_TEXTURE_2D, t->tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, t->w, t->h, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	// Unit quad, scaled to the visible area in the vertex shader.
+	GLfloat vertices[] = {0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 0, 1};
+
+	glGenVertexArrays(1, &t->vao);
+	glGenBuffers(1, &t->vbo);
+
+	glBindVertexArray(t->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, t->vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), 0);
+	glEnableVertexAttribArray(0);
+
+	glBindVertexArray(0);
+
+	if (!textureShader) {
+		textureShader = engine_shader_load("resources/shaders/tilemap_texture.vert", "resources/shaders/tilemap_texture.frag", NULL);
+		engine_shader_use(textureShader);
 		mat4 proj;
 		engine_render_projection(proj);
-		engine_shader_set_mat4(shader, "projection", proj);
+		engine_shader_set_mat4(textureShader, "projection", proj);
+		mat4 view;
+		glm_mat4_identity(view);
+		engine_shader_set_mat4(textureShader, "view", view);
+		engine_shader_set_int(textureShader, "tiles", 0);
+		engine_shader_set_int(textureShader, "light", 1);
+		engine_shader_set_float(textureShader, "lightScale", 255.f / TILEMAP_LIGHT_MAX);
+		engine_shader_set_float(textureShader, "ambient", TILEMAP_LIGHT_AMBIENT);
+
+		GLfloat palette[NUM_TILE_TYPES * 4];
+		for (int i = 0; i < NUM_TILE_TYPES; i++) {
+			palette[i * 4] = tileColors[i].r / 255.f;
+			palette[i * 4 + 1] = tileColors[i].g / 255.f;
+			palette[i * 4 + 2] = tileColors[i].b / 255.f;
+			palette[i * 4 + 3] = tileColors[i].a / 255.f;
+		}
+		glUniform4fv(glGetUniformLocation(textureShader, "palette"), NUM_TILE_TYPES, palette);
+	}
+}
+
+Tilemap *engine_tilemap_create(int w, int h, int tile_size, TileType fill) {
+	return engine_tilemap_create_mode(w, h, tile_size, fill, TILEMAP_RENDER_MESH);
+}
+
+Tilemap *engine_tilemap_create_mode(int w, int h, int tile_size, TileType fill, TilemapRenderMode mode) {
+	Tile *tiles = SDL_SIMDAlloc(sizeof(Tile) * (unsigned long)w * h);
+	engine_tileops_fill(tiles, (size_t)w * h, fill);
+	return engine_tilemap_create_tiles(w, h, tile_size, mode, tiles);
+}
+
+static Tilemap *create(int w, int h, int tile_size, TilemapRenderMode mode, Tile *tiles, int pending) {
+	Tilemap *t = malloc(sizeof(Tilemap));
+	memset(t, 0, sizeof(Tilemap));
+
+	t->w = w;
+	t->h = h;
+	t->tiles = tiles;
+	t->tileSize = tile_size;
+	t->mode = mode;
+	t->entity.on_update = on_update;
+	t->entity.on_render = on_render;
+	t->entity.on_free = on_free;
+
+	t->chunks_w = (w + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+	t->chunks_h = (h + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+	int chunk_count = t->chunks_w * t->chunks_h;
+	t->chunks = malloc(sizeof(TileChunk) * chunk_count);
+	t->draw_first = malloc(sizeof(int) * chunk_count);
+	t->draw_count = malloc(sizeof(int) * chunk_count);
+	t->dirty_chunks = malloc(sizeof(int) * chunk_count);
+	t->sim_chunks = malloc(sizeof(int) * chunk_count);
+
+	int first = 0;
+	for (int cy = 0; cy < t->chunks_h; cy++) {
+		for (int cx = 0; cx < t->chunks_w; cx++) {
+			TileChunk *chunk = &t->chunks[cy * t->chunks_w + cx];
+			memset(chunk, 0, sizeof(TileChunk));
+			chunk->x = cx * TILEMAP_CHUNK_SIZE;
+			chunk->y = cy * TILEMAP_CHUNK_SIZE;
+			chunk->w = SDL_min(TILEMAP_CHUNK_SIZE, w - chunk->x);
+			chunk->h = SDL_min(TILEMAP_CHUNK_SIZE, h - chunk->y);
+			chunk->first = first;
+			chunk->count = chunk->w * chunk->h * 6;
+			chunk->occupancy_dirty = 1;
+			first += chunk->count;
+
+			// Nothing is simulated in a pending chunk, it is woken up when loaded.
+			chunk->pending = pending;
+			if (!pending) {
+				chunk->sim_next = (Rect2Di){chunk->x, chunk->y, chunk->w, chunk->h};
+				chunk->heat_awake = 1;
+			}
+		}
 	}
 
+	// Uploaded by the first flush, the pending chunks once loaded.
+	if (!pending)
+		engine_tilemap_mark_upload(t, (Rect2Di){0, 0, w, h});
+
+	engine_tilemap_init_light(t);
+	engine_tilemap_heat_hook(t, TILE_COAL, TILEMAP_COAL_IGNITION, engine_tilemap_ignite, NULL);
+
 	return t;
 }
+
+Tilemap *engine_tilemap_create_tiles(int w, int h, int tile_size, TilemapRenderMode mode, Tile *tiles) {
+	return create(w, h, tile_size, mode, tiles, 0);
+}
+
+Tilemap *engine_tilemap_create_pending(int w, int h, int tile_size, TilemapRenderMode mode, Tile *tiles) {
+	return create(w, h, tile_size, mode, tiles, 1);
+}
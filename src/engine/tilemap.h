@@ -2,7 +2,28 @@
 #define ENGINE_TILEMAP_H
 
 #include <engine/entity.h>
+#include <SDL_atomic.h>
 #include <engine/math/rect.h>
+#include <engine/jobs.h>
+#include <stdint.h>
+
+// Width and height of a chunk in tiles.
+#define TILEMAP_CHUNK_SIZE 32
+
+// The tile simulation runs at a fixed step, in ms.
+#define TILEMAP_SIM_STEP_MS (1000.0 / 60.0)
+#define TILEMAP_SIM_MAX_STEPS 4
+
+// Temperature of new tiles, air and water are pulled back to it.
+#define TILEMAP_AMBIENT_TEMPERATURE 20.0f
+// Coal turns into fire above this temperature.
+#define TILEMAP_COAL_IGNITION 300.0f
+#define TILEMAP_MAX_HEAT_HOOKS 8
+
+// Light level of lava, every tile the light goes through takes at least one level away.
+#define TILEMAP_LIGHT_MAX 15
+// Brightness of the tiles without light, from 0 to 1.
+#define TILEMAP_LIGHT_AMBIENT 0.3f
 
 typedef enum TileType {
 	TILE_AIR,
@@ -15,25 +36,291 @@ typedef enum TileType {
 	NUM_TILE_TYPES
 } TileType;
 
+// One byte per tile, the type layer of the tilemap is a contiguous array of them.
 typedef struct Tile {
-	TileType type;
+	uint8_t type; // TileType
 } Tile;
 
+// Optional per-tile data, stored as separate arrays with the same layout as the tiles.
+typedef enum TileLayer {
+	TILE_LAYER_FLAGS, // uint8_t, TileFlags
+	TILE_LAYER_LIFETIME, // uint8_t
+	TILE_LAYER_TEMPERATURE, // float
+	NUM_TILE_LAYERS
+} TileLayer;
+
+typedef enum TilemapRenderMode {
+	TILEMAP_RENDER_MESH, // Two triangles per tile, culled per chunk.
+	TILEMAP_RENDER_TEXTURE, // One byte per tile in a R8UI texture, drawn as a single quad.
+} TilemapRenderMode;
+
+typedef enum TileFlags {
+	TILE_FLAG_MOVED = 1 << 0, // Already simulated in the current step.
+} TileFlags;
+
+typedef struct TilemapSimStats {
+	unsigned long steps;
+	int threads;
+	unsigned int active_chunks; // In the last step.
+	unsigned long cells_updated; // In the last step.
+	double step_ms; // Time spent in the last step.
+	double cells_per_second; // Throughput of the last step.
+} TilemapSimStats;
+
+typedef struct TilemapHeatStats {
+	unsigned long steps;
+	unsigned int active_chunks; // In the last step, the others are at equilibrium.
+	unsigned long cells_updated; // In the last step.
+	double step_ms; // Time spent in the last step.
+	double cells_per_second; // Throughput of the last step.
+} TilemapHeatStats;
+
+typedef struct TilemapLightStats {
+	unsigned long updates;
+	unsigned int chunks_changed; // Chunks with changed tiles in the last update.
+	unsigned long tiles_visited; // By the flood fills of the last update.
+	double update_ms; // Time spent in the last update.
+} TilemapLightStats;
+
+typedef struct TilemapRayStats {
+	unsigned long rays; // In the last batch.
+	double batch_ms; // Time spent in the last batch.
+	double rays_per_second; // Throughput of the last batch.
+} TilemapRayStats;
+
+// Tiles the collision queries look for.
+typedef enum TileQuery {
+	TILE_QUERY_SOLID, // Rock, sand and coal, what boxes collide with.
+	TILE_QUERY_NOT_AIR,
+	NUM_TILE_QUERIES
+} TileQuery;
+
+typedef struct TileRay {
+	float x, y; // Origin, in pixels like the tile rects.
+	float dx, dy; // Direction, does not need to be normalized.
+	float max_distance; // In pixels.
+} TileRay;
+
+typedef struct TileRayHit {
+	int hit; // 0 if nothing was hit within the distance, the other fields are not set then.
+	int x, y; // Tile hit.
+	float distance; // From the origin to the hit, in pixels.
+	int normal_x, normal_y; // Side of the tile that was hit, 0 if the ray started inside it.
+} TileRayHit;
+
+typedef struct TilemapPathStats {
+	unsigned long requests; // In the last batch.
+	unsigned long nodes_expanded; // Entrances expanded by the searches of the last batch.
+	double batch_ms; // Time the worker spent on the last batch.
+	unsigned int clusters_rebuilt; // In the last update.
+	double rebuild_ms; // Time spent rebuilding them.
+} TilemapPathStats;
+
+// Path from the start to the goal, both included.
+typedef struct TilePath {
+	int found; // 0 if the goal can't be reached, the path is empty then.
+	int *points; // x, y of each tile in order, count pairs.
+	int count;
+} TilePath;
+
+struct Tilemap;
+
+// Called for a tile above the threshold of the hook, after a heat step.
+typedef void (*TILEMAP_HEAT_FN)(struct Tilemap *t, int x, int y, float temperature, void *data);
+
+// Called from the tilemap update with the result of a request. The points are freed after it returns.
+typedef void (*TILEMAP_PATH_FN)(struct Tilemap *t, int id, const TilePath *path, void *data);
+
+typedef struct TileHeatHook {
+	TileType type;
+	float threshold;
+	TILEMAP_HEAT_FN fn;
+	void *data;
+} TileHeatHook;
+
+// A square block of tiles, its vertices are contiguous in the tilemap VBO.
+typedef struct TileChunk {
+	int x, y; // In tiles.
+	int w, h; // Chunks on the right and bottom edges may be smaller.
+	int first; // First vertex.
+	int count; // Vertex count.
+	Rect2Di dirty; // Tiles not uploaded to the GPU yet, empty if w is 0.
+	Rect2Di sim; // Tiles simulated in the current step, settled tiles are left out.
+	Rect2Di sim_next; // Tiles to simulate in the next step.
+	unsigned int sim_cells; // Cells visited in the last step.
+	int heat_awake; // Temperatures may change, diffused in the next heat step.
+	float heat_change; // Biggest temperature change in the last heat step.
+	int pending; // Still compressed in a mapped world file, see engine_tilemap_load_rect.
+	int uploaded; // The GPU has its tiles and light, written by the first flush after it is loaded.
+	uint32_t occupancy[NUM_TILE_QUERIES][TILEMAP_CHUNK_SIZE]; // Bit per tile matching the query, row by row.
+	int occupied[NUM_TILE_QUERIES]; // Bits set, 0 lets the queries skip the chunk.
+	int occupancy_dirty; // Tiles changed since the bits were built, rebuilt by the next query.
+	Rect2Di light_dirty; // Tiles changed since the last light update, empty if w is 0.
+	int light_upload; // The light changed and is not uploaded yet.
+	int path_dirty; // Tiles changed since the path cluster of the chunk was built.
+	SDL_SpinLock lock; // Guards the rects, the simulation writes to the chunks around too.
+} TileChunk;
+
 typedef struct Tilemap {
 	Entity entity;
-	Tile **tiles;
+	Tile *tiles; // Row by row, index with y * w + x.
+	void *layers[NUM_TILE_LAYERS]; // NULL until requested.
 	int w, h;
 	int tileSize;
+	TilemapRenderMode mode;
+	TileChunk *chunks;
+	int chunks_w, chunks_h;
+	int *draw_first; // Scratch for the visible chunks ranges.
+	int *draw_count;
+	int *dirty_chunks; // Indices of the chunks with a pending upload.
+	int dirty_count;
+	SDL_SpinLock dirty_lock;
+	unsigned char *upload_buffer;
+	size_t upload_buffer_size;
 	unsigned int vao, vbo;
+	unsigned int tex; // Tile types, only with TILEMAP_RENDER_TEXTURE.
+	double sim_time; // Not simulated yet, in ms.
+	unsigned int sim_tick;
+	int *sim_chunks; // Scratch for the awake chunks of a phase.
+	TilemapSimStats sim_stats;
+	float *heat_next; // Temperatures of the step being computed.
+	float *heat_k; // Conductivity of each tile.
+	TileHeatHook heat_hooks[TILEMAP_MAX_HEAT_HOOKS];
+	int heat_hook_count;
+	TilemapHeatStats heat_stats;
+	TilemapRayStats ray_stats;
+	uint8_t *light; // Light level of each tile, up to TILEMAP_LIGHT_MAX.
+	unsigned int light_tex; // R8 texture of the light levels, sampled by the tilemap shaders.
+	int *light_chunks; // Indices of the chunks with a light_dirty rect.
+	int light_chunk_count;
+	int *light_uploads; // Indices of the chunks with a light_upload.
+	int light_upload_count;
+	TilemapLightStats light_stats;
+	struct TilemapPaths *paths; // NULL until the first path request.
+	int *path_chunks; // Indices of the chunks with path_dirty set.
+	int path_chunk_count;
+	TilemapPathStats path_stats;
+	struct WorldSource *source; // World file of the pending chunks, NULL once all are loaded.
 } Tilemap;
 
 Tilemap *engine_tilemap_create(int w, int h, int tile_size, TileType fill);
+Tilemap *engine_tilemap_create_mode(int w, int h, int tile_size, TileType fill, TilemapRenderMode mode);
 
+// Used internally, creates the tilemap around tiles already written, allocated with SDL_SIMDAlloc.
+Tilemap *engine_tilemap_create_tiles(int w, int h, int tile_size, TilemapRenderMode mode, Tile *tiles);
+
+// Used internally, same but every chunk is pending, to be loaded from t->source. Nothing is built for
+// a chunk, on the CPU or the GPU, until it is loaded.
+Tilemap *engine_tilemap_create_pending(int w, int h, int tile_size, TilemapRenderMode mode, Tile *tiles);
+
+// Tile writes only touch the CPU side, the GPU is updated once per frame before rendering
+// within the "tilemap_upload_budget" setting (bytes per frame).
 void engine_tilemap_set(Tilemap *t, int x, int y, TileType type);
 
 void engine_tilemap_set_rect(Tilemap *t, Rect2Di r, TileType type);
 void engine_tilemap_set_rect_wall(Tilemap *t, Rect2Di r, TileType type);
 Tile *engine_tilemap_get(Tilemap *t, int x, int y);
+
+// Returns the layer array, allocating it zeroed the first time. Temperatures start at
+// TILEMAP_AMBIENT_TEMPERATURE instead.
+void *engine_tilemap_layer(Tilemap *t, TileLayer layer);
 void engine_tilemap_get_tile_rect(Tilemap *t, int x, int y, Rect2Di *out);
 
+// Returns the chunk containing the tile, NULL if out of bounds.
+TileChunk *engine_tilemap_get_chunk(Tilemap *t, int x, int y);
+
+// Marks the tiles to be uploaded again, needed after writing tiles returned by engine_tilemap_get.
+void engine_tilemap_mark_dirty(Tilemap *t, Rect2Di r);
+
+// Used internally, like engine_tilemap_mark_dirty without waking the tiles up.
+void engine_tilemap_mark_upload(Tilemap *t, Rect2Di r);
+
+// Decompresses the pending chunks in the rect, for tilemaps loaded lazily from a world file.
+// The tilemap functions already do it, only needed before using the layers or tiles directly.
+void engine_tilemap_load_rect(Tilemap *t, Rect2Di r);
+
+// Used internally, loads the awake chunks and the ones around, the simulation reads them.
+void engine_tilemap_load_awake(Tilemap *t);
+
+// Wakes the tiles up, so they are simulated and their chunks diffused in the next step.
+void engine_tilemap_wake(Tilemap *t, Rect2Di r);
+
+// Runs a step of the falling sand simulation on the awake tiles. Called from the tilemap update.
+// Chunks are simulated in parallel in four phases, like a checkerboard, so two chunks next to
+// each other never run at the same time. The result does not depend on the thread count.
+void engine_tilemap_simulate(Tilemap *t);
+
+// Runs a step of heat diffusion over the temperature layer. Called from the tilemap update after
+// the simulation. Lava and fire heat up, water cools down, and heat flows between neighbours
+// depending on their conductivity. Chunks at equilibrium are skipped until woken up.
+void engine_tilemap_diffuse_heat(Tilemap *t);
+
+// Calls fn after each heat step for every tile of the type above the threshold.
+// Returns 0 if there is no room for more hooks.
+int engine_tilemap_heat_hook(Tilemap *t, TileType type, float threshold, TILEMAP_HEAT_FN fn, void *data);
+
+// Used internally, updates the conductivities of a chunk whose tiles were replaced without waking it.
+void engine_tilemap_heat_update_chunk(Tilemap *t, TileChunk *chunk);
+
+// Heat hook turning the tile into fire, used for coal by default.
+void engine_tilemap_ignite(Tilemap *t, int x, int y, float temperature, void *data);
+
+// Lava and fire light up the tiles around, the light spreads as a flood fill losing levels in each
+// tile depending on the material. After the first fill only the tiles around the changed ones are
+// lit again: the light they spread is removed and filled again from the emitters and the light
+// around. Called before rendering, the chunks whose light changed are uploaded with the tiles.
+void engine_tilemap_update_light(Tilemap *t);
+
+// Used internally, lights the loaded chunks. The pending ones are lit when loaded.
+void engine_tilemap_init_light(Tilemap *t);
+
+// Used internally, creates the light texture empty, each chunk uploads its light with its first tiles.
+void engine_tilemap_create_light_texture(Tilemap *t);
+
+// Used internally, uploads the light of the changed chunks.
+void engine_tilemap_flush_light(Tilemap *t);
+
+// Collision queries, in pixels like engine_tilemap_get_tile_rect. Tiles outside of the map are empty.
+// They use a bitmask per chunk of the tiles matching the query, rebuilt when the tiles change, to
+// skip empty chunks and test whole rows at once.
+
+// Returns 1 if a tile matching the query overlaps the box.
+int engine_tilemap_overlaps(Tilemap *t, Rect2Df box, TileQuery query);
+
+// Moves the box by dx, dy and returns the fraction of the move done before it hits a tile, 1 if it
+// hits nothing, 0 if it already overlaps one. The normal of the side hit is written if not NULL.
+float engine_tilemap_sweep(Tilemap *t, Rect2Df box, float dx, float dy, TileQuery query, int *normal_x, int *normal_y);
+
+// Walks the tiles along the ray and finds the first one matching the query. Returns hit->hit.
+int engine_tilemap_raycast(Tilemap *t, TileRay ray, TileQuery query, TileRayHit *hit);
+
+// Casts the rays across the job threads, the throughput is in t->ray_stats.
+void engine_tilemap_raycast_batch(Tilemap *t, const TileRay *rays, TileRayHit *hits, int count, TileQuery query);
+
+// Used internally, returns the bits of the chunk, loading the chunk and rebuilding them if needed.
+const uint32_t *engine_tilemap_occupancy(Tilemap *t, TileChunk *chunk, TileQuery query);
+
+// Hierarchical pathfinding over the tiles not matching TILE_QUERY_SOLID, moving in four directions.
+// Each chunk is a cluster with entrances where its walkable borders meet the chunks around, and the
+// distances between the entrances of a cluster are precomputed. A search runs over the entrances,
+// then the path is refined tile by tile only inside the clusters it crosses. Paths are close to the
+// shortest, not always the shortest. In a world loaded lazily the pending chunks are solid until
+// they are loaded, the chunks of the start and the goal are loaded by the request.
+//
+// Requests are searched in batches by a job. A batch is started by the tilemap update
+// and its results are delivered to fn by the next one, after the clusters whose tiles changed are
+// rebuilt. Returns the id passed to fn.
+int engine_tilemap_find_path(Tilemap *t, int x0, int y0, int x1, int y1, TILEMAP_PATH_FN fn, void *data);
+
+// Used internally, delivers the finished batch, rebuilds the changed clusters and starts the next batch.
+void engine_tilemap_update_paths(Tilemap *t);
+
+// Used internally, waits for the batch being searched.
+void engine_tilemap_free_paths(Tilemap *t);
+
+// Uploads the pending tile changes. Called before rendering, within the upload budget. The first
+// call creates the GPU side, so creating a tilemap needs no GL context. Chunks never uploaded go
+// over the budget, they have nothing on the GPU yet.
+void engine_tilemap_flush(Tilemap *t);
+
 #endif
@@ -0,0 +1,376 @@
+#include "tilemap.h"
+#include <SDL.h>
+#include <math.h>
+#include <string.h>
+
+#if TILEMAP_CHUNK_SIZE > 32
+#error The occupancy of a chunk row is stored in 32 bits
+#endif
+
+#define RAYS_PER_JOB 256
+
+// Bit per TileType.
+static const unsigned int query_types[NUM_TILE_QUERIES] = {
+	[TILE_QUERY_SOLID] = 1u << TILE_ROCK | 1u << TILE_SAND | 1u << TILE_COAL,
+	[TILE_QUERY_NOT_AIR] = ~(1u << TILE_AIR),
+};
+
+static int lowest_bit(uint32_t bits) {
+#if defined(__GNUC__)
+	return __builtin_ctz(bits);
+#else
+	int i = 0;
+	while (!(bits & 1)) {
+		bits >>= 1;
+		i++;
+	}
+	return i;
+#endif
+}
+
+static int clamp(int v, int min, int max) {
+	return v < min ? min : v > max ? max : v;
+}
+
+// Bits a to b of a row, inclusive.
+static uint32_t row_mask(int a, int b) {
+	uint32_t mask = b - a + 1 == 32 ? ~0u : (1u << (b - a + 1)) - 1;
+	return mask << a;
+}
+
+// Loads the chunk if pending, and rebuilds the bits if the tiles changed.
+static void update_occupancy(Tilemap *t, TileChunk *chunk) {
+	if (chunk->pending)
+		engine_tilemap_load_rect(t, (Rect2Di){chunk->x, chunk->y, chunk->w, chunk->h});
+
+	if (!chunk->occupancy_dirty)
+		return;
+
+	for (int q = 0; q < NUM_TILE_QUERIES; q++) {
+		int occupied = 0;
+
+		for (int y = 0; y < chunk->h; y++) {
+			const Tile *row = t->tiles + (chunk->y + y) * t->w + chunk->x;
+			uint32_t bits = 0;
+			for (int x = 0; x < chunk->w; x++) {
+				if (query_types[q] & (1u << row[x].type)) {
+					bits |= 1u << x;
+					occupied++;
+				}
+			}
+			chunk->occupancy[q][y] = bits;
+		}
+
+		for (int y = chunk->h; y < TILEMAP_CHUNK_SIZE; y++)
+			chunk->occupancy[q][y] = 0;
+		chunk->occupied[q] = occupied;
+	}
+
+	chunk->occupancy_dirty = 0;
+}
+
+const uint32_t *engine_tilemap_occupancy(Tilemap *t, TileChunk *chunk, TileQuery query) {
+	update_occupancy(t, chunk);
+	return chunk->occupancy[query];
+}
+
+// Tiles overlapped by the box, clipped to the map. Returns 0 if there are none.
+static int tile_range(Tilemap *t, Rect2Df box, Rect2Di *out) {
+	float size = t->tileSize;
+	// Clamped as floats first, far away boxes don't fit in an int.
+	int x0 = (int)floorf(SDL_max(0, box.x / size));
+	int y0 = (int)floorf(SDL_max(0, box.y / size));
+	int x1 = (int)ceilf(SDL_min(t->w, (box.x + box.w) / size));
+	int y1 = (int)ceilf(SDL_min(t->h, (box.y + box.h) / size));
+
+	*out = (Rect2Di){x0, y0, x1 - x0, y1 - y0};
+	return x0 < x1 && y0 < y1;
+}
+
+// Calls fn for every tile matching the query in r, stops when it returns 0.
+typedef int (*TILE_VISIT_FN)(Tilemap *t, int x, int y, void *data);
+
+static void visit_tiles(Tilemap *t, Rect2Di r, TileQuery query, TILE_VISIT_FN fn, void *data) {
+	for (int cy = r.y / TILEMAP_CHUNK_SIZE; cy <= (r.y + r.h - 1) / TILEMAP_CHUNK_SIZE; cy++) {
+		for (int cx = r.x / TILEMAP_CHUNK_SIZE; cx <= (r.x + r.w - 1) / TILEMAP_CHUNK_SIZE; cx++) {
+			TileChunk *chunk = &t->chunks[cy * t->chunks_w + cx];
+			update_occupancy(t, chunk);
+			if (!chunk->occupied[query])
+				continue;
+
+			int x0 = SDL_max(r.x, chunk->x) - chunk->x;
+			int x1 = SDL_min(r.x + r.w, chunk->x + chunk->w) - chunk->x;
+			int y0 = SDL_max(r.y, chunk->y) - chunk->y;
+			int y1 = SDL_min(r.y + r.h, chunk->y + chunk->h) - chunk->y;
+			uint32_t mask = row_mask(x0, x1 - 1);
+
+			for (int y = y0; y < y1; y++) {
+				uint32_t bits = chunk->occupancy[query][y] & mask;
+				while (bits) {
+					if (!fn(t, chunk->x + lowest_bit(bits), chunk->y + y, data))
+						return;
+					bits &= bits - 1;
+				}
+			}
+		}
+	}
+}
+
+static int found_tile(Tilemap *t, int x, int y, void *data) {
+	*(int *)data = 1;
+	return 0;
+}
+
+int engine_tilemap_overlaps(Tilemap *t, Rect2Df box, TileQuery query) {
+	Rect2Di r;
+	int found = 0;
+
+	if (tile_range(t, box, &r))
+		visit_tiles(t, r, query, found_tile, &found);
+
+	return found;
+}
+
+typedef struct Sweep {
+	Rect2Df box;
+	float dx, dy;
+	float toi;
+	int normal_x, normal_y;
+} Sweep;
+
+// Times along the move where the box starts and stops overlapping the tile on one axis.
+static int axis_times(float pos, float size, float tile, float tile_size, float d, float *entry, float *exit) {
+	if (d > 0) {
+		*entry = (tile - (pos + size)) / d;
+		*exit = (tile + tile_size - pos) / d;
+	} else if (d < 0) {
+		*entry = (tile + tile_size - pos) / d;
+		*exit = (tile - (pos + size)) / d;
+	} else {
+		// Not moving on this axis, it overlaps all the time or never.
+		*entry = -INFINITY;
+		*exit = INFINITY;
+		return pos < tile + tile_size && tile < pos + size;
+	}
+	return 1;
+}
+
+static int sweep_tile(Tilemap *t, int x, int y, void *data) {
+	Sweep *s = data;
+	float size = t->tileSize;
+	float x_entry, x_exit, y_entry, y_exit;
+
+	if (!axis_times(s->box.x, s->box.w, x * size, size, s->dx, &x_entry, &x_exit) ||
+		!axis_times(s->box.y, s->box.h, y * size, size, s->dy, &y_entry, &y_exit))
+		return 1;
+
+	float entry = SDL_max(x_entry, y_entry);
+	float exit = SDL_min(x_exit, y_exit);
+	if (entry >= exit || exit <= 0 || entry >= s->toi)
+		return 1;
+
+	if (entry <= 0 && x_entry < 0 && y_entry < 0) {
+		// Already overlapping, it can't move at all.
+		s->toi = 0;
+		s->normal_x = s->normal_y = 0;
+		return 0;
+	}
+
+	s->toi = SDL_max(entry, 0);
+	if (x_entry > y_entry) {
+		s->normal_x = s->dx > 0 ? -1 : 1;
+		s->normal_y = 0;
+	} else {
+		s->normal_x = 0;
+		s->normal_y = s->dy > 0 ? -1 : 1;
+	}
+	return 1;
+}
+
+float engine_tilemap_sweep(Tilemap *t, Rect2Df box, float dx, float dy, TileQuery query, int *normal_x, int *normal_y) {
+	Sweep s = {box, dx, dy, 1, 0, 0};
+	// Every tile the box can touch during the move.
+	Rect2Df swept = {SDL_min(box.x, box.x + dx), SDL_min(box.y, box.y + dy), box.w + fabsf(dx), box.h + fabsf(dy)};
+	Rect2Di r;
+
+	if (tile_range(t, swept, &r))
+		visit_tiles(t, r, query, sweep_tile, &s);
+
+	if (normal_x)
+		*normal_x = s.normal_x;
+	if (normal_y)
+		*normal_y = s.normal_y;
+	return s.toi;
+}
+
+// Distance along the ray to the plane at v, infinite if the ray is parallel to it.
+static float plane_distance(float origin, float d, float v) {
+	return d != 0 ? (v - origin) / d : INFINITY;
+}
+
+// Amanatides and Woo DDA over the tiles. Chunks without matching tiles are crossed in one step.
+// With prepared, the chunks the ray can reach were already updated, so nothing is written.
+static int cast_ray(Tilemap *t, TileRay ray, TileQuery query, TileRayHit *hit, int prepared) {
+	float size = t->tileSize;
+	float length = sqrtf(ray.dx * ray.dx + ray.dy * ray.dy);
+	hit->hit = 0;
+
+	if (length == 0)
+		return 0;
+
+	float dx = ray.dx / length;
+	float dy = ray.dy / length;
+	int sx = dx > 0 ? 1 : -1;
+	int sy = dy > 0 ? 1 : -1;
+
+	// Distance where the ray enters and leaves the map.
+	float t_x0 = plane_distance(ray.x, dx, 0), t_x1 = plane_distance(ray.x, dx, t->w * size);
+	float t_y0 = plane_distance(ray.y, dy, 0), t_y1 = plane_distance(ray.y, dy, t->h * size);
+	if (dx == 0) {
+		if (ray.x < 0 || ray.x >= t->w * size)
+			return 0;
+		t_x0 = -INFINITY;
+		t_x1 = INFINITY;
+	}
+	if (dy == 0) {
+		if (ray.y < 0 || ray.y >= t->h * size)
+			return 0;
+		t_y0 = -INFINITY;
+		t_y1 = INFINITY;
+	}
+
+	float enter = SDL_max(SDL_max(SDL_min(t_x0, t_x1), SDL_min(t_y0, t_y1)), 0);
+	float leave = SDL_min(SDL_min(SDL_max(t_x0, t_x1), SDL_max(t_y0, t_y1)), ray.max_distance);
+	if (enter > leave)
+		return 0;
+
+	float dist = enter;
+	int normal_x = 0, normal_y = 0;
+	if (enter > 0) {
+		// Entered from outside of the map, through the side further away.
+		if (SDL_min(t_x0, t_x1) > SDL_min(t_y0, t_y1))
+			normal_x = -sx;
+		else
+			normal_y = -sy;
+	}
+
+	int x = clamp((int)floorf((ray.x + dx * dist) / size), 0, t->w - 1);
+	int y = clamp((int)floorf((ray.y + dy * dist) / size), 0, t->h - 1);
+
+	while (dist <= leave) {
+		TileChunk *chunk = &t->chunks[(y / TILEMAP_CHUNK_SIZE) * t->chunks_w + x / TILEMAP_CHUNK_SIZE];
+		if (!prepared)
+			update_occupancy(t, chunk);
+
+		if (!chunk->occupied[query]) {
+			// Straight to the tile after the chunk.
+			float next_x = plane_distance(ray.x, dx, (sx > 0 ? chunk->x + chunk->w : chunk->x) * size);
+			float next_y = plane_distance(ray.y, dy, (sy > 0 ? chunk->y + chunk->h : chunk->y) * size);
+
+			if (next_x < next_y) {
+				dist = next_x;
+				x = sx > 0 ? chunk->x + chunk->w : chunk->x - 1;
+				y = clamp((int)floorf((ray.y + dy * dist) / size), chunk->y, chunk->y + chunk->h - 1);
+				normal_x = -sx;
+				normal_y = 0;
+			} else {
+				dist = next_y;
+				y = sy > 0 ? chunk->y + chunk->h : chunk->y - 1;
+				x = clamp((int)floorf((ray.x + dx * dist) / size), chunk->x, chunk->x + chunk->w - 1);
+				normal_x = 0;
+				normal_y = -sy;
+			}
+
+			if (x < 0 || x >= t->w || y < 0 || y >= t->h)
+				return 0;
+			continue;
+		}
+
+		if (chunk->occupancy[query][y - chunk->y] & (1u << (x - chunk->x))) {
+			*hit = (TileRayHit){1, x, y, dist, normal_x, normal_y};
+			return 1;
+		}
+
+		float next_x = plane_distance(ray.x, dx, (x + (sx > 0)) * size);
+		float next_y = plane_distance(ray.y, dy, (y + (sy > 0)) * size);
+		if (next_x < next_y) {
+			dist = next_x;
+			x += sx;
+			normal_x = -sx;
+			normal_y = 0;
+		} else {
+			dist = next_y;
+			y += sy;
+			normal_x = 0;
+			normal_y = -sy;
+		}
+
+		if (x < 0 || x >= t->w || y < 0 || y >= t->h)
+			return 0;
+	}
+
+	return 0;
+}
+
+int engine_tilemap_raycast(Tilemap *t, TileRay ray, TileQuery query, TileRayHit *hit) {
+	return cast_ray(t, ray, query, hit, 0);
+}
+
+typedef struct RayContext {
+	Tilemap *t;
+	const TileRay *rays;
+	TileRayHit *hits;
+	int count;
+	TileQuery query;
+} RayContext;
+
+static void cast_rays(void *data, int index) {
+	RayContext *ctx = data;
+	int end = SDL_min(ctx->count, (index + 1) * RAYS_PER_JOB);
+
+	for (int i = index * RAYS_PER_JOB; i < end; i++)
+		cast_ray(ctx->t, ctx->rays[i], ctx->query, &ctx->hits[i], 1);
+}
+
+// Area the rays can reach, in pixels.
+static Rect2Df ray_bounds(Tilemap *t, const TileRay *rays, int count) {
+	float x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+
+	for (int i = 0; i < count; i++) {
+		const TileRay *ray = &rays[i];
+		float length = sqrtf(ray->dx * ray->dx + ray->dy * ray->dy);
+		float ex = ray->x + (length > 0 ? ray->dx * ray->max_distance / length : 0);
+		float ey = ray->y + (length > 0 ? ray->dy * ray->max_distance / length : 0);
+		if (!isfinite(ex) || !isfinite(ey))
+			return (Rect2Df){0, 0, (float)t->w * t->tileSize, (float)t->h * t->tileSize};
+		x0 = SDL_min(x0, SDL_min(ray->x, ex));
+		y0 = SDL_min(y0, SDL_min(ray->y, ey));
+		x1 = SDL_max(x1, SDL_max(ray->x, ex));
+		y1 = SDL_max(y1, SDL_max(ray->y, ey));
+	}
+
+	// A tile more around, the walk stops on the tile after the end.
+	float size = t->tileSize;
+	return (Rect2Df){x0 - size, y0 - size, x1 - x0 + size * 2, y1 - y0 + size * 2};
+}
+
+void engine_tilemap_raycast_batch(Tilemap *t, const TileRay *rays, TileRayHit *hits, int count, TileQuery query) {
+	Uint64 start = SDL_GetPerformanceCounter();
+	Rect2Di r;
+
+	// The threads only read the bits, every chunk the rays can reach is updated before.
+	if (count > 0 && tile_range(t, ray_bounds(t, rays, count), &r)) {
+		for (int cy = r.y / TILEMAP_CHUNK_SIZE; cy <= (r.y + r.h - 1) / TILEMAP_CHUNK_SIZE; cy++) {
+			for (int cx = r.x / TILEMAP_CHUNK_SIZE; cx <= (r.x + r.w - 1) / TILEMAP_CHUNK_SIZE; cx++)
+				update_occupancy(t, &t->chunks[cy * t->chunks_w + cx]);
+		}
+	}
+
+	RayContext ctx = {t, rays, hits, count, query};
+	engine_jobs_for((count + RAYS_PER_JOB - 1) / RAYS_PER_JOB, cast_rays, &ctx);
+
+	double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+	t->ray_stats.rays = count;
+	t->ray_stats.batch_ms = seconds * 1000;
+	t->ray_stats.rays_per_second = seconds > 0 ? count / seconds : 0;
+}
@@ -0,0 +1,269 @@
+#include "tilemap.h"
+#include <SDL.h>
+#include <engine/logger.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Chunks whose temperatures changed less than this in a step are at equilibrium.
+#define HEAT_EPSILON 0.01f
+
+typedef struct HeatMaterial {
+	// Fraction of the difference exchanged with a neighbour per step, the lower of both tiles is used.
+	// At most 0.25, so a tile never gives away more than the difference.
+	float conductivity;
+	float target; // Temperature the tile is pulled to.
+	float rate; // Fraction of the way to the target per step, 0 for none.
+} HeatMaterial;
+
+static const HeatMaterial materials[NUM_TILE_TYPES] = {
+	[TILE_AIR] = {0.02f, TILEMAP_AMBIENT_TEMPERATURE, 0.001f}, // Slowly loses heat to the surroundings.
+	[TILE_ROCK] = {0.1f, 0, 0},
+	[TILE_SAND] = {0.05f, 0, 0},
+	[TILE_COAL] = {0.08f, 0, 0},
+	[TILE_LAVA] = {0.2f, 1200, 0.2f},
+	[TILE_WATER] = {0.15f, TILEMAP_AMBIENT_TEMPERATURE, 0.1f},
+	[TILE_FIRE] = {0.1f, 800, 0.2f},
+};
+
+typedef struct HeatContext {
+	Tilemap *t;
+	float *temperature;
+} HeatContext;
+
+void engine_tilemap_heat_update_chunk(Tilemap *t, TileChunk *chunk) {
+	if (!t->heat_k)
+		return;
+
+	for (int y = chunk->y; y < chunk->y + chunk->h; y++) {
+		int i = y * t->w + chunk->x;
+		for (int x = 0; x < chunk->w; x++)
+			t->heat_k[i + x] = materials[t->tiles[i + x].type].conductivity;
+	}
+}
+
+static void update_conductivity(void *data, int index) {
+	HeatContext *ctx = data;
+	Tilemap *t = ctx->t;
+	engine_tilemap_heat_update_chunk(t, &t->chunks[t->sim_chunks[index]]);
+}
+
+// Neighbours are given as offsets from i.
+static void diffuse_cell(const float *temp, const float *k, float *next, int i, int left, int right, int up, int down) {
+	float tc = temp[i];
+	float kc = k[i];
+	float flux = fminf(kc, k[i + left]) * (temp[i + left] - tc) + fminf(kc, k[i + right]) * (temp[i + right] - tc) +
+				 fminf(kc, k[i + up]) * (temp[i + up] - tc) + fminf(kc, k[i + down]) * (temp[i + down] - tc);
+	next[i] = tc + flux;
+}
+
+#if defined(__SSE2__)
+// Heat flowing from the neighbours at temp and k into four tiles.
+static inline __m128 flux_sse2(__m128 tc, __m128 kc, const float *temp, const float *k) {
+	return _mm_mul_ps(_mm_min_ps(kc, _mm_loadu_ps(k)), _mm_sub_ps(_mm_loadu_ps(temp), tc));
+}
+#endif
+
+// 5-point stencil over [x0, x1) of a row, from temp into heat_next.
+static void diffuse_row(Tilemap *t, const float *temp, int y, int x0, int x1) {
+	const float *k = t->heat_k;
+	float *next = t->heat_next;
+	int w = t->w;
+	int row = y * w;
+	// Outside of the map counts as the same tile, so no heat flows through the edges.
+	int up = y > 0 ? -w : 0;
+	int down = y < t->h - 1 ? w : 0;
+
+	if (x0 == 0)
+		diffuse_cell(temp, k, next, row, 0, w > 1, up, down);
+	if (x1 == w && w > 1)
+		diffuse_cell(temp, k, next, row + w - 1, -1, 0, up, down);
+
+	int x = SDL_max(x0, 1);
+	int end = SDL_min(x1, w - 1);
+
+#if defined(__SSE2__)
+	for (; x + 4 <= end; x += 4) {
+		int i = row + x;
+		__m128 tc = _mm_loadu_ps(temp + i);
+		__m128 kc = _mm_loadu_ps(k + i);
+		__m128 flux = flux_sse2(tc, kc, temp + i - 1, k + i - 1);
+		flux = _mm_add_ps(flux, flux_sse2(tc, kc, temp + i + 1, k + i + 1));
+		flux = _mm_add_ps(flux, flux_sse2(tc, kc, temp + i + up, k + i + up));
+		flux = _mm_add_ps(flux, flux_sse2(tc, kc, temp + i + down, k + i + down));
+		_mm_storeu_ps(next + i, _mm_add_ps(tc, flux));
+	}
+#endif
+
+	for (; x < end; x++)
+		diffuse_cell(temp, k, next, row + x, -1, 1, up, down);
+}
+
+// Pulls lava, fire, water and air to their temperature.
+static void apply_sources(Tilemap *t, int y, int x0, int x1) {
+	int row = y * t->w;
+	for (int x = x0; x < x1; x++) {
+		const HeatMaterial *m = &materials[t->tiles[row + x].type];
+		if (m->rate != 0)
+			t->heat_next[row + x] += m->rate * (m->target - t->heat_next[row + x]);
+	}
+}
+
+static float row_change(const float *temp, const float *next, int n) {
+	float change = 0;
+	int i = 0;
+
+#if defined(__SSE2__)
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 vchange = _mm_setzero_ps();
+	for (; i + 4 <= n; i += 4) {
+		__m128 d = _mm_sub_ps(_mm_loadu_ps(next + i), _mm_loadu_ps(temp + i));
+		vchange = _mm_max_ps(vchange, _mm_and_ps(d, abs_mask));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, vchange);
+	change = fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3]));
+#endif
+
+	for (; i < n; i++)
+		change = fmaxf(change, fabsf(next[i] - temp[i]));
+
+	return change;
+}
+
+static void diffuse_chunk(void *data, int index) {
+	HeatContext *ctx = data;
+	Tilemap *t = ctx->t;
+	TileChunk *chunk = &t->chunks[t->sim_chunks[index]];
+	float change = 0;
+
+	for (int y = chunk->y; y < chunk->y + chunk->h; y++) {
+		int i = y * t->w + chunk->x;
+		diffuse_row(t, ctx->temperature, y, chunk->x, chunk->x + chunk->w);
+		apply_sources(t, y, chunk->x, chunk->x + chunk->w);
+		change = fmaxf(change, row_change(ctx->temperature + i, t->heat_next + i, chunk->w));
+	}
+
+	chunk->heat_change = change;
+}
+
+// Every chunk reads its neighbours, so the new temperatures are only copied back once all are done.
+static void copy_chunk(void *data, int index) {
+	HeatContext *ctx = data;
+	Tilemap *t = ctx->t;
+	TileChunk *chunk = &t->chunks[t->sim_chunks[index]];
+
+	for (int y = chunk->y; y < chunk->y + chunk->h; y++) {
+		int i = y * t->w + chunk->x;
+		memcpy(ctx->temperature + i, t->heat_next + i, sizeof(float) * chunk->w);
+	}
+}
+
+static void run_hooks(Tilemap *t, float *temperature, int n) {
+	unsigned int hooked = 0;
+	for (int h = 0; h < t->heat_hook_count; h++)
+		hooked |= 1u << t->heat_hooks[h].type;
+
+	if (!hooked)
+		return;
+
+	for (int c = 0; c < n; c++) {
+		TileChunk *chunk = &t->chunks[t->sim_chunks[c]];
+
+		for (int y = chunk->y; y < chunk->y + chunk->h; y++) {
+			for (int x = chunk->x; x < chunk->x + chunk->w; x++) {
+				int i = y * t->w + x;
+				TileType type = t->tiles[i].type;
+				if (!(hooked & (1u << type)))
+					continue;
+
+				for (int h = 0; h < t->heat_hook_count; h++) {
+					TileHeatHook *hook = &t->heat_hooks[h];
+					// A hook may change the tile, the next ones see the new type.
+					if (hook->type == t->tiles[i].type && temperature[i] > hook->threshold)
+						hook->fn(t, x, y, temperature[i], hook->data);
+				}
+			}
+		}
+	}
+}
+
+// Heat reaches the chunks around in the next step.
+static void wake_around(Tilemap *t, TileChunk *chunk) {
+	int cx = chunk->x / TILEMAP_CHUNK_SIZE;
+	int cy = chunk->y / TILEMAP_CHUNK_SIZE;
+
+	for (int y = SDL_max(0, cy - 1); y <= SDL_min(t->chunks_h - 1, cy + 1); y++) {
+		for (int x = SDL_max(0, cx - 1); x <= SDL_min(t->chunks_w - 1, cx + 1); x++)
+			t->chunks[y * t->chunks_w + x].heat_awake = 1;
+	}
+}
+
+void engine_tilemap_diffuse_heat(Tilemap *t) {
+	Uint64 start = SDL_GetPerformanceCounter();
+	int chunk_count = t->chunks_w * t->chunks_h;
+
+	HeatContext ctx;
+	ctx.t = t;
+	ctx.temperature = engine_tilemap_layer(t, TILE_LAYER_TEMPERATURE);
+
+	if (!t->heat_next) {
+		size_t size = sizeof(float) * t->w * t->h;
+		t->heat_next = SDL_SIMDAlloc(size);
+		t->heat_k = SDL_SIMDAlloc(size);
+		for (int i = 0; i < t->w * t->h; i++)
+			t->heat_k[i] = materials[t->tiles[i].type].conductivity;
+	}
+
+	engine_tilemap_load_awake(t);
+
+	int n = 0;
+	unsigned long cells = 0;
+	for (int i = 0; i < chunk_count; i++) {
+		TileChunk *chunk = &t->chunks[i];
+		if (chunk->heat_awake) {
+			chunk->heat_awake = 0;
+			t->sim_chunks[n++] = i;
+			cells += chunk->w * chunk->h;
+		}
+	}
+
+	// The tiles may have changed since the last step, the conductivities of all the awake chunks
+	// are needed before diffusing any of them.
+	engine_jobs_for(n, update_conductivity, &ctx);
+	engine_jobs_for(n, diffuse_chunk, &ctx);
+	engine_jobs_for(n, copy_chunk, &ctx);
+
+	for (int i = 0; i < n; i++) {
+		TileChunk *chunk = &t->chunks[t->sim_chunks[i]];
+		if (chunk->heat_change > HEAT_EPSILON)
+			wake_around(t, chunk);
+	}
+
+	run_hooks(t, ctx.temperature, n);
+
+	double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+	TilemapHeatStats *stats = &t->heat_stats;
+	stats->steps++;
+	stats->active_chunks = n;
+	stats->cells_updated = cells;
+	stats->step_ms = seconds * 1000;
+	stats->cells_per_second = seconds > 0 ? cells / seconds : 0;
+}
+
+int engine_tilemap_heat_hook(Tilemap *t, TileType type, float threshold, TILEMAP_HEAT_FN fn, void *data) {
+	if (t->heat_hook_count == TILEMAP_MAX_HEAT_HOOKS) {
+		engine_log_error("Too many heat hooks, the limit is %d", TILEMAP_MAX_HEAT_HOOKS);
+		return 0;
+	}
+
+	t->heat_hooks[t->heat_hook_count++] = (TileHeatHook){type, threshold, fn, data};
+	return 1;
+}
+
+void engine_tilemap_ignite(Tilemap *t, int x, int y, float temperature, void *data) {
+	engine_tilemap_set(t, x, y, TILE_FIRE);
+}
@@ -0,0 +1,265 @@
+#include "tilemap.h"
+#include <GL/glew.h>
+#include <SDL.h>
+#include <engine/graphics/renderer.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct LightMaterial {
+	uint8_t emission; // Light level of the tile itself.
+	uint8_t cost; // Levels lost when the light enters the tile, at least 1.
+} LightMaterial;
+
+static const LightMaterial materials[NUM_TILE_TYPES] = {
+	[TILE_AIR] = {0, 1},
+	[TILE_ROCK] = {0, 5},
+	[TILE_SAND] = {0, 5},
+	[TILE_COAL] = {0, 5},
+	[TILE_LAVA] = {TILEMAP_LIGHT_MAX, 1},
+	[TILE_WATER] = {0, 2},
+	[TILE_FIRE] = {TILEMAP_LIGHT_MAX - 3, 1},
+};
+
+typedef struct LightNode {
+	int index; // Tile
+	uint8_t level; // Light it had when it was removed.
+} LightNode;
+
+// Queues of the flood fills, only used from the main thread.
+typedef struct LightQueue {
+	LightNode *nodes;
+	int head, tail;
+	int capacity;
+} LightQueue;
+
+static LightQueue add_queue;
+static LightQueue remove_queue;
+static LightQueue emitters; // Emitting tiles cleared by the removal, lit again after it.
+
+static void push(LightQueue *q, int index, uint8_t level) {
+	if (q->tail == q->capacity) {
+		q->capacity = q->capacity ? q->capacity * 2 : 1024;
+		q->nodes = realloc(q->nodes, sizeof(LightNode) * q->capacity);
+	}
+	q->nodes[q->tail++] = (LightNode){index, level};
+}
+
+static uint8_t emission(Tilemap *t, int index) {
+	return materials[t->tiles[index].type].emission;
+}
+
+// Queues the chunk of the tile for upload, the first time its light changes.
+static void light_changed(Tilemap *t, int index) {
+	int x = index % t->w;
+	int y = index / t->w;
+	int chunk_index = (y / TILEMAP_CHUNK_SIZE) * t->chunks_w + x / TILEMAP_CHUNK_SIZE;
+	TileChunk *chunk = &t->chunks[chunk_index];
+
+	if (!chunk->light_upload) {
+		chunk->light_upload = 1;
+		t->light_uploads[t->light_upload_count++] = chunk_index;
+	}
+}
+
+static void set_light(Tilemap *t, int index, uint8_t level) {
+	t->light[index] = level;
+	light_changed(t, index);
+}
+
+// Writes the indices of the neighbours inside the map to out, returns how many.
+static int neighbours(Tilemap *t, int index, int *out) {
+	int x = index % t->w;
+	int n = 0;
+
+	if (x > 0)
+		out[n++] = index - 1;
+	if (x < t->w - 1)
+		out[n++] = index + 1;
+	if (index >= t->w)
+		out[n++] = index - t->w;
+	if (index + t->w < t->w * t->h)
+		out[n++] = index + t->w;
+
+	return n;
+}
+
+// Darkens the tiles lit by the removed ones. Tiles lit from somewhere else are queued to spread
+// their light back, and emitters are queued to light up again.
+static void remove_light(Tilemap *t) {
+	LightQueue *q = &remove_queue;
+
+	while (q->head < q->tail) {
+		LightNode node = q->nodes[q->head++];
+		int around[4];
+		int count = neighbours(t, node.index, around);
+
+		for (int i = 0; i < count; i++) {
+			int n = around[i];
+			uint8_t level = t->light[n];
+			if (level != 0 && level < node.level) {
+				set_light(t, n, 0);
+				push(q, n, level);
+				if (emission(t, n))
+					push(&emitters, n, 0);
+			} else if (level >= node.level) {
+				push(&add_queue, n, 0);
+			}
+		}
+	}
+}
+
+static void spread_light(Tilemap *t) {
+	LightQueue *q = &add_queue;
+
+	while (q->head < q->tail) {
+		int index = q->nodes[q->head++].index;
+		int level = t->light[index];
+		int around[4];
+		int count = neighbours(t, index, around);
+
+		for (int i = 0; i < count; i++) {
+			int n = around[i];
+			int next = level - materials[t->tiles[n].type].cost;
+			if (next > t->light[n]) {
+				set_light(t, n, next);
+				push(q, n, 0);
+			}
+		}
+	}
+}
+
+static unsigned long relight_rect(Tilemap *t, Rect2Di r) {
+	for (int y = r.y; y < r.y + r.h; y++) {
+		for (int x = r.x; x < r.x + r.w; x++) {
+			int index = y * t->w + x;
+			if (t->light[index]) {
+				push(&remove_queue, index, t->light[index]);
+				set_light(t, index, 0);
+			}
+			if (emission(t, index))
+				push(&emitters, index, 0);
+		}
+	}
+
+	remove_light(t);
+	unsigned long visited = remove_queue.tail;
+
+	for (int i = 0; i < emitters.tail; i++) {
+		int index = emitters.nodes[i].index;
+		if (emission(t, index) > t->light[index]) {
+			set_light(t, index, emission(t, index));
+			push(&add_queue, index, 0);
+		}
+	}
+
+	// Light around the rect may now get through it, tiles that turned into air for example.
+	for (int y = r.y; y < r.y + r.h; y++) {
+		for (int x = r.x; x < r.x + r.w; x++) {
+			int around[4];
+			int count = neighbours(t, y * t->w + x, around);
+			for (int i = 0; i < count; i++) {
+				if (t->light[around[i]])
+					push(&add_queue, around[i], 0);
+			}
+		}
+	}
+
+	spread_light(t);
+	visited += add_queue.tail;
+
+	remove_queue.head = remove_queue.tail = 0;
+	add_queue.head = add_queue.tail = 0;
+	emitters.head = emitters.tail = 0;
+	return visited;
+}
+
+void engine_tilemap_init_light(Tilemap *t) {
+	t->light = malloc((size_t)t->w * t->h);
+	memset(t->light, 0, (size_t)t->w * t->h);
+	t->light_chunks = malloc(sizeof(int) * t->chunks_w * t->chunks_h);
+	t->light_uploads = malloc(sizeof(int) * t->chunks_w * t->chunks_h);
+
+	// The loaded chunks are lit once, after that only around the changes.
+	for (int c = 0; c < t->chunks_w * t->chunks_h; c++) {
+		TileChunk *chunk = &t->chunks[c];
+		if (chunk->pending)
+			continue;
+
+		for (int y = chunk->y; y < chunk->y + chunk->h; y++) {
+			for (int x = chunk->x; x < chunk->x + chunk->w; x++) {
+				int i = y * t->w + x;
+				if (emission(t, i)) {
+					t->light[i] = emission(t, i);
+					push(&add_queue, i, 0);
+				}
+			}
+		}
+	}
+	spread_light(t);
+	add_queue.head = add_queue.tail = 0;
+
+	// Uploaded with the tiles of each chunk.
+	for (int i = 0; i < t->light_upload_count; i++)
+		t->chunks[t->light_uploads[i]].light_upload = 0;
+	t->light_upload_count = 0;
+}
+
+void engine_tilemap_create_light_texture(Tilemap *t) {
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glGenTextures(1, &t->light_tex);
+	glBindTexture(GL_TEXTURE_2D, t->light_tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, t->w, t->h, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	// Smooth between the tiles.
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void engine_tilemap_update_light(Tilemap *t) {
+	if (t->light_chunk_count == 0)
+		return;
+
+	Uint64 start = SDL_GetPerformanceCounter();
+	unsigned long visited = 0;
+
+	for (int i = 0; i < t->light_chunk_count; i++) {
+		TileChunk *chunk = &t->chunks[t->light_chunks[i]];
+		visited += relight_rect(t, chunk->light_dirty);
+		chunk->light_dirty.w = 0;
+	}
+
+	TilemapLightStats *stats = &t->light_stats;
+	stats->updates++;
+	stats->chunks_changed = t->light_chunk_count;
+	stats->tiles_visited = visited;
+	stats->update_ms = (double)(SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency();
+	t->light_chunk_count = 0;
+}
+
+void engine_tilemap_flush_light(Tilemap *t) {
+	if (t->light_upload_count == 0)
+		return;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, t->w);
+	glBindTexture(GL_TEXTURE_2D, t->light_tex);
+
+	for (int i = 0; i < t->light_upload_count; i++) {
+		TileChunk *chunk = &t->chunks[t->light_uploads[i]];
+		glTexSubImage2D(GL_TEXTURE_2D, 0, chunk->x, chunk->y, chunk->w, chunk->h, GL_RED, GL_UNSIGNED_BYTE,
+						&t->light[chunk->y * t->w + chunk->x]);
+		chunk->light_upload = 0;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	RenderStats *stats = engine_render_stats();
+	stats->tilemap_uploads += t->light_upload_count;
+	stats->tilemap_upload_bytes += (unsigned long)t->light_upload_count * TILEMAP_CHUNK_SIZE * TILEMAP_CHUNK_SIZE;
+	t->light_upload_count = 0;
+}
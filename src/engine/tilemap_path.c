@@ -0,0 +1,668 @@
+#include "tilemap.h"
+#include <SDL.h>
+#include <engine/logger.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if TILEMAP_CHUNK_SIZE > 32
+#error The walkable tiles of a cluster row are stored in 32 bits
+#endif
+
+#define CLUSTER_TILES (TILEMAP_CHUNK_SIZE * TILEMAP_CHUNK_SIZE)
+// Every other tile of a border at most, on each of the four borders.
+#define CLUSTER_NODES (2 * TILEMAP_CHUNK_SIZE)
+#define UNREACHABLE 0xffff
+// Walkable runs along a border shorter than this get an entrance in the middle, longer ones one at
+// each end, so paths along wide openings don't have to go through the middle.
+#define LONG_ENTRANCE 6
+
+typedef enum PathSide {
+	SIDE_TOP,
+	SIDE_BOTTOM,
+	SIDE_LEFT,
+	SIDE_RIGHT,
+} PathSide;
+
+typedef struct PathNode {
+	uint8_t x, y; // In the cluster.
+	uint8_t side; // PathSide, the entrance leads to the cluster on that side.
+} PathNode;
+
+typedef struct PathCluster {
+	uint32_t walk[TILEMAP_CHUNK_SIZE]; // Bit per walkable tile, row by row.
+	PathNode nodes[CLUSTER_NODES]; // Entrances.
+	int node_count;
+	uint16_t *dist; // Between each pair of entrances inside the cluster, node_count * node_count.
+	unsigned int stamp; // Last rebuild that visited the cluster.
+} PathCluster;
+
+typedef struct PathRequest {
+	int id;
+	int x0, y0, x1, y1;
+	TILEMAP_PATH_FN fn;
+	void *data;
+	TilePath path;
+} PathRequest;
+
+// Search state of an entrance, keyed by cluster * CLUSTER_NODES + node.
+typedef struct PathRecord {
+	int key;
+	unsigned int stamp; // Search that wrote it, older records are empty slots.
+	int g; // Distance from the start.
+	int parent; // Key of the previous entrance, -1 for the start.
+	int closed;
+} PathRecord;
+
+typedef struct PathOpen {
+	int f;
+	int g;
+	int key;
+} PathOpen;
+
+typedef struct TilemapPaths {
+	int w, h;
+	int chunks_w, chunks_h;
+	PathCluster *clusters;
+	int *changed; // Scratch for the clusters whose walkable tiles changed.
+	unsigned int stamp;
+	PathRequest *queued; // Waiting for the next batch.
+	int queued_count;
+	int queued_capacity;
+	PathRequest *batch; // Being searched by the job.
+	int batch_count;
+	int batch_capacity;
+	int next_id;
+	JobCounter batch_job;
+	int busy;
+
+	// Only used by the job.
+	PathRecord *records;
+	int record_capacity; // Power of two.
+	int record_count;
+	unsigned int search;
+	PathOpen *open; // Binary heap on f.
+	int open_count;
+	int open_capacity;
+	int *route; // Entrances of the found path, from the goal back to the start.
+	int route_capacity;
+	uint16_t start_dist[CLUSTER_TILES];
+	uint16_t goal_dist[CLUSTER_TILES];
+	uint16_t local_dist[CLUSTER_TILES];
+	uint16_t queue[CLUSTER_TILES];
+	unsigned long nodes_expanded;
+	double batch_ms;
+} TilemapPaths;
+
+static int walkable(const PathCluster *c, int x, int y) {
+	return (c->walk[y] >> x) & 1;
+}
+
+// Bits of a column, bit y for row y.
+static uint32_t column(const PathCluster *c, int x) {
+	uint32_t bits = 0;
+	for (int y = 0; y < TILEMAP_CHUNK_SIZE; y++)
+		bits |= ((c->walk[y] >> x) & 1u) << y;
+	return bits;
+}
+
+// Distances from the tile to the tiles of the cluster it can reach, UNREACHABLE for the others.
+static void cluster_bfs(const PathCluster *c, int x, int y, uint16_t *dist, uint16_t *queue) {
+	memset(dist, 0xff, sizeof(uint16_t) * CLUSTER_TILES);
+
+	int head = 0;
+	int tail = 0;
+	dist[y * TILEMAP_CHUNK_SIZE + x] = 0;
+	queue[tail++] = y * TILEMAP_CHUNK_SIZE + x;
+
+	while (head < tail) {
+		int i = queue[head++];
+		int cx = i % TILEMAP_CHUNK_SIZE;
+		int cy = i / TILEMAP_CHUNK_SIZE;
+		uint16_t d = dist[i] + 1;
+
+		if (cx > 0 && walkable(c, cx - 1, cy) && dist[i - 1] == UNREACHABLE) {
+			dist[i - 1] = d;
+			queue[tail++] = i - 1;
+		}
+		if (cx < TILEMAP_CHUNK_SIZE - 1 && walkable(c, cx + 1, cy) && dist[i + 1] == UNREACHABLE) {
+			dist[i + 1] = d;
+			queue[tail++] = i + 1;
+		}
+		if (cy > 0 && walkable(c, cx, cy - 1) && dist[i - TILEMAP_CHUNK_SIZE] == UNREACHABLE) {
+			dist[i - TILEMAP_CHUNK_SIZE] = d;
+			queue[tail++] = i - TILEMAP_CHUNK_SIZE;
+		}
+		if (cy < TILEMAP_CHUNK_SIZE - 1 && walkable(c, cx, cy + 1) && dist[i + TILEMAP_CHUNK_SIZE] == UNREACHABLE) {
+			dist[i + TILEMAP_CHUNK_SIZE] = d;
+			queue[tail++] = i + TILEMAP_CHUNK_SIZE;
+		}
+	}
+}
+
+static void add_node(PathCluster *c, int side, int pos) {
+	PathNode *node = &c->nodes[c->node_count++];
+	node->side = side;
+	node->x = side == SIDE_LEFT ? 0 : side == SIDE_RIGHT ? TILEMAP_CHUNK_SIZE - 1 : pos;
+	node->y = side == SIDE_TOP ? 0 : side == SIDE_BOTTOM ? TILEMAP_CHUNK_SIZE - 1 : pos;
+}
+
+// open has a bit per position along the side where both clusters are walkable. Both clusters of a
+// border get the same positions, so each entrance has a partner on the other side.
+static void add_entrances(PathCluster *c, uint32_t open, int side) {
+	int pos = 0;
+	while (pos < TILEMAP_CHUNK_SIZE) {
+		if (!((open >> pos) & 1)) {
+			pos++;
+			continue;
+		}
+
+		int end = pos;
+		while (end + 1 < TILEMAP_CHUNK_SIZE && ((open >> (end + 1)) & 1))
+			end++;
+
+		if (end - pos + 1 < LONG_ENTRANCE) {
+			add_node(c, side, (pos + end) / 2);
+		} else {
+			add_node(c, side, pos);
+			add_node(c, side, end);
+		}
+		pos = end + 1;
+	}
+}
+
+// Updates the walkable bits from the tiles, returns 1 if they changed.
+static int update_walk(Tilemap *t, TilemapPaths *p, int index) {
+	TileChunk *chunk = &t->chunks[index];
+	PathCluster *c = &p->clusters[index];
+	const uint32_t *solid = engine_tilemap_occupancy(t, chunk, TILE_QUERY_SOLID);
+	// Shifted in 64 bits, a full row can be 32 tiles.
+	uint32_t inside = (uint32_t)((1ull << chunk->w) - 1);
+	uint32_t walk[TILEMAP_CHUNK_SIZE];
+
+	for (int y = 0; y < TILEMAP_CHUNK_SIZE; y++)
+		walk[y] = y < chunk->h ? ~solid[y] & inside : 0;
+
+	if (memcmp(walk, c->walk, sizeof(walk)) == 0)
+		return 0;
+
+	memcpy(c->walk, walk, sizeof(walk));
+	return 1;
+}
+
+// Finds the entrances of the cluster and the distances between them.
+static void build_cluster(TilemapPaths *p, int index) {
+	PathCluster *c = &p->clusters[index];
+	int cx = index % p->chunks_w;
+	int cy = index / p->chunks_w;
+	int last = TILEMAP_CHUNK_SIZE - 1;
+
+	c->node_count = 0;
+	if (cy > 0)
+		add_entrances(c, c->walk[0] & p->clusters[index - p->chunks_w].walk[last], SIDE_TOP);
+	if (cy < p->chunks_h - 1)
+		add_entrances(c, c->walk[last] & p->clusters[index + p->chunks_w].walk[0], SIDE_BOTTOM);
+	if (cx > 0)
+		add_entrances(c, column(c, 0) & column(&p->clusters[index - 1], last), SIDE_LEFT);
+	if (cx < p->chunks_w - 1)
+		add_entrances(c, column(c, last) & column(&p->clusters[index + 1], 0), SIDE_RIGHT);
+
+	int n = c->node_count;
+	c->dist = realloc(c->dist, sizeof(uint16_t) * (n > 0 ? n * n : 1));
+	for (int i = 0; i < n; i++) {
+		cluster_bfs(c, c->nodes[i].x, c->nodes[i].y, p->local_dist, p->queue);
+		for (int j = 0; j < n; j++)
+			c->dist[i * n + j] = p->local_dist[c->nodes[j].y * TILEMAP_CHUNK_SIZE + c->nodes[j].x];
+	}
+}
+
+// Entrance on the other side of the border, -1 if there is none.
+static int partner(TilemapPaths *p, int key) {
+	int index = key / CLUSTER_NODES;
+	PathNode *node = &p->clusters[index].nodes[key % CLUSTER_NODES];
+	int other;
+	int side;
+
+	switch (node->side) {
+	case SIDE_TOP:
+		other = index - p->chunks_w;
+		side = SIDE_BOTTOM;
+		break;
+	case SIDE_BOTTOM:
+		other = index + p->chunks_w;
+		side = SIDE_TOP;
+		break;
+	case SIDE_LEFT:
+		other = index - 1;
+		side = SIDE_RIGHT;
+		break;
+	default:
+		other = index + 1;
+		side = SIDE_LEFT;
+		break;
+	}
+
+	PathCluster *c = &p->clusters[other];
+	int horizontal = side == SIDE_TOP || side == SIDE_BOTTOM;
+	for (int i = 0; i < c->node_count; i++) {
+		PathNode *n = &c->nodes[i];
+		if (n->side == side && (horizontal ? n->x == node->x : n->y == node->y))
+			return other * CLUSTER_NODES + i;
+	}
+
+	return -1;
+}
+
+static void node_position(TilemapPaths *p, int key, int *x, int *y) {
+	int index = key / CLUSTER_NODES;
+	PathNode *node = &p->clusters[index].nodes[key % CLUSTER_NODES];
+	*x = (index % p->chunks_w) * TILEMAP_CHUNK_SIZE + node->x;
+	*y = (index / p->chunks_w) * TILEMAP_CHUNK_SIZE + node->y;
+}
+
+static PathRecord *find_record(TilemapPaths *p, int key) {
+	uint32_t slot = ((uint32_t)key * 0x9e3779b1u) >> 8;
+	while (1) {
+		PathRecord *r = &p->records[slot & (p->record_capacity - 1)];
+		if (r->stamp != p->search || r->key == key)
+			return r;
+		slot++;
+	}
+}
+
+static PathRecord *get_record(TilemapPaths *p, int key) {
+	if ((p->record_count + 1) * 2 > p->record_capacity) {
+		PathRecord *old = p->records;
+		int old_capacity = p->record_capacity;
+
+		p->record_capacity = old_capacity ? old_capacity * 2 : 1024;
+		p->records = malloc(sizeof(PathRecord) * p->record_capacity);
+		memset(p->records, 0, sizeof(PathRecord) * p->record_capacity);
+		for (int i = 0; i < old_capacity; i++) {
+			if (old[i].stamp == p->search)
+				*find_record(p, old[i].key) = old[i];
+		}
+		free(old);
+	}
+
+	PathRecord *r = find_record(p, key);
+	if (r->stamp != p->search) {
+		*r = (PathRecord){key, p->search, INT_MAX, -1, 0};
+		p->record_count++;
+	}
+	return r;
+}
+
+static void push_open(TilemapPaths *p, PathOpen e) {
+	if (p->open_count == p->open_capacity) {
+		p->open_capacity = p->open_capacity ? p->open_capacity * 2 : 256;
+		p->open = realloc(p->open, sizeof(PathOpen) * p->open_capacity);
+	}
+
+	int i = p->open_count++;
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (p->open[parent].f <= e.f)
+			break;
+		p->open[i] = p->open[parent];
+		i = parent;
+	}
+	p->open[i] = e;
+}
+
+static PathOpen pop_open(TilemapPaths *p) {
+	PathOpen top = p->open[0];
+	PathOpen last = p->open[--p->open_count];
+
+	int i = 0;
+	while (1) {
+		int child = i * 2 + 1;
+		if (child >= p->open_count)
+			break;
+		if (child + 1 < p->open_count && p->open[child + 1].f < p->open[child].f)
+			child++;
+		if (last.f <= p->open[child].f)
+			break;
+		p->open[i] = p->open[child];
+		i = child;
+	}
+	if (p->open_count > 0)
+		p->open[i] = last;
+
+	return top;
+}
+
+static void relax(TilemapPaths *p, int key, int g, int parent, int gx, int gy) {
+	PathRecord *r = get_record(p, key);
+	if (r->closed || g >= r->g)
+		return;
+
+	r->g = g;
+	r->parent = parent;
+
+	int x, y;
+	node_position(p, key, &x, &y);
+	push_open(p, (PathOpen){g + abs(x - gx) + abs(y - gy), g, key});
+}
+
+static void push_point(TilePath *path, int *capacity, int x, int y) {
+	if (path->count == *capacity) {
+		*capacity = *capacity ? *capacity * 2 : 64;
+		path->points = realloc(path->points, sizeof(int) * 2 * *capacity);
+	}
+	path->points[path->count * 2] = x;
+	path->points[path->count * 2 + 1] = y;
+	path->count++;
+}
+
+// Appends the tiles after (x0, y0) up to (x1, y1), a shortest way inside the cluster.
+static void local_path(TilemapPaths *p, int index, int x0, int y0, int x1, int y1, TilePath *path, int *capacity) {
+	PathCluster *c = &p->clusters[index];
+	int ox = (index % p->chunks_w) * TILEMAP_CHUNK_SIZE;
+	int oy = (index / p->chunks_w) * TILEMAP_CHUNK_SIZE;
+	int x = x0 - ox;
+	int y = y0 - oy;
+
+	// Distances to the end, then downhill from the start.
+	cluster_bfs(c, x1 - ox, y1 - oy, p->local_dist, p->queue);
+	uint16_t *dist = p->local_dist;
+
+	while (dist[y * TILEMAP_CHUNK_SIZE + x] != 0) {
+		int i = y * TILEMAP_CHUNK_SIZE + x;
+		uint16_t d = dist[i] - 1;
+
+		if (x > 0 && dist[i - 1] == d)
+			x--;
+		else if (x < TILEMAP_CHUNK_SIZE - 1 && dist[i + 1] == d)
+			x++;
+		else if (y > 0 && dist[i - TILEMAP_CHUNK_SIZE] == d)
+			y--;
+		else
+			y++;
+
+		push_point(path, capacity, ox + x, oy + y);
+	}
+}
+
+static int cluster_of(TilemapPaths *p, int x, int y) {
+	return (y / TILEMAP_CHUNK_SIZE) * p->chunks_w + x / TILEMAP_CHUNK_SIZE;
+}
+
+static void search(TilemapPaths *p, PathRequest *r) {
+	TilePath *path = &r->path;
+	*path = (TilePath){0, NULL, 0};
+
+	if (r->x0 < 0 || r->y0 < 0 || r->x0 >= p->w || r->y0 >= p->h || r->x1 < 0 || r->y1 < 0 || r->x1 >= p->w || r->y1 >= p->h)
+		return;
+
+	int sc = cluster_of(p, r->x0, r->y0);
+	int gc = cluster_of(p, r->x1, r->y1);
+	PathCluster *start = &p->clusters[sc];
+	PathCluster *goal = &p->clusters[gc];
+	int sx = r->x0 % TILEMAP_CHUNK_SIZE;
+	int sy = r->y0 % TILEMAP_CHUNK_SIZE;
+	int gx = r->x1 % TILEMAP_CHUNK_SIZE;
+	int gy = r->y1 % TILEMAP_CHUNK_SIZE;
+
+	if (!walkable(start, sx, sy) || !walkable(goal, gx, gy))
+		return;
+
+	// The start and goal are joined to the entrances of their clusters for this search only.
+	cluster_bfs(start, sx, sy, p->start_dist, p->queue);
+	cluster_bfs(goal, gx, gy, p->goal_dist, p->queue);
+
+	p->search++;
+	p->record_count = 0;
+	p->open_count = 0;
+
+	// A way inside a single cluster is used unless going out of it is shorter.
+	int best = INT_MAX;
+	int best_parent = -1;
+	if (sc == gc && p->start_dist[gy * TILEMAP_CHUNK_SIZE + gx] != UNREACHABLE)
+		best = p->start_dist[gy * TILEMAP_CHUNK_SIZE + gx];
+
+	for (int i = 0; i < start->node_count; i++) {
+		uint16_t d = p->start_dist[start->nodes[i].y * TILEMAP_CHUNK_SIZE + start->nodes[i].x];
+		if (d != UNREACHABLE)
+			relax(p, sc * CLUSTER_NODES + i, d, -1, r->x1, r->y1);
+	}
+
+	while (p->open_count > 0) {
+		PathOpen e = pop_open(p);
+		if (e.f >= best)
+			break;
+
+		PathRecord *record = get_record(p, e.key);
+		if (record->closed || e.g > record->g)
+			continue;
+		record->closed = 1;
+		p->nodes_expanded++;
+
+		int index = e.key / CLUSTER_NODES;
+		int node = e.key % CLUSTER_NODES;
+		PathCluster *c = &p->clusters[index];
+
+		if (index == gc) {
+			uint16_t d = p->goal_dist[c->nodes[node].y * TILEMAP_CHUNK_SIZE + c->nodes[node].x];
+			if (d != UNREACHABLE && e.g + d < best) {
+				best = e.g + d;
+				best_parent = e.key;
+			}
+		}
+
+		for (int j = 0; j < c->node_count; j++) {
+			uint16_t d = c->dist[node * c->node_count + j];
+			if (j != node && d != UNREACHABLE)
+				relax(p, index * CLUSTER_NODES + j, e.g + d, e.key, r->x1, r->y1);
+		}
+
+		int other = partner(p, e.key);
+		if (other >= 0)
+			relax(p, other, e.g + 1, e.key, r->x1, r->y1);
+	}
+
+	if (best == INT_MAX)
+		return;
+
+	int count = 0;
+	for (int key = best_parent; key >= 0; key = get_record(p, key)->parent) {
+		if (count == p->route_capacity) {
+			p->route_capacity = p->route_capacity ? p->route_capacity * 2 : 64;
+			p->route = realloc(p->route, sizeof(int) * p->route_capacity);
+		}
+		p->route[count++] = key;
+	}
+
+	// Refine the entrances into tiles, only inside the clusters the path goes through.
+	int capacity = 0;
+	int x = r->x0;
+	int y = r->y0;
+	path->found = 1;
+	push_point(path, &capacity, x, y);
+
+	for (int i = count - 1; i >= 0; i--) {
+		int nx, ny;
+		node_position(p, p->route[i], &nx, &ny);
+		if (nx == x && ny == y)
+			continue;
+
+		if (cluster_of(p, nx, ny) == cluster_of(p, x, y))
+			local_path(p, cluster_of(p, x, y), x, y, nx, ny, path, &capacity);
+		else
+			push_point(path, &capacity, nx, ny);
+		x = nx;
+		y = ny;
+	}
+
+	local_path(p, gc, x, y, r->x1, r->y1, path, &capacity);
+}
+
+static void run_batch(TilemapPaths *p) {
+	Uint64 start = SDL_GetPerformanceCounter();
+	p->nodes_expanded = 0;
+
+	for (int i = 0; i < p->batch_count; i++)
+		search(p, &p->batch[i]);
+
+	p->batch_ms = (double)(SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency();
+}
+
+static void batch_job(void *data) {
+	run_batch(data);
+}
+
+static TilemapPaths *create_paths(Tilemap *t) {
+	Uint64 start = SDL_GetPerformanceCounter();
+	int count = t->chunks_w * t->chunks_h;
+
+	TilemapPaths *p = malloc(sizeof(TilemapPaths));
+	memset(p, 0, sizeof(TilemapPaths));
+	p->w = t->w;
+	p->h = t->h;
+	p->chunks_w = t->chunks_w;
+	p->chunks_h = t->chunks_h;
+	p->clusters = malloc(sizeof(PathCluster) * count);
+	memset(p->clusters, 0, sizeof(PathCluster) * count);
+	p->changed = malloc(sizeof(int) * count);
+	t->path_chunks = malloc(sizeof(int) * count);
+
+	// All the walkable bits first, the entrances of a cluster depend on the clusters around. Pending
+	// chunks are left unwalkable, loading them all would defeat the lazy loading. Once loaded they
+	// are marked path_dirty and rebuilt like any other change.
+	for (int i = 0; i < count; i++) {
+		if (!t->chunks[i].pending)
+			update_walk(t, p, i);
+	}
+	for (int i = 0; i < count; i++)
+		build_cluster(p, i);
+
+	double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency();
+	engine_log_info("Built the path clusters of a %dx%d tilemap in %.1f ms", t->w, t->h, ms);
+
+	return p;
+}
+
+int engine_tilemap_find_path(Tilemap *t, int x0, int y0, int x1, int y1, TILEMAP_PATH_FN fn, void *data) {
+	if (!t->paths)
+		t->paths = create_paths(t);
+
+	// The clusters of the start and goal are rebuilt before the batch is searched if they load now.
+	engine_tilemap_load_rect(t, (Rect2Di){x0, y0, 1, 1});
+	engine_tilemap_load_rect(t, (Rect2Di){x1, y1, 1, 1});
+
+	TilemapPaths *p = t->paths;
+	if (p->queued_count == p->queued_capacity) {
+		p->queued_capacity = p->queued_capacity ? p->queued_capacity * 2 : 16;
+		p->queued = realloc(p->queued, sizeof(PathRequest) * p->queued_capacity);
+	}
+
+	PathRequest *r = &p->queued[p->queued_count++];
+	memset(r, 0, sizeof(PathRequest));
+	r->id = ++p->next_id;
+	r->x0 = x0;
+	r->y0 = y0;
+	r->x1 = x1;
+	r->y1 = y1;
+	r->fn = fn;
+	r->data = data;
+
+	return r->id;
+}
+
+// Rebuilds the clusters whose walkable tiles changed and the ones around, their borders changed too.
+static void rebuild_changed(Tilemap *t, TilemapPaths *p) {
+	Uint64 start = SDL_GetPerformanceCounter();
+	int changed = 0;
+
+	for (int i = 0; i < t->path_chunk_count; i++) {
+		int index = t->path_chunks[i];
+		t->chunks[index].path_dirty = 0;
+		if (update_walk(t, p, index))
+			p->changed[changed++] = index;
+	}
+	t->path_chunk_count = 0;
+
+	p->stamp++;
+	unsigned int rebuilt = 0;
+	for (int i = 0; i < changed; i++) {
+		int index = p->changed[i];
+		int cx = index % p->chunks_w;
+		int cy = index / p->chunks_w;
+
+		for (int y = SDL_max(0, cy - 1); y <= SDL_min(p->chunks_h - 1, cy + 1); y++) {
+			for (int x = SDL_max(0, cx - 1); x <= SDL_min(p->chunks_w - 1, cx + 1); x++) {
+				PathCluster *c = &p->clusters[y * p->chunks_w + x];
+				if ((x != cx && y != cy) || c->stamp == p->stamp)
+					continue;
+				c->stamp = p->stamp;
+				build_cluster(p, y * p->chunks_w + x);
+				rebuilt++;
+			}
+		}
+	}
+
+	t->path_stats.clusters_rebuilt = rebuilt;
+	t->path_stats.rebuild_ms = (double)(SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency();
+}
+
+void engine_tilemap_update_paths(Tilemap *t) {
+	TilemapPaths *p = t->paths;
+
+	if (p->busy) {
+		engine_jobs_wait(&p->batch_job);
+		p->busy = 0;
+
+		TilemapPathStats *stats = &t->path_stats;
+		stats->requests = p->batch_count;
+		stats->nodes_expanded = p->nodes_expanded;
+		stats->batch_ms = p->batch_ms;
+
+		for (int i = 0; i < p->batch_count; i++) {
+			PathRequest *r = &p->batch[i];
+			r->fn(t, r->id, &r->path, r->data);
+			free(r->path.points);
+		}
+		p->batch_count = 0;
+	}
+
+	// The job is done, the clusters can change.
+	rebuild_changed(t, p);
+
+	if (p->queued_count == 0)
+		return;
+
+	PathRequest *batch = p->batch;
+	int capacity = p->batch_capacity;
+	p->batch = p->queued;
+	p->batch_count = p->queued_count;
+	p->batch_capacity = p->queued_capacity;
+	p->queued = batch;
+	p->queued_count = 0;
+	p->queued_capacity = capacity;
+
+	p->busy = 1;
+	engine_jobs_run(batch_job, p, &p->batch_job);
+}
+
+void engine_tilemap_free_paths(Tilemap *t) {
+	TilemapPaths *p = t->paths;
+
+	if (p->busy)
+		engine_jobs_wait(&p->batch_job);
+	for (int i = 0; i < p->batch_count; i++)
+		free(p->batch[i].path.points);
+
+	for (int i = 0; i < t->chunks_w * t->chunks_h; i++)
+		free(p->clusters[i].dist);
+
+	free(p->clusters);
+	free(p->changed);
+	free(p->queued);
+	free(p->batch);
+	free(p->records);
+	free(p->open);
+	free(p->route);
+	free(p);
+	free(t->path_chunks);
+	t->paths = NULL;
+}
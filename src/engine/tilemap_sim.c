@@ -0,0 +1,284 @@
+#include "tilemap.h"
+#include <SDL.h>
+#include <string.h>
+
+// Steps a fire tile burns before turning into air.
+#define FIRE_LIFETIME 90
+// One in n chance per step for fire to spread to a neighbour coal tile.
+#define FIRE_SPREAD_CHANCE 8
+// Lava only flows one in n steps.
+#define LAVA_VISCOSITY 3
+
+typedef struct SimContext {
+	Tilemap *t;
+	uint8_t *flags;
+	uint8_t *lifetime;
+	float *temperature; // NULL until heat is diffused.
+	unsigned int tick;
+} SimContext;
+
+// Deterministic per cell and step, so a step only depends on the map.
+static uint32_t cell_random(int x, int y, unsigned int tick) {
+	uint32_t h = (uint32_t)x * 0x8da6b343u ^ (uint32_t)y * 0xd8163841u ^ tick * 0xcb1ab31fu;
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return h;
+}
+
+static int in_bounds(Tilemap *t, int x, int y) {
+	return x >= 0 && y >= 0 && x < t->w && y < t->h;
+}
+
+static TileType type_at(Tilemap *t, int x, int y) {
+	if (!in_bounds(t, x, y))
+		return TILE_ROCK;
+	return t->tiles[y * t->w + x].type;
+}
+
+static void write_cell(SimContext *ctx, int x, int y, TileType type, uint8_t lifetime) {
+	int i = y * ctx->t->w + x;
+	ctx->t->tiles[i].type = type;
+	ctx->lifetime[i] = lifetime;
+	ctx->flags[i] |= TILE_FLAG_MOVED;
+	engine_tilemap_mark_dirty(ctx->t, (Rect2Di){x, y, 1, 1});
+}
+
+static void swap_cells(SimContext *ctx, int x1, int y1, int x2, int y2) {
+	int a = y1 * ctx->t->w + x1;
+	int b = y2 * ctx->t->w + x2;
+	TileType type = ctx->t->tiles[a].type;
+	uint8_t lifetime = ctx->lifetime[a];
+	write_cell(ctx, x1, y1, ctx->t->tiles[b].type, ctx->lifetime[b]);
+	write_cell(ctx, x2, y2, type, lifetime);
+
+	// Falling tiles take their heat with them.
+	if (ctx->temperature) {
+		float temperature = ctx->temperature[a];
+		ctx->temperature[a] = ctx->temperature[b];
+		ctx->temperature[b] = temperature;
+	}
+}
+
+// Keeps a tile that did not change awake, e.g. fire that is still burning.
+static void stay_awake(SimContext *ctx, int x, int y) {
+	engine_tilemap_wake(ctx->t, (Rect2Di){x, y, 1, 1});
+}
+
+static int is_liquid_or_air(TileType type) {
+	return type == TILE_AIR || type == TILE_WATER;
+}
+
+// Tries to move the tile to (x + dx, y + dy) when the destination is one of the allowed types.
+static int try_move(SimContext *ctx, int x, int y, int dx, int dy, int (*allowed)(TileType)) {
+	int nx = x + dx;
+	int ny = y + dy;
+	if (!in_bounds(ctx->t, nx, ny) || (ctx->flags[ny * ctx->t->w + nx] & TILE_FLAG_MOVED))
+		return 0;
+	if (!allowed(type_at(ctx->t, nx, ny)))
+		return 0;
+	swap_cells(ctx, x, y, nx, ny);
+	return 1;
+}
+
+static int is_air(TileType type) {
+	return type == TILE_AIR;
+}
+
+static void update_sand(SimContext *ctx, int x, int y) {
+	int dir = cell_random(x, y, ctx->tick) & 1 ? 1 : -1;
+
+	// Sand sinks through water.
+	if (try_move(ctx, x, y, 0, 1, is_liquid_or_air))
+		return;
+	if (try_move(ctx, x, y, dir, 1, is_liquid_or_air))
+		return;
+	try_move(ctx, x, y, -dir, 1, is_liquid_or_air);
+}
+
+static int update_liquid(SimContext *ctx, int x, int y) {
+	int dir = cell_random(x, y, ctx->tick) & 1 ? 1 : -1;
+
+	return try_move(ctx, x, y, 0, 1, is_air) ||
+		   try_move(ctx, x, y, dir, 1, is_air) ||
+		   try_move(ctx, x, y, -dir, 1, is_air) ||
+		   try_move(ctx, x, y, dir, 0, is_air) ||
+		   try_move(ctx, x, y, -dir, 0, is_air);
+}
+
+static const int neighbours[4][2] = {{0, 1}, {1, 0}, {0, -1}, {-1, 0}};
+
+static void update_lava(SimContext *ctx, int x, int y) {
+	int reacted = 0;
+
+	for (int i = 0; i < 4; i++) {
+		int nx = x + neighbours[i][0];
+		int ny = y + neighbours[i][1];
+		TileType type = type_at(ctx->t, nx, ny);
+
+		if (type == TILE_WATER) {
+			// The water boils away and the lava cools down.
+			write_cell(ctx, nx, ny, TILE_AIR, 0);
+			write_cell(ctx, x, y, TILE_ROCK, 0);
+			return;
+		} else if (type == TILE_COAL) {
+			write_cell(ctx, nx, ny, TILE_FIRE, 0);
+			reacted = 1;
+		}
+	}
+
+	if ((cell_random(x, y, ctx->tick) >> 8) % LAVA_VISCOSITY == 0) {
+		if (update_liquid(ctx, x, y))
+			return;
+	} else if (type_at(ctx->t, x, y + 1) == TILE_AIR || type_at(ctx->t, x - 1, y) == TILE_AIR ||
+			   type_at(ctx->t, x + 1, y) == TILE_AIR) {
+		// Could flow, try again in the next steps.
+		reacted = 1;
+	}
+
+	if (reacted)
+		stay_awake(ctx, x, y);
+}
+
+static void update_fire(SimContext *ctx, int x, int y) {
+	int i = y * ctx->t->w + x;
+	uint32_t r = cell_random(x, y, ctx->tick);
+
+	// Fire written with engine_tilemap_set has no lifetime yet.
+	if (ctx->lifetime[i] == 0)
+		ctx->lifetime[i] = FIRE_LIFETIME + r % (FIRE_LIFETIME / 2);
+
+	for (int n = 0; n < 4; n++) {
+		int nx = x + neighbours[n][0];
+		int ny = y + neighbours[n][1];
+		TileType type = type_at(ctx->t, nx, ny);
+
+		if (type == TILE_WATER) {
+			write_cell(ctx, x, y, TILE_AIR, 0);
+			return;
+		} else if (type == TILE_COAL && (r >> (8 + n * 3)) % FIRE_SPREAD_CHANCE == 0) {
+			write_cell(ctx, nx, ny, TILE_FIRE, 0);
+		}
+	}
+
+	if (--ctx->lifetime[i] == 0) {
+		write_cell(ctx, x, y, TILE_AIR, 0);
+		return;
+	}
+
+	stay_awake(ctx, x, y);
+}
+
+static void update_cell(SimContext *ctx, int x, int y) {
+	int i = y * ctx->t->w + x;
+
+	if (ctx->flags[i] & TILE_FLAG_MOVED)
+		return;
+
+	switch (ctx->t->tiles[i].type) {
+	case TILE_SAND:
+		update_sand(ctx, x, y);
+		break;
+	case TILE_WATER:
+		update_liquid(ctx, x, y);
+		break;
+	case TILE_LAVA:
+		update_lava(ctx, x, y);
+		break;
+	case TILE_FIRE:
+		update_fire(ctx, x, y);
+		break;
+	default:
+		break;
+	}
+}
+
+static void update_chunk(void *data, int index) {
+	SimContext *ctx = data;
+	Tilemap *t = ctx->t;
+	TileChunk *chunk = &t->chunks[t->sim_chunks[index]];
+	Rect2Di *r = &chunk->sim;
+	// Alternate the horizontal direction so liquids do not drift to one side.
+	int left_to_right = ctx->tick & 1;
+
+	// Bottom to top, so a falling column moves in a single step.
+	for (int y = r->y + r->h - 1; y >= r->y; y--) {
+		for (int i = 0; i < r->w; i++) {
+			int x = left_to_right ? r->x + i : r->x + r->w - 1 - i;
+			update_cell(ctx, x, y);
+		}
+	}
+
+	chunk->sim_cells = r->w * r->h;
+}
+
+// Every moved tile woke itself up, so clearing the next awake area clears all the flags.
+static void clear_flags(void *data, int index) {
+	SimContext *ctx = data;
+	Tilemap *t = ctx->t;
+	Rect2Di *r = &t->chunks[t->sim_chunks[index]].sim_next;
+
+	for (int y = r->y; y < r->y + r->h; y++) {
+		uint8_t *row = ctx->flags + y * t->w + r->x;
+		for (int x = 0; x < r->w; x++)
+			row[x] &= ~TILE_FLAG_MOVED;
+	}
+}
+
+void engine_tilemap_simulate(Tilemap *t) {
+	Uint64 start = SDL_GetPerformanceCounter();
+	int chunk_count = t->chunks_w * t->chunks_h;
+
+	SimContext ctx;
+	ctx.t = t;
+	ctx.flags = engine_tilemap_layer(t, TILE_LAYER_FLAGS);
+	ctx.lifetime = engine_tilemap_layer(t, TILE_LAYER_LIFETIME);
+	ctx.temperature = t->layers[TILE_LAYER_TEMPERATURE];
+	ctx.tick = t->sim_tick++;
+
+	engine_tilemap_load_awake(t);
+
+	unsigned int active = 0;
+	for (int i = 0; i < chunk_count; i++) {
+		TileChunk *chunk = &t->chunks[i];
+		chunk->sim = chunk->sim_next;
+		chunk->sim_next.w = 0;
+		chunk->sim_cells = 0;
+		if (chunk->sim.w != 0)
+			active++;
+	}
+
+	// A chunk only touches the tiles next to it, chunks of the same phase are two chunks apart.
+	// Phases go bottom to top, like the rows inside a chunk.
+	for (int phase = 0; phase < 4; phase++) {
+		int n = 0;
+		for (int cy = t->chunks_h - 1 - (phase >> 1); cy >= 0; cy -= 2) {
+			for (int cx = phase & 1; cx < t->chunks_w; cx += 2) {
+				int index = cy * t->chunks_w + cx;
+				if (t->chunks[index].sim.w != 0)
+					t->sim_chunks[n++] = index;
+			}
+		}
+		engine_jobs_for(n, update_chunk, &ctx);
+	}
+
+	unsigned long cells = 0;
+	int n = 0;
+	for (int i = 0; i < chunk_count; i++) {
+		cells += t->chunks[i].sim_cells;
+		if (t->chunks[i].sim_next.w != 0)
+			t->sim_chunks[n++] = i;
+	}
+	engine_jobs_for(n, clear_flags, &ctx);
+
+	double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+	TilemapSimStats *stats = &t->sim_stats;
+	stats->steps++;
+	stats->threads = engine_jobs_thread_count();
+	stats->active_chunks = active;
+	stats->cells_updated = cells;
+	stats->step_ms = seconds * 1000;
+	stats->cells_per_second = seconds > 0 ? cells / seconds : 0;
+}
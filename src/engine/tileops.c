@@ -0,0 +1,306 @@
+#include "tileops.h"
+#include <SDL.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define TILEOPS_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TILEOPS_X86 0
+#endif
+
+typedef struct TileKernels {
+	const char *name;
+	size_t (*replace)(uint8_t *p, size_t n, uint8_t from, uint8_t to);
+	size_t (*count)(const uint8_t *p, size_t n, uint8_t type);
+	void (*histogram)(const uint8_t *p, size_t n, unsigned long *hist);
+} TileKernels;
+
+static size_t replace_scalar(uint8_t *p, size_t n, uint8_t from, uint8_t to) {
+	size_t count = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (p[i] == from) {
+			p[i] = to;
+			count++;
+		}
+	}
+	return count;
+}
+
+static size_t count_scalar(const uint8_t *p, size_t n, uint8_t type) {
+	size_t count = 0;
+	for (size_t i = 0; i < n; i++)
+		count += p[i] == type;
+	return count;
+}
+
+static void histogram_scalar(const uint8_t *p, size_t n, unsigned long *hist) {
+	for (size_t i = 0; i < n; i++) {
+		if (p[i] < NUM_TILE_TYPES)
+			hist[p[i]]++;
+	}
+}
+
+static const TileKernels scalar_kernels = {"scalar", replace_scalar, count_scalar, histogram_scalar};
+
+#if TILEOPS_X86
+
+// Byte counters overflow after 255 additions, they are summed up before that.
+#define MAX_BYTE_ADDS 255
+
+TARGET_SSE2 static size_t replace_sse2(uint8_t *p, size_t n, uint8_t from, uint8_t to) {
+	__m128i vfrom = _mm_set1_epi8((char)from);
+	__m128i vto = _mm_set1_epi8((char)to);
+	size_t count = 0;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		__m128i m = _mm_cmpeq_epi8(v, vfrom);
+		int mask = _mm_movemask_epi8(m);
+		if (mask) {
+			v = _mm_or_si128(_mm_andnot_si128(m, v), _mm_and_si128(m, vto));
+			_mm_storeu_si128((__m128i *)(p + i), v);
+			count += __builtin_popcount(mask);
+		}
+	}
+
+	return count + replace_scalar(p + i, n - i, from, to);
+}
+
+TARGET_SSE2 static size_t sum_bytes_sse2(__m128i acc) {
+	__m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+	return (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_extract_epi16(sums, 4);
+}
+
+TARGET_SSE2 static size_t count_sse2(const uint8_t *p, size_t n, uint8_t type) {
+	__m128i needle = _mm_set1_epi8((char)type);
+	size_t count = 0;
+	size_t i = 0;
+
+	while (i + 16 <= n) {
+		size_t end = SDL_min(n, i + 16 * MAX_BYTE_ADDS);
+		__m128i acc = _mm_setzero_si128();
+
+		// Matches are -1, subtracting them counts them.
+		for (; i + 16 <= end; i += 16)
+			acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), needle));
+
+		count += sum_bytes_sse2(acc);
+	}
+
+	return count + count_scalar(p + i, n - i, type);
+}
+
+TARGET_SSE2 static void histogram_sse2(const uint8_t *p, size_t n, unsigned long *hist) {
+	size_t i = 0;
+
+	while (i + 16 <= n) {
+		size_t end = SDL_min(n, i + 16 * MAX_BYTE_ADDS);
+		__m128i acc[NUM_TILE_TYPES];
+		for (int t = 0; t < NUM_TILE_TYPES; t++)
+			acc[t] = _mm_setzero_si128();
+
+		for (; i + 16 <= end; i += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+			for (int t = 0; t < NUM_TILE_TYPES; t++)
+				acc[t] = _mm_sub_epi8(acc[t], _mm_cmpeq_epi8(v, _mm_set1_epi8((char)t)));
+		}
+
+		for (int t = 0; t < NUM_TILE_TYPES; t++)
+			hist[t] += sum_bytes_sse2(acc[t]);
+	}
+
+	histogram_scalar(p + i, n - i, hist);
+}
+
+static const TileKernels sse2_kernels = {"sse2", replace_sse2, count_sse2, histogram_sse2};
+
+TARGET_AVX2 static size_t replace_avx2(uint8_t *p, size_t n, uint8_t from, uint8_t to) {
+	__m256i vfrom = _mm256_set1_epi8((char)from);
+	__m256i vto = _mm256_set1_epi8((char)to);
+	size_t count = 0;
+	size_t i = 0;
+
+	for (; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+		__m256i m = _mm256_cmpeq_epi8(v, vfrom);
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8(m);
+		if (mask) {
+			_mm256_storeu_si256((__m256i *)(p + i), _mm256_blendv_epi8(v, vto, m));
+			count += __builtin_popcount(mask);
+		}
+	}
+
+	return count + replace_sse2(p + i, n - i, from, to);
+}
+
+TARGET_AVX2 static size_t sum_bytes_avx2(__m256i acc) {
+	__m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+	return (size_t)_mm256_extract_epi64(sums, 0) + (size_t)_mm256_extract_epi64(sums, 1) +
+		   (size_t)_mm256_extract_epi64(sums, 2) + (size_t)_mm256_extract_epi64(sums, 3);
+}
+
+TARGET_AVX2 static size_t count_avx2(const uint8_t *p, size_t n, uint8_t type) {
+	__m256i needle = _mm256_set1_epi8((char)type);
+	size_t count = 0;
+	size_t i = 0;
+
+	while (i + 32 <= n) {
+		size_t end = SDL_min(n, i + 32 * MAX_BYTE_ADDS);
+		__m256i acc = _mm256_setzero_si256();
+
+		for (; i + 32 <= end; i += 32)
+			acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), needle));
+
+		count += sum_bytes_avx2(acc);
+	}
+
+	return count + count_sse2(p + i, n - i, type);
+}
+
+TARGET_AVX2 static void histogram_avx2(const uint8_t *p, size_t n, unsigned long *hist) {
+	size_t i = 0;
+
+	while (i + 32 <= n) {
+		size_t end = SDL_min(n, i + 32 * MAX_BYTE_ADDS);
+		__m256i acc[NUM_TILE_TYPES];
+		for (int t = 0; t < NUM_TILE_TYPES; t++)
+			acc[t] = _mm256_setzero_si256();
+
+		for (; i + 32 <= end; i += 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+			for (int t = 0; t < NUM_TILE_TYPES; t++)
+				acc[t] = _mm256_sub_epi8(acc[t], _mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)t)));
+		}
+
+		for (int t = 0; t < NUM_TILE_TYPES; t++)
+			hist[t] += sum_bytes_avx2(acc[t]);
+	}
+
+	histogram_sse2(p + i, n - i, hist);
+}
+
+static const TileKernels avx2_kernels = {"avx2", replace_avx2, count_avx2, histogram_avx2};
+
+#endif
+
+static const TileKernels *kernels = NULL;
+
+static const TileKernels *get_kernels() {
+	if (!kernels) {
+		kernels = &scalar_kernels;
+#if TILEOPS_X86
+		if (SDL_HasAVX2())
+			kernels = &avx2_kernels;
+		else if (SDL_HasSSE2())
+			kernels = &sse2_kernels;
+#endif
+	}
+	return kernels;
+}
+
+const char *engine_tileops_kernel() {
+	return get_kernels()->name;
+}
+
+void engine_tileops_fill(Tile *tiles, size_t n, TileType type) {
+	// Tiles are bytes, memset is already vectorized.
+	memset(tiles, type, sizeof(Tile) * n);
+}
+
+size_t engine_tileops_replace(Tile *tiles, size_t n, TileType from, TileType to) {
+	return get_kernels()->replace(&tiles->type, n, from, to);
+}
+
+size_t engine_tileops_count(const Tile *tiles, size_t n, TileType type) {
+	return get_kernels()->count(&tiles->type, n, type);
+}
+
+void engine_tileops_histogram(const Tile *tiles, size_t n, unsigned long *hist) {
+	get_kernels()->histogram(&tiles->type, n, hist);
+}
+
+// Clips r to the map, returns 0 if nothing is left.
+static int clip_rect(Tilemap *t, Rect2Di *r) {
+	int x0 = SDL_max(0, r->x);
+	int y0 = SDL_max(0, r->y);
+	int x1 = SDL_min(t->w, r->x + r->w);
+	int y1 = SDL_min(t->h, r->y + r->h);
+
+	if (x0 >= x1 || y0 >= y1)
+		return 0;
+
+	*r = (Rect2Di){x0, y0, x1 - x0, y1 - y0};
+	return 1;
+}
+
+// Zeroes the lifetime of the tiles of type from. Branchless, so the compiler can vectorize it.
+static void reset_lifetime(const Tile *tiles, uint8_t *lifetime, int n, TileType from) {
+	for (int i = 0; i < n; i++)
+		lifetime[i] = tiles[i].type == from ? 0 : lifetime[i];
+}
+
+size_t engine_tilemap_replace_rect(Tilemap *t, Rect2Di r, TileType from, TileType to) {
+	if (!clip_rect(t, &r))
+		return 0;
+
+	engine_tilemap_load_rect(t, r);
+
+	// Replaced tiles start a new life, as with set_rect. Done before the replace, while the old
+	// types are still there.
+	uint8_t *lifetime = t->layers[TILE_LAYER_LIFETIME];
+	if (lifetime && from != to) {
+		for (int y = r.y; y < r.y + r.h; y++)
+			reset_lifetime(&t->tiles[y * t->w + r.x], &lifetime[y * t->w + r.x], r.w, from);
+	}
+
+	size_t count = 0;
+	if (r.w == t->w) {
+		count = engine_tileops_replace(&t->tiles[r.y * t->w], (size_t)r.w * r.h, from, to);
+	} else {
+		for (int y = r.y; y < r.y + r.h; y++)
+			count += engine_tileops_replace(&t->tiles[y * t->w + r.x], r.w, from, to);
+	}
+
+	if (count)
+		engine_tilemap_mark_dirty(t, r);
+
+	return count;
+}
+
+size_t engine_tilemap_count_rect(Tilemap *t, Rect2Di r, TileType type) {
+	if (!clip_rect(t, &r))
+		return 0;
+
+	engine_tilemap_load_rect(t, r);
+
+	// A rect as wide as the map is one span.
+	if (r.w == t->w)
+		return engine_tileops_count(&t->tiles[r.y * t->w], (size_t)r.w * r.h, type);
+
+	size_t count = 0;
+	for (int y = r.y; y < r.y + r.h; y++)
+		count += engine_tileops_count(&t->tiles[y * t->w + r.x], r.w, type);
+
+	return count;
+}
+
+void engine_tilemap_histogram_rect(Tilemap *t, Rect2Di r, unsigned long *hist) {
+	memset(hist, 0, sizeof(unsigned long) * NUM_TILE_TYPES);
+
+	if (!clip_rect(t, &r))
+		return;
+
+	engine_tilemap_load_rect(t, r);
+
+	if (r.w == t->w) {
+		engine_tileops_histogram(&t->tiles[r.y * t->w], (size_t)r.w * r.h, hist);
+		return;
+	}
+
+	for (int y = r.y; y < r.y + r.h; y++)
+		engine_tileops_histogram(&t->tiles[y * t->w + r.x], r.w, hist);
+}
@@ -0,0 +1,29 @@
+#ifndef ENGINE_TILEOPS_H
+#define ENGINE_TILEOPS_H
+
+#include <engine/tilemap.h>
+#include <stddef.h>
+
+// Bulk operations over spans of tiles. The SSE2 or AVX2 kernels are picked at runtime,
+// with a scalar fallback when neither is available.
+
+void engine_tileops_fill(Tile *tiles, size_t n, TileType type);
+
+// Returns the count of replaced tiles.
+size_t engine_tileops_replace(Tile *tiles, size_t n, TileType from, TileType to);
+
+size_t engine_tileops_count(const Tile *tiles, size_t n, TileType type);
+
+// Adds the count of each type to hist, which has NUM_TILE_TYPES elements.
+void engine_tileops_histogram(const Tile *tiles, size_t n, unsigned long *hist);
+
+// Name of the kernels in use: "avx2", "sse2" or "scalar".
+const char *engine_tileops_kernel();
+
+// Rect versions over a tilemap, the rect is clipped to the map.
+
+size_t engine_tilemap_replace_rect(Tilemap *t, Rect2Di r, TileType from, TileType to);
+size_t engine_tilemap_count_rect(Tilemap *t, Rect2Di r, TileType type);
+void engine_tilemap_histogram_rect(Tilemap *t, Rect2Di r, unsigned long *hist);
+
+#endif
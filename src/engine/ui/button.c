@@ -2,15 +2,22 @@
 #include <engine/graphics/renderer.h>
 #include <engine/input.h>
 #include <engine/logger.h>
+#include <engine/memory.h>
 #include <engine/util.h>
 #include <stdlib.h>
 #include <string.h>
 
-Button *engine_button_create(unsigned int w, unsigned int h, int pt, int style, const char *text,
+static void on_render(Entity *entity, double delta);
+static void on_mouse_button_up(Entity *entity, unsigned char button_code, int x, int y);
+static void on_free(Entity *entity);
+
+static MemoryPool button_pool = MEMORY_POOL(Button, 32);
+
+Button *engine_ui_button_create(unsigned int w, unsigned int h, int pt, int style, const char *text,
 							 BUTTON_ON_CLICK_FN on_click, Color fg, Color bg) {
 	Button *button;
 
-	button = malloc(sizeof(Button));
+	button = MEMORY_POOL_NEW(&button_pool, Button);
 	memset(button, 0, sizeof(Button));
 
 	button->entity.render_priority = 1000;
@@ -19,6 +26,7 @@ Button *engine_button_create(unsigned int w, unsigned int h, int pt, int style,
 	button->entity.on_free = on_free;
 
 	button->rect = (Rect2Df){0, 0, w, h};
+	button->entity.bounds = &button->rect;
 
 	button->on_click = on_click;
 
@@ -53,45 +61,23 @@ static void on_render(Entity *entity, double delta) {
 		button->textpt, button->textStyle, button->pText,
 		(int)(button->rect.x + (button->rect.w - button->textSizeW) / 2.f),
 		(int)(button->rect.y + (button->rect.h - button->textSizeH) / 2.f));
-
-	engine_render_text_color_s(COLOR_BLACK);
-	Rect2Df rect;
-	float w, h;
-
-	const char *text = "Testing\nend";
-	engine_render_text_size(text, 20, STYLE_REGULAR, &w, &h);
-
-	rect.x = 30;
-	rect.y = 30;
-	rect.w = w;
-	rect.h = h;
-
-	engine_render_color_s(COLOR_RED);
-	engine_render_rect_s(&rect, 0);
-	engine_render_text(20, STYLE_REGULAR, text, 30, 30);
-
-	const char *text2 = "testTing";
-	engine_render_text_size(text2, 20, STYLE_REGULAR, &w, &h);
-
-	rect.x = 120;
-	rect.y = 30;
-	rect.w = w;
-	rect.h = h;
-
-	engine_render_color_s(COLOR_RED);
-	engine_render_rect_s(&rect, 0);
-	engine_render_text(20, STYLE_REGULAR, text2, 120, 30);
 }
 
 static void on_mouse_button_up(Entity *entity, unsigned char button_code, int x, int y) {
 	Button *button = (Button *)entity;
-	if (button->on_click && button_code == BUTTON_LEFT && engine_math_mouse_in_rect2df(&button->rect)) {
+	// Only called for clicks inside the bounds. The other buttons go through to what is below.
+	if (button_code != BUTTON_LEFT)
+		return;
+
+	if (button->on_click)
 		button->on_click();
-	}
+
+	// Whatever is below the button doesn't get the click.
+	engine_entity_stop_event();
 }
 
 static void on_free(Entity *entity) {
 	Button *button = (Button *)entity;
 	free(button->pText);
-	free(button);
+	engine_memory_pool_free(&button_pool, button);
 }
@@ -11,7 +11,7 @@ typedef void (*BUTTON_ON_CLICK_FN)();
 
 typedef struct Button {
 	Entity entity;
-	Rect2Df rect;
+	Rect2Df rect; // The bounds, changes are picked up by the next engine_entity_flush.
 	float textSizeW, textSizeH;
 	int textpt;
 	int textStyle;
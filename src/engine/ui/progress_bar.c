@@ -1,10 +1,17 @@
 #include "progress_bar.h"
 #include <engine/graphics/renderer.h>
 #include <engine/logger.h>
+#include <engine/memory.h>
 #include <math.h>
 
+static void on_render(Entity *entity, double delta);
+static void on_update(Entity *entity, double delta);
+static void on_free(Entity *entity);
+
+static MemoryPool progressbar_pool = MEMORY_POOL(ProgressBar, 16);
+
 ProgressBar *engine_ui_progressbar_create(int w, int h, Color bg, Color start, Color end) {
-	ProgressBar *p = malloc(sizeof(ProgressBar));
+	ProgressBar *p = MEMORY_POOL_NEW(&progressbar_pool, ProgressBar);
 
 	memset(p, 0, sizeof(ProgressBar));
 
@@ -14,6 +21,7 @@ ProgressBar *engine_ui_progressbar_create(int w, int h, Color bg, Color start, C
 	p->entity.on_free = on_free;
 
 	p->rect = (Rect2Df){0, 0, w, h};
+	p->entity.bounds = &p->rect;
 	p->bg = bg;
 	p->start = start;
 	p->end = end;
@@ -30,7 +38,7 @@ ProgressBar *engine_ui_progressbar_create(int w, int h, Color bg, Color start, C
 
 static void on_free(Entity *entity) {
 	ProgressBar *p = (ProgressBar *)entity;
-	free(p);
+	engine_memory_pool_free(&progressbar_pool, p);
 }
 
 void engine_ui_progressbar_set_progress(ProgressBar *p, double progress) {
@@ -40,11 +48,10 @@ void engine_ui_progressbar_set_progress(ProgressBar *p, double progress) {
 	p->current_animation_time = 0;
 }
 
-static void on_update(Entity *entity) {
+static void on_update(Entity *entity, double delta) {
 	ProgressBar *p = (ProgressBar *)entity;
 
 	if (p->animate) {
-		double delta = engine_util_delta_time();
 		p->current_animation_time += delta;
 
 		if (p->initial_progress < p->next_progress) {
@@ -75,7 +82,7 @@ static void on_update(Entity *entity) {
 		}
 	}
 }
-static void on_render(Entity *entity) {
+static void on_render(Entity *entity, double delta) {
 	ProgressBar *p = (ProgressBar *)entity;
 
 	engine_render_color_s(p->bg);
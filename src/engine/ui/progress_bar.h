@@ -6,7 +6,7 @@
 
 typedef struct ProgressBar {
 	Entity entity;
-	Rect2Df rect;
+	Rect2Df rect; // The bounds, changes are picked up by the next engine_entity_flush.
 	double progress;
 	double initial_progress;
 	double next_progress;
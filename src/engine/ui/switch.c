@@ -1,12 +1,20 @@
 #include "switch.h"
 #include <engine/input.h>
 #include <engine/logger.h>
+#include <engine/memory.h>
 #include <engine/util.h>
 #include <stdlib.h>
 #include <string.h>
 
+static void on_render(Entity *entity, double delta);
+static void on_update(Entity *entity, double delta);
+static void on_mouse_button_up(Entity *entity, unsigned char button_code, int x, int y);
+static void on_free(Entity *entity);
+
+static MemoryPool switch_pool = MEMORY_POOL(Switch, 16);
+
 Switch *engine_ui_switch_create(int w, int h, Color bg, Color offColor, Color onColor) {
-	Switch *s = malloc(sizeof(Switch));
+	Switch *s = MEMORY_POOL_NEW(&switch_pool, Switch);
 
 	memset(s, 0, sizeof(Switch));
 
@@ -17,6 +25,7 @@ Switch *engine_ui_switch_create(int w, int h, Color bg, Color offColor, Color on
 	s->entity.on_free = on_free;
 
 	s->rect = (Rect2Df){0, 0, w, h};
+	s->entity.bounds = &s->rect;
 	s->bg = bg;
 	s->off_color = offColor;
 	s->on_color = onColor;
@@ -31,19 +40,22 @@ Switch *engine_ui_switch_create(int w, int h, Color bg, Color offColor, Color on
 static void on_mouse_button_up(Entity *entity, unsigned char button_code, int x, int y) {
 	Switch *s = (Switch *)entity;
 
-	if (button_code == BUTTON_LEFT && engine_math_mouse_in_rect2df(&s->rect)) {
+	// Only called for clicks inside the bounds.
+	if (button_code == BUTTON_LEFT) {
 		s->animate = 1;
 		s->value = !s->value;
 		if (s->current_animation_time > 0)
 			s->current_animation_time = s->total_animation_time - s->current_animation_time;
 	}
+
+	engine_entity_stop_event();
 }
 
-static void on_update(Entity *entity) {
+static void on_update(Entity *entity, double delta) {
 	Switch *s = (Switch *)entity;
 
 	if (s->animate) {
-		s->current_animation_time += engine_util_delta_time();
+		s->current_animation_time += delta;
 		if (s->current_animation_time >= s->total_animation_time) {
 			s->animate = 0;
 			s->current_animation_time = 0;
@@ -54,10 +66,10 @@ static void on_update(Entity *entity) {
 static void on_free(Entity *entity) {
 	Switch *s = (Switch *)entity;
 
-	free(entity);
+	engine_memory_pool_free(&switch_pool, s);
 }
 
-static void on_render(Entity *entity) {
+static void on_render(Entity *entity, double delta) {
 	Switch *s = (Switch *)entity;
 
 	engine_render_color_s(s->bg);
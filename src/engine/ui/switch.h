@@ -6,7 +6,7 @@
 
 typedef struct Switch {
 	Entity entity;
-	Rect2Df rect;
+	Rect2Df rect; // The bounds, changes are picked up by the next engine_entity_flush.
 	Color bg;
 	Color off_color;
 	Color on_color;
@@ -2,6 +2,8 @@
 #include <engine/graphics/renderer.h>
 #include <engine/input.h>
 #include <engine/logger.h>
+#include <engine/memory.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -11,26 +13,76 @@
 #define CURSOR_BLINK_MS 500
 static Tick next_input_tick = 0;
 
+static MemoryPool textbox_pool = MEMORY_POOL(Textbox, 16);
+
 static void update_input_tick() {
 	next_input_tick = engine_util_tick() + INPUT_DELAY_MS;
 }
 
+// Only one textbox has the focus. The watcher has no bounds and is on top of everything, so it
+// sees every click first and takes the focus away on the ones outside of the focused textbox.
+static Textbox *focused_textbox = NULL;
+static Entity focus_watcher;
+static int focus_watcher_added = 0;
+
+static void set_focused(Textbox *t) {
+	if (focused_textbox)
+		focused_textbox->focused = 0;
+	if (t)
+		t->focused = 1;
+	focused_textbox = t;
+}
+
+static void on_focus_watcher_mouse_button_down(Entity *e, unsigned char button_code, int x, int y) {
+	if (button_code != BUTTON_LEFT || !focused_textbox)
+		return;
+
+	// Half open like the bounds.
+	Rect2Df *r = &focused_textbox->rect;
+	if (x < r->x || x >= r->x + r->w || y < r->y || y >= r->y + r->h)
+		set_focused(NULL);
+}
+
+// Not allocated, only lets it be added again after the entities are freed.
+static void on_focus_watcher_free(Entity *e) {
+	focus_watcher_added = 0;
+}
+
+static void add_focus_watcher() {
+	if (focus_watcher_added)
+		return;
+
+	memset(&focus_watcher, 0, sizeof(Entity));
+	focus_watcher.render_priority = UINT_MAX;
+	focus_watcher.on_mouse_button_down = on_focus_watcher_mouse_button_down;
+	focus_watcher.on_free = on_focus_watcher_free;
+	engine_entity_add(&focus_watcher);
+	focus_watcher_added = 1;
+}
+
 static void on_free(Entity *e) {
 	Textbox *t = (Textbox *)e;
+	if (focused_textbox == t)
+		focused_textbox = NULL;
+
 	free(t->pText);
-	free(t);
+	engine_memory_pool_free(&textbox_pool, t);
 }
 
-static void on_update(Entity *e, double delta) {
+// Only gets the clicks inside of the bounds, the watcher handles the others.
+static void on_mouse_button_down(Entity *e, unsigned char button_code, int x, int y) {
 	Textbox *t = (Textbox *)e;
+	if (button_code != BUTTON_LEFT)
+		return;
 
-	if (!t->focused && engine_math_mouse_in_rect2df(&t->rect) &&
-		engine_input_mouse_click(BUTTON_LEFT)) {
-		t->focused = 1;
-	} else if (!engine_math_mouse_in_rect2df(&t->rect) &&
-			   engine_input_mouse_click(BUTTON_LEFT)) {
-		t->focused = 0;
-	}
+	if (!t->focused)
+		set_focused(t);
+	// Whatever is below the textbox doesn't get the click.
+	engine_entity_stop_event();
+}
+
+static void on_update(Entity *e, double delta) {
+	Textbox *t = (Textbox *)e;
 
 	if (t->focused) {
 		if (engine_util_tick_passed(t->cursor_blink_tick)) {
@@ -93,13 +145,16 @@ static void on_textinput(Entity *e, const char *text) {
 		t->cursor_pos++;
 		t->update_cursor_x = 1;
 	}
+
+	// Only the focused textbox takes the text.
+	engine_entity_stop_event();
 }
 
 static void on_textediting(Entity *e, const char *text, int start, int length) {
 	engine_log_debug("textediting event: '%s' %d %d", text, start, length);
 }
 
-void on_render(Entity *e, double delta) {
+static void on_render(Entity *e, double delta) {
 	Textbox *t = (Textbox *)e;
 
 	engine_render_color_s(t->outline);
@@ -129,11 +184,12 @@ void on_render(Entity *e, double delta) {
 Textbox *engine_ui_textbox_create(int w, int h, int pt, int text_length, Color fg,
 								  Color bg, Color outline) {
 
-	Textbox *textbox = malloc(sizeof(Textbox));
+	Textbox *textbox = MEMORY_POOL_NEW(&textbox_pool, Textbox);
 	memset(textbox, 0, sizeof(Textbox));
 
 	textbox->entity.on_free = on_free;
 	textbox->entity.on_update = on_update;
+	textbox->entity.on_mouse_button_down = on_mouse_button_down;
 	textbox->entity.on_render = on_render;
 	textbox->entity.on_textinput = on_textinput;
 	textbox->entity.on_textediting = on_textediting;
@@ -143,6 +199,7 @@ Textbox *engine_ui_textbox_create(int w, int h, int pt, int text_length, Color f
 	memset(textbox->pText, 0, sizeof(char) * textbox->length);
 
 	textbox->rect = (Rect2Df){0, 0, w, h};
+	textbox->entity.bounds = &textbox->rect;
 	textbox->fg = fg;
 	textbox->bg = bg;
 	textbox->focused = 0;
@@ -159,5 +216,7 @@ Textbox *engine_ui_textbox_create(int w, int h, int pt, int text_length, Color f
 
 	engine_render_text_size_s("|", textbox->text_pt + 10, STYLE_REGULAR, &cursor_size);
 	textbox->cursor_size = cursor_size.y;
+
+	add_focus_watcher();
 	return textbox;
 }
@@ -7,7 +7,7 @@
 
 typedef struct Textbox {
 	Entity entity;
-	Rect2Df rect;
+	Rect2Df rect; // The bounds, changes are picked up by the next engine_entity_flush.
 	float padding;
 	char *pText;
 	int length;
@@ -15,7 +15,7 @@ typedef struct Textbox {
 	Color bg;
 	Color outline;
 	int outline_size;
-	int focused;
+	int focused; // Changed by the clicks, see on_mouse_button_down.
 	int cursor_pos;
 	float cursor_size;
 	int update_cursor_x;
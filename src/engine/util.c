@@ -5,11 +5,14 @@
 #include <engine/settings.h>
 #include <engine/tilemap.h>
 #include <engine/input.h>
+#include <engine/replay.h>
 #include <stdarg.h>
 #include <stdio.h>
 
 static double last_time = 0;
 static double now_time = 0;
+// Time while recording or replaying, it advances a fixed step per tick.
+static double replay_time = 0;
 
 Color engine_util_color(unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
 	return (Color){r, g, b, a};
@@ -26,17 +29,33 @@ void engine_util_screen(Rect2Df *out) {
 void engine_util_update() {
 	last_time = now_time;
 	now_time = SDL_GetPerformanceCounter();
+
+	if (engine_replay_mode() != REPLAY_OFF)
+		replay_time += ENGINE_REPLAY_STEP_MS;
+	else
+		replay_time = 0;
 }
 
-Uint32 engine_util_tick() { return SDL_GetTicks(); }
+Uint32 engine_util_tick() {
+	if (engine_replay_mode() != REPLAY_OFF)
+		return (Uint32)replay_time;
+	return SDL_GetTicks();
+}
 
 int engine_util_tick_passed(Uint32 a) { return SDL_TICKS_PASSED(engine_util_tick(), a); }
 
-double engine_util_delta_time() {
+static double real_delta_time() {
 	return (double)((now_time - last_time) * 1000) / SDL_GetPerformanceFrequency();
 }
 
-double engine_util_fps() { return 1 / (engine_util_delta_time() / 1000); }
+double engine_util_delta_time() {
+	// Fixed, so the ticks don't depend on the frame rate.
+	if (engine_replay_mode() != REPLAY_OFF)
+		return ENGINE_REPLAY_STEP_MS;
+	return real_delta_time();
+}
+
+double engine_util_fps() { return 1 / (real_delta_time() / 1000); }
 
 void engine_util_str_format(char *buf, size_t size, const char *fmt, ...) {
 	SDL_assert(buf);
@@ -0,0 +1,597 @@
+#include "world.h"
+#include <SDL.h>
+#include <engine/io.h>
+#include <engine/logger.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define WORLD_MMAP 1
+#else
+#define WORLD_MMAP 0
+#endif
+
+// Header, little endian:
+//   u32 magic, u32 version, u32 width, u32 height, u32 chunk size, u32 layers, u32 sim tick, u32 chunk count
+// Index, one entry per chunk in chunk order:
+//   u64 offset, u32 size, u32 flags
+// Chunks: the tile types, then each stored layer in TileLayer order, every one of them encoded
+// as runs. A control byte 0x80 | (n - 1) is followed by one element repeated n times, a control
+// byte n - 1 by n elements copied as they are. Repeats are at least MIN_RUN elements long.
+
+#define WORLD_MAGIC 0x44574753 // "SGWD"
+#define WORLD_VERSION 1
+#define WORLD_HEADER_SIZE 32
+#define WORLD_ENTRY_SIZE 16
+
+#define CHUNK_TILES (TILEMAP_CHUNK_SIZE * TILEMAP_CHUNK_SIZE)
+
+#if TILEMAP_CHUNK_SIZE > 32
+#error The awake area of a chunk is stored in 5 bits per coordinate
+#endif
+// Decompressed chunk with the types, lifetime and temperature.
+#define CHUNK_MAX_BYTES (CHUNK_TILES * (1 + 1 + sizeof(float)))
+// Compressed chunk in the worst case, a control byte every 128 elements of each layer. Each repeat
+// saves at least one byte more than its control byte, which pays for the control byte of the copy
+// it splits, so mixing them never takes more.
+#define CHUNK_PACKED_MAX (CHUNK_MAX_BYTES + 3 * (CHUNK_TILES / 128 + 1))
+#define MAX_RUN 128
+#define MIN_RUN 3
+
+// Layers stored besides the tile types, the flags only matter during a step.
+static const TileLayer stored_layers[] = {TILE_LAYER_LIFETIME, TILE_LAYER_TEMPERATURE};
+#define NUM_STORED_LAYERS (int)(sizeof(stored_layers) / sizeof(stored_layers[0]))
+
+typedef struct WorldHeader {
+	int w, h;
+	unsigned int layers;
+	unsigned int sim_tick;
+	int chunk_count;
+} WorldHeader;
+
+static size_t element_size(TileLayer layer) {
+	return layer == TILE_LAYER_TEMPERATURE ? sizeof(float) : sizeof(uint8_t);
+}
+
+static uint32_t read_u32(const unsigned char *p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t read_u64(const unsigned char *p) {
+	return read_u32(p) | (uint64_t)read_u32(p + 4) << 32;
+}
+
+static void write_u32(unsigned char *p, uint32_t value) {
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+}
+
+// Whether MIN_RUN equal elements start at i.
+static int starts_run(const unsigned char *src, int i, int n, size_t size) {
+	if (i + MIN_RUN > n)
+		return 0;
+
+	for (int k = 1; k < MIN_RUN; k++) {
+		if (memcmp(src + i * size, src + (i + k) * size, size) != 0)
+			return 0;
+	}
+	return 1;
+}
+
+static size_t rle_encode(const unsigned char *src, int n, size_t size, unsigned char *out) {
+	size_t o = 0;
+	int i = 0;
+
+	while (i < n) {
+		int run = 1;
+		while (i + run < n && run < MAX_RUN && memcmp(src + i * size, src + (i + run) * size, size) == 0)
+			run++;
+
+		// Shorter repeats would take more than copying the elements.
+		if (run >= MIN_RUN) {
+			out[o++] = 0x80 | (run - 1);
+			memcpy(out + o, src + i * size, size);
+			o += size;
+			i += run;
+			continue;
+		}
+
+		// Copy up to the next run.
+		int count = 1;
+		while (i + count < n && count < MAX_RUN && !starts_run(src, i + count, n, size))
+			count++;
+
+		out[o++] = count - 1;
+		memcpy(out + o, src + i * size, count * size);
+		o += count * size;
+		i += count;
+	}
+
+	return o;
+}
+
+// Returns the bytes read, 0 if the data is corrupt.
+static size_t rle_decode(const unsigned char *in, size_t in_size, int n, size_t size, unsigned char *dst) {
+	size_t o = 0;
+	int i = 0;
+
+	while (i < n) {
+		if (o >= in_size)
+			return 0;
+
+		int control = in[o++];
+		int count = (control & 0x7f) + 1;
+		if (i + count > n)
+			return 0;
+
+		if (control & 0x80) {
+			if (o + size > in_size)
+				return 0;
+			if (size == 1) {
+				memset(dst + i, in[o], count);
+			} else {
+				for (int k = 0; k < count; k++)
+					memcpy(dst + (i + k) * size, in + o, size);
+			}
+			o += size;
+		} else {
+			if (o + count * size > in_size)
+				return 0;
+			memcpy(dst + i * size, in + o, count * size);
+			o += count * size;
+		}
+
+		i += count;
+	}
+
+	return o;
+}
+
+static Rect2Di chunk_rect(int w, int h, int chunks_w, int index) {
+	int x = (index % chunks_w) * TILEMAP_CHUNK_SIZE;
+	int y = (index / chunks_w) * TILEMAP_CHUNK_SIZE;
+	return (Rect2Di){x, y, SDL_min(TILEMAP_CHUNK_SIZE, w - x), SDL_min(TILEMAP_CHUNK_SIZE, h - y)};
+}
+
+// Copies the rect of a map layer into a contiguous buffer.
+static void gather(unsigned char *dst, const unsigned char *src, size_t size, int map_w, Rect2Di r) {
+	for (int y = 0; y < r.h; y++)
+		memcpy(dst + y * r.w * size, src + ((size_t)(r.y + y) * map_w + r.x) * size, r.w * size);
+}
+
+static void scatter(unsigned char *dst, const unsigned char *src, size_t size, int map_w, Rect2Di r) {
+	for (int y = 0; y < r.h; y++)
+		memcpy(dst + ((size_t)(r.y + y) * map_w + r.x) * size, src + y * r.w * size, r.w * size);
+}
+
+// Encodes the chunk into out, at most CHUNK_PACKED_MAX bytes. Returns the size.
+static size_t encode_chunk(Tilemap *t, Rect2Di r, unsigned int layers, unsigned char *raw, unsigned char *out) {
+	int n = r.w * r.h;
+
+	gather(raw, &t->tiles->type, 1, t->w, r);
+	size_t size = rle_encode(raw, n, 1, out);
+
+	for (int i = 0; i < NUM_STORED_LAYERS; i++) {
+		TileLayer layer = stored_layers[i];
+		if (layers & (1u << layer)) {
+			gather(raw, t->layers[layer], element_size(layer), t->w, r);
+			size += rle_encode(raw, n, element_size(layer), out + size);
+		}
+	}
+
+	SDL_assert(size <= CHUNK_PACKED_MAX);
+	return size;
+}
+
+// Returns 0 if the data is corrupt, the tiles may be partly written.
+static int decode_chunk(const unsigned char *data, size_t size, unsigned int layers, int map_w, Rect2Di r,
+						Tile *tiles, void **layer_data, unsigned char *raw) {
+	int n = r.w * r.h;
+
+	size_t used = rle_decode(data, size, n, 1, raw);
+	if (!used)
+		return 0;
+
+	for (int i = 0; i < n; i++) {
+		if (raw[i] >= NUM_TILE_TYPES)
+			return 0;
+	}
+	scatter(&tiles->type, raw, 1, map_w, r);
+
+	for (int i = 0; i < NUM_STORED_LAYERS; i++) {
+		TileLayer layer = stored_layers[i];
+		if (!(layers & (1u << layer)))
+			continue;
+
+		data += used;
+		size -= used;
+		used = rle_decode(data, size, n, element_size(layer), raw);
+		if (!used)
+			return 0;
+
+		scatter(layer_data[layer], raw, element_size(layer), map_w, r);
+	}
+
+	return 1;
+}
+
+static uint32_t chunk_flags(TileChunk *chunk) {
+	uint32_t flags = chunk->heat_awake ? WORLD_CHUNK_HEAT_AWAKE : 0;
+	Rect2Di *r = &chunk->sim_next;
+
+	if (r->w != 0) {
+		uint32_t rect = (r->x - chunk->x) | (r->y - chunk->y) << 5 | (r->w - 1) << 10 | (r->h - 1) << 15;
+		flags |= WORLD_CHUNK_AWAKE | rect << WORLD_CHUNK_RECT_SHIFT;
+	}
+
+	return flags;
+}
+
+// Restores the awake areas saved with chunk_flags, the stored rect is clipped in case the file is corrupt.
+static void wake_chunk(TileChunk *chunk, uint32_t flags) {
+	chunk->sim_next.w = 0;
+	chunk->heat_awake = (flags & WORLD_CHUNK_HEAT_AWAKE) != 0;
+
+	if (flags & WORLD_CHUNK_AWAKE) {
+		uint32_t rect = flags >> WORLD_CHUNK_RECT_SHIFT;
+		int x = rect & 31;
+		int y = rect >> 5 & 31;
+		int w = SDL_min((int)(rect >> 10 & 31) + 1, chunk->w - x);
+		int h = SDL_min((int)(rect >> 15 & 31) + 1, chunk->h - y);
+		if (w > 0 && h > 0)
+			chunk->sim_next = (Rect2Di){chunk->x + x, chunk->y + y, w, h};
+	}
+}
+
+int engine_world_save(Tilemap *t, const char *path) {
+	char *full_path = engine_io_app_path(path);
+	// Written next to the file and renamed at the end, so a mapped world can be saved over itself.
+	size_t tmp_length = strlen(full_path) + 5;
+	char *tmp_path = malloc(tmp_length);
+	snprintf(tmp_path, tmp_length, "%s.tmp", full_path);
+
+	SDL_RWops *file = SDL_RWFromFile(tmp_path, "wb");
+	if (!file) {
+		engine_log_error("Error saving world %s: %s", path, SDL_GetError());
+		free(tmp_path);
+		free(full_path);
+		return 0;
+	}
+
+	unsigned int layers = 0;
+	for (int i = 0; i < NUM_STORED_LAYERS; i++) {
+		if (t->layers[stored_layers[i]])
+			layers |= 1u << stored_layers[i];
+	}
+
+	// Pending chunks are copied as they are, unless the tilemap got other layers since it was loaded.
+	if (t->source && t->source->layers != layers)
+		engine_tilemap_load_rect(t, (Rect2Di){0, 0, t->w, t->h});
+
+	int chunk_count = t->chunks_w * t->chunks_h;
+	unsigned char header[WORLD_HEADER_SIZE];
+	write_u32(header, WORLD_MAGIC);
+	write_u32(header + 4, WORLD_VERSION);
+	write_u32(header + 8, t->w);
+	write_u32(header + 12, t->h);
+	write_u32(header + 16, TILEMAP_CHUNK_SIZE);
+	write_u32(header + 20, layers);
+	write_u32(header + 24, t->sim_tick);
+	write_u32(header + 28, chunk_count);
+
+	int ok = SDL_RWwrite(file, header, sizeof(header), 1) == 1;
+
+	// The index is written once the offsets are known.
+	WorldChunkEntry *index = malloc(sizeof(WorldChunkEntry) * chunk_count);
+	uint64_t offset = WORLD_HEADER_SIZE + (uint64_t)chunk_count * WORLD_ENTRY_SIZE;
+	ok = ok && SDL_RWseek(file, offset, RW_SEEK_SET) >= 0;
+
+	// Only one chunk is in memory at a time.
+	unsigned char *raw = malloc(CHUNK_MAX_BYTES);
+	unsigned char *packed = malloc(CHUNK_PACKED_MAX);
+
+	for (int i = 0; i < chunk_count && ok; i++) {
+		TileChunk *chunk = &t->chunks[i];
+		const unsigned char *data = packed;
+		size_t size;
+
+		if (chunk->pending) {
+			WorldChunkEntry *entry = &t->source->index[i];
+			if (entry->offset > t->source->size || entry->size > t->source->size - entry->offset) {
+				ok = 0;
+				break;
+			}
+			data = t->source->data + entry->offset;
+			size = entry->size;
+			index[i].flags = entry->flags;
+		} else {
+			Rect2Di r = {chunk->x, chunk->y, chunk->w, chunk->h};
+			size = encode_chunk(t, r, layers, raw, packed);
+			index[i].flags = chunk_flags(chunk);
+		}
+
+		index[i].offset = offset;
+		index[i].size = size;
+		offset += size;
+		ok = SDL_RWwrite(file, data, size, 1) == 1;
+	}
+
+	ok = ok && SDL_RWseek(file, WORLD_HEADER_SIZE, RW_SEEK_SET) >= 0;
+	for (int i = 0; i < chunk_count && ok; i++) {
+		ok = SDL_WriteLE64(file, index[i].offset) && SDL_WriteLE32(file, index[i].size) &&
+			 SDL_WriteLE32(file, index[i].flags);
+	}
+
+	ok = SDL_RWclose(file) == 0 && ok;
+
+	if (ok) {
+#ifdef _WIN32
+		remove(full_path);
+#endif
+		ok = rename(tmp_path, full_path) == 0;
+	}
+
+	if (!ok) {
+		engine_log_error("Error writing world %s", path);
+		remove(tmp_path);
+	}
+
+	free(raw);
+	free(packed);
+	free(index);
+	free(tmp_path);
+	free(full_path);
+	return ok;
+}
+
+static int parse_header(const unsigned char *data, WorldHeader *header) {
+	unsigned int known_layers = 0;
+	for (int i = 0; i < NUM_STORED_LAYERS; i++)
+		known_layers |= 1u << stored_layers[i];
+
+	header->w = read_u32(data + 8);
+	header->h = read_u32(data + 12);
+	header->layers = read_u32(data + 20);
+	header->sim_tick = read_u32(data + 24);
+	header->chunk_count = read_u32(data + 28);
+
+	if (read_u32(data) != WORLD_MAGIC || read_u32(data + 4) != WORLD_VERSION) {
+		engine_log_error("Not a world file or from another version");
+		return 0;
+	}
+
+	int chunks_w = (header->w + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+	int chunks_h = (header->h + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+
+	if (read_u32(data + 16) != TILEMAP_CHUNK_SIZE || header->w <= 0 || header->h <= 0 ||
+		(header->layers & ~known_layers) || header->chunk_count != chunks_w * chunks_h) {
+		engine_log_error("World file with an unsupported layout");
+		return 0;
+	}
+
+	return 1;
+}
+
+static void parse_entry(const unsigned char *data, WorldChunkEntry *entry) {
+	entry->offset = read_u64(data);
+	entry->size = read_u32(data + 8);
+	entry->flags = read_u32(data + 12);
+}
+
+// Creates the tilemap with the decoded tiles and layers, every layer is NULL or of the header.
+static Tilemap *create_tilemap(WorldHeader *header, int tile_size, TilemapRenderMode mode, Tile *tiles, void **layer_data,
+							   WorldChunkEntry *index) {
+	Tilemap *t = engine_tilemap_create_tiles(header->w, header->h, tile_size, mode, tiles);
+	t->sim_tick = header->sim_tick;
+
+	for (int i = 0; i < NUM_TILE_LAYERS; i++)
+		t->layers[i] = layer_data[i];
+
+	for (int i = 0; i < header->chunk_count; i++)
+		wake_chunk(&t->chunks[i], index[i].flags);
+
+	return t;
+}
+
+// Corrupt chunks are left with the values of new tiles.
+static void *alloc_layer(WorldHeader *header, TileLayer layer) {
+	size_t count = (size_t)header->w * header->h;
+	void *data = SDL_SIMDAlloc(element_size(layer) * count);
+
+	if (layer == TILE_LAYER_TEMPERATURE) {
+		float *temperature = data;
+		for (size_t i = 0; i < count; i++)
+			temperature[i] = TILEMAP_AMBIENT_TEMPERATURE;
+	} else {
+		memset(data, 0, element_size(layer) * count);
+	}
+
+	return data;
+}
+
+static Tile *alloc_tiles(WorldHeader *header) {
+	size_t size = sizeof(Tile) * (size_t)header->w * header->h;
+	Tile *tiles = SDL_SIMDAlloc(size);
+	memset(tiles, TILE_AIR, size);
+	return tiles;
+}
+
+static Tilemap *load_streaming(const char *path, int tile_size, TilemapRenderMode mode) {
+	SDL_RWops *file = SDL_RWFromFile(path, "rb");
+	if (!file) {
+		engine_log_error("Error loading world %s: %s", path, SDL_GetError());
+		return NULL;
+	}
+
+	unsigned char header_data[WORLD_HEADER_SIZE];
+	WorldHeader header;
+	if (SDL_RWread(file, header_data, sizeof(header_data), 1) != 1 || !parse_header(header_data, &header)) {
+		SDL_RWclose(file);
+		return NULL;
+	}
+
+	WorldChunkEntry *index = malloc(sizeof(WorldChunkEntry) * header.chunk_count);
+	for (int i = 0; i < header.chunk_count; i++) {
+		unsigned char entry[WORLD_ENTRY_SIZE];
+		if (SDL_RWread(file, entry, sizeof(entry), 1) != 1) {
+			engine_log_error("World %s is truncated", path);
+			free(index);
+			SDL_RWclose(file);
+			return NULL;
+		}
+		parse_entry(entry, &index[i]);
+	}
+
+	Tile *tiles = alloc_tiles(&header);
+	void *layer_data[NUM_TILE_LAYERS] = {NULL};
+	for (int i = 0; i < NUM_STORED_LAYERS; i++) {
+		TileLayer layer = stored_layers[i];
+		if (header.layers & (1u << layer))
+			layer_data[layer] = alloc_layer(&header, layer);
+	}
+
+	// Only one chunk is in memory at a time.
+	unsigned char *packed = malloc(CHUNK_PACKED_MAX);
+	unsigned char *raw = malloc(CHUNK_MAX_BYTES);
+	int chunks_w = (header.w + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+	int corrupt = 0;
+
+	for (int i = 0; i < header.chunk_count; i++) {
+		WorldChunkEntry *entry = &index[i];
+		Rect2Di r = chunk_rect(header.w, header.h, chunks_w, i);
+
+		if (entry->size > CHUNK_PACKED_MAX || SDL_RWseek(file, entry->offset, RW_SEEK_SET) < 0 ||
+			SDL_RWread(file, packed, entry->size, 1) != 1 ||
+			!decode_chunk(packed, entry->size, header.layers, header.w, r, tiles, layer_data, raw)) {
+			corrupt++;
+		}
+	}
+
+	if (corrupt)
+		engine_log_error("%d corrupt chunks in world %s", corrupt, path);
+
+	Tilemap *t = create_tilemap(&header, tile_size, mode, tiles, layer_data, index);
+
+	free(packed);
+	free(raw);
+	free(index);
+	SDL_RWclose(file);
+	return t;
+}
+
+#if WORLD_MMAP
+static Tilemap *load_mapped(const char *path, int tile_size, TilemapRenderMode mode) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	void *data = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size >= WORLD_HEADER_SIZE)
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping stays valid without the descriptor.
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return NULL;
+
+	WorldSource *source = malloc(sizeof(WorldSource));
+	memset(source, 0, sizeof(WorldSource));
+	source->data = data;
+	source->size = st.st_size;
+
+	WorldHeader header;
+	if (!parse_header(source->data, &header) ||
+		WORLD_HEADER_SIZE + (size_t)header.chunk_count * WORLD_ENTRY_SIZE > source->size) {
+		engine_world_source_free(source);
+		return NULL;
+	}
+
+	source->layers = header.layers;
+	source->pending = header.chunk_count;
+	source->buffer = malloc(CHUNK_MAX_BYTES);
+	source->index = malloc(sizeof(WorldChunkEntry) * header.chunk_count);
+	for (int i = 0; i < header.chunk_count; i++)
+		parse_entry(source->data + WORLD_HEADER_SIZE + i * WORLD_ENTRY_SIZE, &source->index[i]);
+
+	// Nothing is built for the chunks until they are loaded, the mesh and light included.
+	Tilemap *t = engine_tilemap_create_pending(header.w, header.h, tile_size, mode, alloc_tiles(&header));
+	t->sim_tick = header.sim_tick;
+
+	// Allocated by the tilemap, the temperatures start at ambient until the chunks are loaded.
+	for (int i = 0; i < NUM_STORED_LAYERS; i++) {
+		if (header.layers & (1u << stored_layers[i]))
+			engine_tilemap_layer(t, stored_layers[i]);
+	}
+
+	t->source = source;
+
+	// Chunks that were still changing are loaded now, so they keep going without being looked at.
+	// Usually a small part of the world, the settled chunks wait for their first use.
+	for (int i = 0; i < header.chunk_count && t->source; i++) {
+		if (source->index[i].flags & (WORLD_CHUNK_AWAKE | WORLD_CHUNK_HEAT_AWAKE))
+			engine_world_load_chunk(t, &t->chunks[i]);
+	}
+
+	return t;
+}
+#endif
+
+Tilemap *engine_world_load(const char *path, int tile_size, TilemapRenderMode mode, int lazy) {
+	char *full_path = engine_io_app_path(path);
+	Tilemap *t = NULL;
+
+#if WORLD_MMAP
+	if (lazy)
+		t = load_mapped(full_path, tile_size, mode);
+#endif
+
+	// Also when the file can't be mapped.
+	if (!t)
+		t = load_streaming(full_path, tile_size, mode);
+
+	free(full_path);
+	return t;
+}
+
+void engine_world_load_chunk(Tilemap *t, TileChunk *chunk) {
+	WorldSource *source = t->source;
+	int index = (chunk->y / TILEMAP_CHUNK_SIZE) * t->chunks_w + chunk->x / TILEMAP_CHUNK_SIZE;
+	WorldChunkEntry *entry = &source->index[index];
+	Rect2Di r = {chunk->x, chunk->y, chunk->w, chunk->h};
+
+	if (entry->offset > source->size || entry->size > source->size - entry->offset ||
+		!decode_chunk(source->data + entry->offset, entry->size, source->layers, t->w, r, t->tiles, t->layers,
+					  source->buffer)) {
+		engine_log_error("Corrupt world chunk at %d, %d", chunk->x, chunk->y);
+	}
+
+	chunk->pending = 0;
+	engine_tilemap_mark_upload(t, r);
+	engine_tilemap_heat_update_chunk(t, chunk);
+
+	// The chunks around are not woken up, otherwise loading one would load the whole world.
+	wake_chunk(chunk, entry->flags);
+
+	if (--source->pending == 0) {
+		engine_world_source_free(source);
+		t->source = NULL;
+	}
+}
+
+void engine_world_source_free(WorldSource *source) {
+#if WORLD_MMAP
+	if (source->data)
+		munmap((void *)source->data, source->size);
+#endif
+	free(source->index);
+	free(source->buffer);
+	free(source);
+}
@@ -0,0 +1,50 @@
+#ifndef ENGINE_WORLD_H
+#define ENGINE_WORLD_H
+
+#include <engine/tilemap.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary world files: a header, an index with the offset of each chunk, and the chunks.
+// Each chunk holds its tile types and the lifetime and temperature layers if the tilemap has
+// them, run length encoded. Paths are inside the app directory, like engine_io_save.
+
+typedef struct WorldChunkEntry {
+	uint64_t offset; // From the start of the file.
+	uint32_t size; // Compressed bytes.
+	uint32_t flags; // WorldChunkFlags
+} WorldChunkEntry;
+
+typedef enum WorldChunkFlags {
+	WORLD_CHUNK_AWAKE = 1 << 0, // Was simulated when saved, the area is in the bits from WORLD_CHUNK_RECT_SHIFT.
+	WORLD_CHUNK_HEAT_AWAKE = 1 << 1, // Same for the heat diffusion.
+} WorldChunkFlags;
+
+// The awake area of the chunk, x, y, w - 1 and h - 1 relative to the chunk in 5 bits each.
+#define WORLD_CHUNK_RECT_SHIFT 8
+
+// A mapped world file the chunks of a lazily loaded tilemap are decompressed from.
+typedef struct WorldSource {
+	const unsigned char *data;
+	size_t size;
+	unsigned int layers; // Bit per TileLayer stored in the file.
+	WorldChunkEntry *index;
+	unsigned char *buffer; // Decompressed chunk.
+	int pending; // Chunks not loaded yet, the source is freed when it reaches 0.
+} WorldSource;
+
+// Streams the tilemap to the file chunk by chunk. Returns 0 on error.
+int engine_world_save(Tilemap *t, const char *path);
+
+// With lazy, the file is mapped and each chunk is decompressed the first time it is used, its mesh
+// and light built then too, so opening a big world takes no time. Otherwise, or where mapping is not supported, the chunks are
+// read one by one. Returns NULL on error.
+Tilemap *engine_world_load(const char *path, int tile_size, TilemapRenderMode mode, int lazy);
+
+// Used internally, decompresses a pending chunk from the tilemap source.
+void engine_world_load_chunk(Tilemap *t, TileChunk *chunk);
+
+// Used internally
+void engine_world_source_free(WorldSource *source);
+
+#endif
@@ -0,0 +1,240 @@
+#include "worldgen.h"
+#include <SDL.h>
+#include <engine/logger.h>
+#include <engine/random.h>
+#include <engine/jobs.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The noise is value noise on a lattice with a power of two spacing, so inside a lattice cell the
+// interpolation weights along a row are the same for every cell and come from a table. A row is
+// then a few lattice lookups and a multiply add over the table, done four tiles at a time.
+
+#define MAX_SHIFT 6 // Widest lattice spacing, 64 tiles.
+#define ROW_MAX 64 // Tiles of a row evaluated at once.
+
+typedef struct Octave {
+	int shift; // Lattice spacing is 1 << shift tiles.
+	float amplitude;
+} Octave;
+
+static const Octave cave_octaves[] = {{6, 0.6f}, {5, 0.3f}, {4, 0.15f}};
+static const Octave coal_octaves[] = {{3, 0.7f}, {2, 0.3f}};
+static const Octave lava_octaves[] = {{5, 1.0f}};
+static const Octave surface_octaves[] = {{6, 0.8f}, {4, 0.2f}};
+
+// Salts for the seed of each noise field.
+enum {
+	FIELD_SURFACE = 1,
+	FIELD_CAVES,
+	FIELD_COAL,
+	FIELD_LAVA,
+};
+
+// Smoothstep weights of the positions inside a lattice cell, for every spacing.
+typedef struct Ramps {
+	float values[MAX_SHIFT + 1][1 << MAX_SHIFT];
+} Ramps;
+
+static Ramps ramps;
+static SDL_atomic_t ramps_ready;
+static SDL_SpinLock ramps_lock;
+
+// Built by the first call, which can be on any of the job threads.
+static const Ramps *get_ramps() {
+	if (!SDL_AtomicGet(&ramps_ready)) {
+		SDL_AtomicLock(&ramps_lock);
+		if (!SDL_AtomicGet(&ramps_ready)) {
+			for (int shift = 0; shift <= MAX_SHIFT; shift++) {
+				int period = 1 << shift;
+				for (int i = 0; i < period; i++) {
+					float t = (float)i / period;
+					ramps.values[shift][i] = t * t * (3 - 2 * t);
+				}
+			}
+			SDL_AtomicSet(&ramps_ready, 1);
+		}
+		SDL_AtomicUnlock(&ramps_lock);
+	}
+	return &ramps;
+}
+
+// Floor of v / 2^shift, also for negative values.
+static int floor_shift(int v, int shift) {
+	return v >= 0 ? v >> shift : ~(~v >> shift);
+}
+
+// v - floor_shift(v, shift) * 2^shift, without shifting negative values.
+static int mod_shift(int v, int shift) {
+	return v & ((1 << shift) - 1);
+}
+
+static uint32_t field_seed(uint64_t seed, int field) {
+	Random r;
+	engine_random_seed(&r, seed + field * 0x9e3779b97f4a7c15ull);
+	return engine_random_next(&r);
+}
+
+// Value of a lattice point, in [-1, 1).
+static float lattice(uint32_t seed, int ix, int iy) {
+	uint32_t h = seed ^ (uint32_t)ix * 0x8da6b343u ^ (uint32_t)iy * 0xd8163841u;
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return (h >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+// out[i] += a + b * ramp[i]
+static void add_ramp(float *out, const float *ramp, int n, float a, float b) {
+	int i = 0;
+
+#if defined(__SSE2__)
+	__m128 va = _mm_set1_ps(a);
+	__m128 vb = _mm_set1_ps(b);
+	for (; i + 4 <= n; i += 4) {
+		__m128 v = _mm_add_ps(va, _mm_mul_ps(vb, _mm_loadu_ps(ramp + i)));
+		_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), v));
+	}
+#endif
+
+	for (; i < n; i++)
+		out[i] += a + b * ramp[i];
+}
+
+// Adds the octaves of the noise at row y, tiles [x0, x0 + n), to out.
+static void noise_row(const Ramps *ramps, uint32_t seed, const Octave *octaves, int count, int x0, int y, int n, float *out) {
+	for (int o = 0; o < count; o++) {
+		int shift = octaves[o].shift;
+		float amplitude = octaves[o].amplitude;
+		int iy = floor_shift(y, shift);
+		float sy = ramps->values[shift][mod_shift(y, shift)];
+
+		int x = x0;
+		while (x < x0 + n) {
+			int ix = floor_shift(x, shift);
+			int i = mod_shift(x, shift);
+			int length = SDL_min((1 << shift) - i, x0 + n - x);
+
+			// The row crosses the cell at sy, along it the value goes linearly with the ramp.
+			float top = lattice(seed, ix, iy);
+			float bottom = lattice(seed, ix, iy + 1);
+			float left = top + (bottom - top) * sy;
+			top = lattice(seed, ix + 1, iy);
+			bottom = lattice(seed, ix + 1, iy + 1);
+			float right = top + (bottom - top) * sy;
+
+			add_ramp(out + x - x0, ramps->values[shift] + i, length, amplitude * left, amplitude * (right - left));
+			x += length;
+		}
+	}
+}
+
+static TileType tile_at(const WorldGenParams *p, int y, int surface, float cave, float coal, float lava) {
+	int depth = y - surface;
+
+	if (depth < 0)
+		return TILE_AIR;
+
+	// No caves right at the surface, so the ground is not full of holes.
+	if (depth > p->sand_depth && cave > p->caves) {
+		if (y >= p->lava_depth && lava > p->lava)
+			return TILE_LAVA;
+		if (y >= p->water_table)
+			return TILE_WATER;
+		return TILE_AIR;
+	}
+
+	if (depth < p->sand_depth)
+		return TILE_SAND;
+	if (coal > p->coal)
+		return TILE_COAL;
+
+	return TILE_ROCK;
+}
+
+static void generate_segment(const WorldGenParams *p, const Ramps *ramps, int x0, int n, Rect2Di r, Tile *out, int stride) {
+	float surface_noise[ROW_MAX] = {0};
+	int surface[ROW_MAX];
+	noise_row(ramps, field_seed(p->seed, FIELD_SURFACE), surface_octaves, SDL_arraysize(surface_octaves), x0, 0, n, surface_noise);
+	for (int x = 0; x < n; x++)
+		surface[x] = p->surface + (int)(surface_noise[x] * p->surface_height);
+
+	uint32_t cave_seed = field_seed(p->seed, FIELD_CAVES);
+	uint32_t coal_seed = field_seed(p->seed, FIELD_COAL);
+	uint32_t lava_seed = field_seed(p->seed, FIELD_LAVA);
+
+	for (int y = r.y; y < r.y + r.h; y++) {
+		float cave[ROW_MAX] = {0};
+		float coal[ROW_MAX] = {0};
+		float lava[ROW_MAX] = {0};
+		noise_row(ramps, cave_seed, cave_octaves, SDL_arraysize(cave_octaves), x0, y, n, cave);
+		noise_row(ramps, coal_seed, coal_octaves, SDL_arraysize(coal_octaves), x0, y, n, coal);
+		noise_row(ramps, lava_seed, lava_octaves, SDL_arraysize(lava_octaves), x0, y, n, lava);
+
+		Tile *row = out + (size_t)(y - r.y) * stride + x0 - r.x;
+		for (int x = 0; x < n; x++)
+			row[x].type = tile_at(p, y, surface[x], cave[x], coal[x], lava[x]);
+	}
+}
+
+void engine_worldgen_params(WorldGenParams *p, uint64_t seed, int h) {
+	p->seed = seed;
+	p->surface = h / 8;
+	p->surface_height = h / 16;
+	p->sand_depth = 4;
+	p->caves = 0.2f;
+	p->coal = 0.45f;
+	p->lava = 0.1f;
+	p->water_table = h / 2;
+	p->lava_depth = h * 3 / 4;
+}
+
+void engine_worldgen_rect(const WorldGenParams *p, Rect2Di r, Tile *out, int stride) {
+	const Ramps *ramps = get_ramps();
+
+	for (int x = r.x; x < r.x + r.w; x += ROW_MAX)
+		generate_segment(p, ramps, x, SDL_min(ROW_MAX, r.x + r.w - x), r, out, stride);
+}
+
+typedef struct GenContext {
+	const WorldGenParams *p;
+	Tile *tiles;
+	int w, h;
+	int chunks_w;
+} GenContext;
+
+static void generate_chunk(void *data, int index) {
+	GenContext *ctx = data;
+	int x = (index % ctx->chunks_w) * TILEMAP_CHUNK_SIZE;
+	int y = (index / ctx->chunks_w) * TILEMAP_CHUNK_SIZE;
+	Rect2Di r = {x, y, SDL_min(TILEMAP_CHUNK_SIZE, ctx->w - x), SDL_min(TILEMAP_CHUNK_SIZE, ctx->h - y)};
+
+	engine_worldgen_rect(ctx->p, r, ctx->tiles + (size_t)y * ctx->w + x, ctx->w);
+}
+
+Tilemap *engine_worldgen_create(const WorldGenParams *p, int w, int h, int tile_size, TilemapRenderMode mode) {
+	Uint64 start = SDL_GetPerformanceCounter();
+
+	GenContext ctx;
+	ctx.p = p;
+	ctx.tiles = SDL_SIMDAlloc(sizeof(Tile) * (size_t)w * h);
+	ctx.w = w;
+	ctx.h = h;
+	ctx.chunks_w = (w + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+	int chunk_count = ctx.chunks_w * ((h + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE);
+
+	engine_jobs_for(chunk_count, generate_chunk, &ctx);
+	int threads = engine_jobs_thread_count();
+
+	double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency();
+	double millions = (double)w * h / 1000000;
+	engine_log_info("Generated a %dx%d world in %.1f ms on %d threads, %.2f ms per million tiles", w, h, ms, threads,
+					ms / millions);
+
+	return engine_tilemap_create_tiles(w, h, tile_size, mode, ctx.tiles);
+}
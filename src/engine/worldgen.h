@@ -0,0 +1,33 @@
+#ifndef ENGINE_WORLDGEN_H
+#define ENGINE_WORLDGEN_H
+
+#include <engine/tilemap.h>
+#include <stdint.h>
+
+// Noise based terrain: hills of sand over rock, caves, coal veins, caves flooded below the water
+// table and lava pockets deeper down. Every tile only depends on the seed and its position, so
+// chunks can be generated in any order and on any thread with the same result.
+
+typedef struct WorldGenParams {
+	uint64_t seed;
+	int surface; // Average ground level, in tiles from the top.
+	int surface_height; // How far the hills go above and below it.
+	int sand_depth; // Sand below the surface.
+	float caves; // Noise threshold for caves, from -1 to 1, higher means fewer caves.
+	float coal; // Same for coal veins.
+	float lava; // Same for lava in the caves below lava_depth.
+	int water_table; // Caves below this row are flooded.
+	int lava_depth; // Caves below this row may have lava.
+} WorldGenParams;
+
+// Parameters for a map h tiles high.
+void engine_worldgen_params(WorldGenParams *p, uint64_t seed, int h);
+
+// Writes the tiles of r row by row to out, stride is the tiles between the start of two rows.
+// Coordinates can be negative.
+void engine_worldgen_rect(const WorldGenParams *p, Rect2Di r, Tile *out, int stride);
+
+// Generates the chunks across the job threads and logs the time per million tiles.
+Tilemap *engine_worldgen_create(const WorldGenParams *p, int w, int h, int tile_size, TilemapRenderMode mode);
+
+#endif
@@ -0,0 +1,118 @@
+#include <engine/io.h>
+#include <engine/jobs.h>
+#include <engine/tilemap.h>
+#include <engine/world.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Saves tilemaps whose layers defeat the run length encoding and checks they load back the same,
+// streamed and mapped. Not a multiple of the chunk size, so the edge chunks are smaller.
+
+#define MAP_W 100
+#define MAP_H 70
+#define PATH "world_test.world"
+
+typedef int (*PATTERN_FN)(int i);
+
+// A copy then a repeat of two, the worst case when repeats of two were written.
+static int pattern_xyy(int i) {
+	return i % 3 == 0 ? 1 : 2;
+}
+
+static int pattern_distinct(int i) {
+	return i;
+}
+
+// Repeats of two and three alternating.
+static int pattern_pairs_triples(int i) {
+	int k = i % 5;
+	return k < 2 ? 0 : 1;
+}
+
+// Repeats just over the longest one.
+static int pattern_long_runs(int i) {
+	return (i / 130) % 2;
+}
+
+static int pattern_random(int i) {
+	return rand();
+}
+
+static int pattern_uniform(int i) {
+	return 3;
+}
+
+static const struct {
+	const char *name;
+	PATTERN_FN fn;
+} patterns[] = {
+	{"x,y,y", pattern_xyy},
+	{"distinct", pattern_distinct},
+	{"pairs and triples", pattern_pairs_triples},
+	{"long runs", pattern_long_runs},
+	{"random", pattern_random},
+	{"uniform", pattern_uniform},
+};
+
+static void fill(Tilemap *t, PATTERN_FN fn) {
+	uint8_t *lifetime = engine_tilemap_layer(t, TILE_LAYER_LIFETIME);
+	float *temperature = engine_tilemap_layer(t, TILE_LAYER_TEMPERATURE);
+
+	for (int i = 0; i < t->w * t->h; i++) {
+		int value = fn(i);
+		t->tiles[i].type = value % NUM_TILE_TYPES;
+		lifetime[i] = value;
+		temperature[i] = (float)(value % 1000) * 0.5f;
+	}
+}
+
+// Returns 1 if b has the tiles and layers of a.
+static int same(Tilemap *a, Tilemap *b) {
+	engine_tilemap_load_rect(b, (Rect2Di){0, 0, b->w, b->h});
+
+	size_t n = (size_t)a->w * a->h;
+	return b->w == a->w && b->h == a->h && b->layers[TILE_LAYER_LIFETIME] && b->layers[TILE_LAYER_TEMPERATURE] &&
+		   memcmp(a->tiles, b->tiles, n) == 0 &&
+		   memcmp(a->layers[TILE_LAYER_LIFETIME], b->layers[TILE_LAYER_LIFETIME], n) == 0 &&
+		   memcmp(a->layers[TILE_LAYER_TEMPERATURE], b->layers[TILE_LAYER_TEMPERATURE], n * sizeof(float)) == 0;
+}
+
+static int check(const char *name, Tilemap *t, int lazy) {
+	Tilemap *loaded = engine_world_load(PATH, 8, TILEMAP_RENDER_MESH, lazy);
+	int ok = loaded && same(t, loaded);
+
+	if (!ok)
+		printf("%s: %s load differs\n", name, lazy ? "mapped" : "streamed");
+	if (loaded)
+		loaded->entity.on_free(&loaded->entity);
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	engine_jobs_init(1);
+	srand(1);
+
+	int failed = 0;
+	for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+		Tilemap *t = engine_tilemap_create(MAP_W, MAP_H, 8, TILE_AIR);
+		fill(t, patterns[i].fn);
+
+		if (!engine_world_save(t, PATH)) {
+			printf("%s: save failed\n", patterns[i].name);
+			failed++;
+		} else if (!check(patterns[i].name, t, 0) || !check(patterns[i].name, t, 1)) {
+			failed++;
+		}
+
+		t->entity.on_free(&t->entity);
+	}
+
+	char *path = engine_io_app_path(PATH);
+	remove(path);
+	free(path);
+	engine_jobs_quit();
+
+	printf("%d of %d patterns failed\n", failed, (int)(sizeof(patterns) / sizeof(patterns[0])));
+	return failed != 0;
+}